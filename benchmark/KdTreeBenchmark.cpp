@@ -0,0 +1,444 @@
+/**
+ * @file KdTreeBenchmark.cpp
+ * @brief KdTree build and query throughput, and geometry kernel costs
+ *
+ * Results as JSON (for tracking over time):
+ *     cs350-benchmark --benchmark_out=kdtree.json --benchmark_out_format=json
+ *
+ * On Linux, build and query benchmarks also report hardware counters per triangle/ray (cycles, instructions,
+ * cache and branch misses) when perf_event_open is allowed, e.g. with kernel.perf_event_paranoid <= 2.
+ *
+ * Build and load phases of the whole run as a Chrome/Perfetto trace:
+ *     cs350-benchmark --cs350_trace=kdtree_trace.json
+ *
+ * Render benchmarks are the end to end throughput reference: a 512x512 ray cast with shadows and 4 AO rays per hit,
+ * on every hardware thread (MRays/s counts all rays).
+ *
+ * Instrumentation::None is free by construction, its code is compared with a build without the hooks by:
+ *     benchmark/check_instrumentation.sh -I<glm and fmt include folders>
+ *
+ * QueryLatency benchmarks report p50/p99/p99.9 latency and nodes/triangles per query as counters,
+ * their full histograms are written with:
+ *     cs350-benchmark --benchmark_filter=QueryLatency --cs350_histograms=kdtree_latency.json
+ */
+#include "CS350Loader.hpp"
+#include "ChromeTrace.hpp"
+#include "KdTree.hpp"
+#include "LatencyHistogram.hpp"
+#include "MeshGenerator.hpp"
+#include "PerfCounters.hpp"
+#include "Quantization.hpp"
+#include "RayCaster.hpp"
+#include "SceneLoader.hpp"
+#include "ShapeUtils.hpp"
+#include "Stats.hpp"
+#include "ThreadPool.hpp"
+#include "Utils.hpp"
+
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using CS350::Instrumentation;
+
+    char const* const cMeshes[]     = { "avocado", "suzanne", "bunny", "bunny-dense" };
+    size_t const      cRayCount     = 1 << 14;
+    unsigned const    cRaySeed      = 0x350;
+    int const         cBuildDepths[] = { 8, 16, 0 };
+
+    enum class RaySet { Random, Camera, Shadow, Diffuse };
+    char const* const cRaySetNames[] = { "random", "camera", "shadow", "diffuse" };
+
+    /**
+     * A mesh, its tree (unlimited depth) and the ray sets used to query it. Built on first use
+     */
+    struct Fixture {
+        std::vector<CS350::Triangle> triangles;
+        CS350::KdTree                kdtree;
+        vec3                         bv_min{ 0.0f };
+        vec3                         bv_max{ 0.0f };
+        std::vector<CS350::Ray>      rays[4];
+    };
+
+    vec3 RandomUnitVector(std::mt19937& rng) {
+        std::normal_distribution<float> normal;
+        vec3                            v(normal(rng), normal(rng), normal(rng));
+        float                           length = glm::length(v);
+        return length > 0.0f ? v / length : vec3(0, 1, 0);
+    }
+
+    std::vector<CS350::Ray> MakeRays(Fixture const& fixture, RaySet set) {
+        std::mt19937                          rng(cRaySeed + unsigned(set));
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        vec3                                  center = (fixture.bv_min + fixture.bv_max) * 0.5f;
+        float                                 radius = glm::length(fixture.bv_max - fixture.bv_min) * 0.5f;
+        std::vector<CS350::Ray>               rays;
+        rays.reserve(cRayCount);
+
+        // Primary rays of a pinhole camera framing the mesh
+        vec3 eye     = center + vec3(0.0f, 0.3f, 2.0f) * radius * 1.5f;
+        vec3 forward = glm::normalize(center - eye);
+        vec3 right   = glm::normalize(glm::cross(forward, vec3(0, 1, 0)));
+        vec3 up      = glm::cross(right, forward);
+        size_t side  = size_t(std::sqrt(double(cRayCount)));
+        auto   camera_ray = [&](size_t i) {
+            float u = (float(i % side) + 0.5f) / float(side) * 2.0f - 1.0f;
+            float v = (float(i / side) + 0.5f) / float(side) * 2.0f - 1.0f;
+            return CS350::Ray(eye, forward + (right * u + up * v) * 0.3f);
+        };
+
+        switch (set) {
+            case RaySet::Random:
+                // Outside the mesh towards its inner region, as in the tests
+                for (size_t i = 0; i < cRayCount; ++i) {
+                    vec3 origin = center + RandomUnitVector(rng) * radius * (1.0f + 2.0f * unit(rng));
+                    vec3 target = center + RandomUnitVector(rng) * radius * 0.5f * unit(rng);
+                    rays.emplace_back(origin, target - origin);
+                }
+                break;
+            case RaySet::Camera:
+                for (size_t i = 0; i < cRayCount; ++i) {
+                    rays.push_back(camera_ray(i % (side * side)));
+                }
+                break;
+            case RaySet::Shadow:
+            case RaySet::Diffuse: {
+                // Secondary rays start on the visible surface
+                vec3   light = center + vec3(1.0f, 2.0f, 1.0f) * radius * 2.0f;
+                size_t i     = 0;
+                while (rays.size() < cRayCount && i < cRayCount * 4) {
+                    auto primary = camera_ray((i++) % (side * side));
+                    auto hit     = fixture.kdtree.get_closest<Instrumentation::None>(fixture.triangles, primary, nullptr);
+                    if (!hit) {
+                        continue;
+                    }
+                    auto const& tri    = fixture.triangles[hit.triangle_index];
+                    vec3        normal = glm::cross(tri[1] - tri[0], tri[2] - tri[0]);
+                    normal             = glm::dot(normal, primary.direction) > 0.0f ? -normal : normal;
+                    normal             = glm::length(normal) > 0.0f ? glm::normalize(normal) : -primary.direction;
+                    vec3 origin        = primary.origin + primary.direction * hit.t + normal * radius * 1e-4f;
+                    if (set == RaySet::Shadow) {
+                        rays.emplace_back(origin, light - origin);
+                    } else {
+                        vec3 direction = normal + RandomUnitVector(rng); // Cosine weighted
+                        rays.emplace_back(origin, glm::length(direction) > 1e-6f ? direction : normal);
+                    }
+                }
+                break;
+            }
+        }
+        return rays;
+    }
+
+    Fixture const& GetFixture(std::string const& mesh) {
+        static std::map<std::string, std::unique_ptr<Fixture>> fixtures;
+        auto&                                                  fixture = fixtures[mesh];
+        if (!fixture) {
+            fixture = std::make_unique<Fixture>();
+            auto data = CS350::LoadCS350Binary(fmt::format("./assets/cs350/{}.cs350_binary", mesh));
+            fixture->triangles = CS350::TrianglesFromPrimitive(data);
+            fixture->bv_min    = data.bvMin;
+            fixture->bv_max    = data.bvMax;
+            CS350::KdTree::Config config;
+            config.max_depth = 0;
+            fixture->kdtree.build(fixture->triangles, config);
+            for (int set = 0; set < 4; ++set) {
+                fixture->rays[set] = MakeRays(*fixture, RaySet(set));
+            }
+        }
+        return *fixture;
+    }
+
+    /**
+     * Hardware counters per unit of work, as "<event>_per_<unit>". Nothing is reported where perf is not available
+     */
+    void ReportPerfCounters(benchmark::State& state, CS350::PerfCounters const& perf, double units_per_iteration, char const* unit) {
+        auto   sample = perf.read();
+        double units  = units_per_iteration * double(state.iterations());
+        for (int e = 0; e < CS350::PerfCounters::cEventCount; ++e) {
+            if (sample.valid[size_t(e)]) {
+                state.counters[fmt::format("{}_per_{}", CS350::PerfCounters::Name(CS350::PerfCounters::Event(e)), unit)] = double(sample.values[size_t(e)]) / units;
+            }
+        }
+        if (sample.valid[CS350::PerfCounters::cCycles] && sample.valid[CS350::PerfCounters::cInstructions] && sample[CS350::PerfCounters::cCycles] > 0) {
+            state.counters["ipc"] = double(sample[CS350::PerfCounters::cInstructions]) / double(sample[CS350::PerfCounters::cCycles]);
+        }
+    }
+
+    void BuildBenchmark(benchmark::State& state, std::string const& mesh, int max_depth) {
+        auto const&           fixture = GetFixture(mesh);
+        CS350::KdTree::Config config;
+        config.max_depth = max_depth;
+        CS350::KdTree       kdtree;
+        CS350::PerfCounters perf;
+        {
+            CS350::PerfScope scope(perf);
+            for (auto _ : state) {
+                kdtree.build(fixture.triangles, config);
+                benchmark::DoNotOptimize(kdtree.nodes().data());
+            }
+        }
+        ReportPerfCounters(state, perf, double(fixture.triangles.size()), "triangle");
+        state.counters["triangles_per_second"] = benchmark::Counter(double(fixture.triangles.size()), benchmark::Counter::kIsIterationInvariantRate);
+        state.counters["nodes"]                = double(kdtree.nodes().size());
+        state.counters["triangles"]            = double(fixture.triangles.size());
+        auto quality                           = kdtree.quality_report();
+        state.counters["sah_cost"]             = double(quality.sah_cost);
+        state.counters["duplication_factor"]   = double(quality.duplication_factor);
+    }
+
+    /**
+     * Build time on synthetic meshes, state.range(0) triangles (generated outside the timed loop)
+     */
+    void BuildScalingBenchmark(benchmark::State& state, CS350::MeshShape shape) {
+        CS350::MeshGeneratorConfig cfg;
+        cfg.shape          = shape;
+        cfg.triangle_count = size_t(state.range(0));
+        CS350::ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+        auto              triangles = CS350::GenerateTriangles(cfg, &pool);
+
+        CS350::KdTree::Config config;
+        config.max_depth = 0;
+        CS350::KdTree       kdtree;
+        CS350::PerfCounters perf;
+        {
+            CS350::PerfScope scope(perf);
+            for (auto _ : state) {
+                kdtree.build(triangles, config);
+                benchmark::DoNotOptimize(kdtree.nodes().data());
+            }
+        }
+        ReportPerfCounters(state, perf, double(triangles.size()), "triangle");
+        state.counters["triangles_per_second"] = benchmark::Counter(double(triangles.size()), benchmark::Counter::kIsIterationInvariantRate);
+        state.counters["nodes"]                = double(kdtree.nodes().size());
+        state.counters["triangles"]            = double(triangles.size());
+        auto quality                           = kdtree.quality_report();
+        state.counters["sah_cost"]             = double(quality.sah_cost);
+        state.counters["duplication_factor"]   = double(quality.duplication_factor);
+    }
+
+    template <Instrumentation Level>
+    void QueryBenchmark(benchmark::State& state, std::string const& mesh, RaySet set) {
+        auto const&         fixture = GetFixture(mesh);
+        auto const&         rays    = fixture.rays[int(set)];
+        size_t              hits    = 0;
+        CS350::PerfCounters perf;
+        CS350::Stats::Instance().Reset();
+        {
+            CS350::PerfScope scope(perf);
+            for (auto _ : state) {
+                hits = 0;
+                for (auto const& ray : rays) {
+                    hits += fixture.kdtree.get_closest<Level>(fixture.triangles, ray, nullptr) ? 1 : 0;
+                }
+                benchmark::DoNotOptimize(hits);
+            }
+        }
+        state.counters["rays_per_second"] = benchmark::Counter(double(rays.size()), benchmark::Counter::kIsIterationInvariantRate);
+        state.counters["hit_ratio"]       = double(hits) / double(rays.size());
+        ReportPerfCounters(state, perf, double(rays.size()), "ray");
+        if constexpr (Level != Instrumentation::None) {
+            double total_rays                         = double(rays.size()) * double(state.iterations());
+            state.counters["ray_vs_aabb_per_ray"]     = double(CS350::Stats::Instance().rayVsAabb) / total_rays;
+            state.counters["ray_vs_triangle_per_ray"] = double(CS350::Stats::Instance().rayVsTriangle) / total_rays;
+        }
+    }
+
+    // Histograms of the last run of every QueryLatency benchmark, by name
+    std::map<std::string, CS350::QueryHistograms> g_latency_histograms;
+
+    /**
+     * Per query distributions (CycleClock latency, nodes visited, triangles tested). Counting goes through a TraceSink,
+     * so latencies include it: compare them with each other, not with Query/ throughput
+     */
+    void QueryLatencyBenchmark(benchmark::State& state, std::string const& name, std::string const& mesh, RaySet set) {
+        auto const&          fixture = GetFixture(mesh);
+        auto const&          rays    = fixture.rays[int(set)];
+        CS350::QueryProfiler profiler;
+        for (auto _ : state) {
+            for (auto const& ray : rays) {
+                benchmark::DoNotOptimize(profiler.get_closest(fixture.kdtree, fixture.triangles, ray));
+            }
+        }
+        auto const& histograms            = profiler.histograms();
+        state.counters["rays_per_second"] = benchmark::Counter(double(rays.size()), benchmark::Counter::kIsIterationInvariantRate);
+        state.counters["latency_p50_ns"]  = double(histograms.latency_ns.percentile(0.5));
+        state.counters["latency_p99_ns"]  = double(histograms.latency_ns.percentile(0.99));
+        state.counters["latency_p999_ns"] = double(histograms.latency_ns.percentile(0.999));
+        state.counters["latency_max_ns"]  = double(histograms.latency_ns.max());
+        state.counters["nodes_p99"]       = double(histograms.nodes_visited.percentile(0.99));
+        state.counters["triangles_p99"]   = double(histograms.triangles_tested.percentile(0.99));
+        g_latency_histograms[name]        = histograms;
+    }
+
+    void QueryScalingBenchmark(benchmark::State& state, std::string const& mesh) {
+        auto const&       fixture = GetFixture(mesh);
+        auto const&       rays    = fixture.rays[int(RaySet::Random)];
+        CS350::ThreadPool pool(unsigned(state.range(0)));
+        std::vector<float> results(rays.size());
+        for (auto _ : state) {
+            pool.parallel_for(rays.size(), [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    results[i] = fixture.kdtree.get_closest<Instrumentation::None>(fixture.triangles, rays[i], nullptr).t;
+                }
+            });
+            benchmark::DoNotOptimize(results.data());
+        }
+        state.counters["rays_per_second"] = benchmark::Counter(double(rays.size()), benchmark::Counter::kIsIterationInvariantRate);
+        state.counters["threads"]         = double(state.range(0));
+    }
+
+    void RenderBenchmark(benchmark::State& state, std::string const& mesh) {
+        auto const&       fixture = GetFixture(mesh);
+        vec3              center  = (fixture.bv_min + fixture.bv_max) * 0.5f;
+        float             radius  = glm::length(fixture.bv_max - fixture.bv_min) * 0.5f;
+        CS350::ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1); // The calling thread renders too
+        CS350::Camera     camera;
+        camera.SetPosition(center + vec3(0.0f, 0.3f, 2.0f) * radius * 1.5f);
+        camera.SetTarget(center);
+
+        CS350::RenderSettings settings;
+        settings.ao_samples = 4;
+        settings.pool       = &pool;
+        CS350::RenderStats stats;
+        for (auto _ : state) {
+            auto result = CS350::RenderKdTree(camera, fixture.kdtree, fixture.triangles, settings);
+            stats       = result.stats;
+            benchmark::DoNotOptimize(result.image.rgba.data());
+        }
+        state.counters["mrays"]          = benchmark::Counter(double(stats.total_rays()) * 1e-6, benchmark::Counter::kIsIterationInvariantRate); // Per second
+        state.counters["rays_per_frame"] = double(stats.total_rays());
+        state.counters["threads"]        = double(stats.threads);
+    }
+
+    // Kernels, cycling over a few inputs so that branches are not trivially predicted
+    void RayAabbKernel(benchmark::State& state) {
+        auto const& fixture = GetFixture("bunny");
+        auto const& rays    = fixture.rays[int(RaySet::Random)];
+        auto const& aabbs   = fixture.kdtree.aabbs();
+        size_t      i       = 0;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(CS350::IntersectionTimeRayAabb<Instrumentation::None>(rays[i % rays.size()], aabbs[i % aabbs.size()]));
+            ++i;
+        }
+    }
+
+    void RayTriangleKernel(benchmark::State& state) {
+        auto const& fixture = GetFixture("bunny");
+        auto const& rays    = fixture.rays[int(RaySet::Random)];
+        size_t      i       = 0;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(CS350::IntersectionTimeRayTriangle<Instrumentation::None>(rays[i % rays.size()], fixture.triangles[i % fixture.triangles.size()]));
+            ++i;
+        }
+    }
+
+    void ClassifyPointAabbKernel(benchmark::State& state) {
+        auto const& fixture = GetFixture("bunny");
+        auto const& aabbs   = fixture.kdtree.aabbs();
+        size_t      i       = 0;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(CS350::ClassifyPointAabb(fixture.triangles[i % fixture.triangles.size()][0], aabbs[i % aabbs.size()]));
+            ++i;
+        }
+    }
+
+    void DequantizeTriangleKernel(benchmark::State& state) {
+        auto const&               fixture = GetFixture("bunny");
+        CS350::QuantizedTriangles quantized(fixture.triangles);
+        size_t                    i = 0;
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(quantized[i % quantized.size()]);
+            ++i;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    // Own flags, removed before google benchmark sees the arguments
+    std::string trace_file;
+    std::string histograms_file;
+    int         kept = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--cs350_trace=", 0) == 0) {
+            trace_file = arg.substr(std::strlen("--cs350_trace="));
+        } else if (arg.rfind("--cs350_histograms=", 0) == 0) {
+            histograms_file = arg.substr(std::strlen("--cs350_histograms="));
+        } else {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+    if (!trace_file.empty()) {
+        CS350::ChromeTrace::Instance().start();
+    }
+    CS350::ChangeWorkdir();
+
+    for (auto const* mesh : cMeshes) {
+        for (int depth : cBuildDepths) {
+            benchmark::RegisterBenchmark(fmt::format("Build/{}/max_depth:{}", mesh, depth).c_str(), BuildBenchmark, mesh, depth)->Unit(benchmark::kMillisecond);
+        }
+    }
+    for (auto shape : { CS350::MeshShape::Sphere, CS350::MeshShape::Terrain, CS350::MeshShape::Soup, CS350::MeshShape::Clustered, CS350::MeshShape::Slivers }) {
+        benchmark::RegisterBenchmark(fmt::format("BuildScaling/{}", CS350::MeshShapeName(shape)).c_str(), BuildScalingBenchmark, shape)
+            ->RangeMultiplier(10)
+            ->Range(1000, 1000000)
+            ->Unit(benchmark::kMillisecond);
+    }
+    for (auto const* mesh : cMeshes) {
+        for (int set = 0; set < 4; ++set) {
+            benchmark::RegisterBenchmark(fmt::format("Query/{}/{}", mesh, cRaySetNames[set]).c_str(), QueryBenchmark<Instrumentation::None>, mesh, RaySet(set))->Unit(benchmark::kMillisecond);
+        }
+    }
+    for (int set = 0; set < 4; ++set) {
+        auto name = fmt::format("QueryLatency/bunny-dense/{}", cRaySetNames[set]);
+        benchmark::RegisterBenchmark(name.c_str(), QueryLatencyBenchmark, name, "bunny-dense", RaySet(set))->Unit(benchmark::kMillisecond);
+    }
+    for (auto const* mesh : cMeshes) {
+        benchmark::RegisterBenchmark(fmt::format("Render/{}", mesh).c_str(), RenderBenchmark, mesh)->UseRealTime()->Unit(benchmark::kMillisecond);
+    }
+    // Cost of counting (Instrumentation::Counters), against Query/bunny-dense/random (None). The default entry points use
+    // CS350_INSTRUMENTATION: none in cs350-lib, trace in the test and demo builds. None itself is checked by check_instrumentation.sh
+    benchmark::RegisterBenchmark("QueryCounters/bunny-dense/random", QueryBenchmark<Instrumentation::Counters>, "bunny-dense", RaySet::Random)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("QueryScaling/bunny-dense/random", QueryScalingBenchmark, "bunny-dense")
+        ->RangeMultiplier(2)
+        ->Range(1, int64_t(std::max(1u, std::thread::hardware_concurrency())))
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("Kernel/RayAabb", RayAabbKernel);
+    benchmark::RegisterBenchmark("Kernel/RayTriangle", RayTriangleKernel);
+    benchmark::RegisterBenchmark("Kernel/ClassifyPointAabb", ClassifyPointAabbKernel);
+    benchmark::RegisterBenchmark("Kernel/DequantizeTriangle", DequantizeTriangleKernel);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    if (!trace_file.empty()) {
+        CS350::ChromeTrace::Instance().stop();
+        CS350::ChromeTrace::Instance().save(trace_file);
+    }
+    if (!histograms_file.empty()) {
+        std::ofstream os(histograms_file);
+        os << "{\n";
+        size_t i = 0;
+        for (auto const& [name, histograms] : g_latency_histograms) {
+            os << fmt::format("\"{}\": {}{}", name, histograms.to_json(), ++i < g_latency_histograms.size() ? ",\n" : "");
+        }
+        os << "}\n";
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+/**
+ * @file PerfGate.cpp
+ * @brief Performance regression gate: compares this build against a committed baseline
+ *
+ *     cs350-perf-gate --record=perf_baseline.json            Measures and writes a baseline
+ *     cs350-perf-gate --compare=perf_baseline.json           Exits with 1 when a metric regressed
+ *         [--tolerance=0.01] [--timed_tolerance=0.10] [--confidence=0.95] [--repetitions=7] [--report=gate.json] [--any_host]
+ *     Both accept [--host_key=ci-runner-x64] (replaces MachineBuildId) and --record accepts [--counted_only]
+ *
+ * Build time, rays/s, nodes/ray and triangles/ray are measured for every mesh and tree configuration.
+ * Timed metrics are only compared against baselines recorded on the same kind of host (CPU model and build, see
+ * MachineBuildId, or the same --host_key), unless --any_host is given; counted metrics are always compared.
+ * make perf-gate runs two comparisons. Counted metrics are compared with the committed benchmark/perf_baseline.json
+ * (recorded --counted_only, timings of another machine mean nothing). Timed ones are compared with the base revision
+ * (PERF-BASE-REF), recorded on the same machine in the same run, both under --host_key=perf-gate.
+ */
+#include "CS350Loader.hpp"
+#include "KdTree.hpp"
+#include "PerfGate.hpp"
+#include "SceneLoader.hpp"
+#include "Utils.hpp"
+
+#include <fmt/format.h>
+#include <cmath>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    char const* const cMeshes[] = { "avocado", "suzanne", "bunny", "bunny-dense" };
+    size_t const      cRayCount = 1 << 12;
+    unsigned const    cRaySeed  = 0x350;
+
+    // Unlimited depth, the default coarse leaves and fine ones: different trees, so both leaf and traversal costs are gated
+    struct GateConfig {
+        float cost_intersection;
+        int   min_triangles;
+    };
+    GateConfig const cConfigs[] = { { 80.0f, 50 }, { 10.0f, 4 } };
+
+    bool ReadFlag(std::string const& arg, char const* name, std::string& value) {
+        std::string prefix = fmt::format("--{}=", name);
+        if (arg.rfind(prefix, 0) != 0) {
+            return false;
+        }
+        value = arg.substr(prefix.size());
+        return true;
+    }
+
+    vec3 RandomUnitVector(std::mt19937& rng) {
+        std::normal_distribution<float> normal;
+        vec3                            v(normal(rng), normal(rng), normal(rng));
+        float                           length = glm::length(v);
+        return length > 0.0f ? v / length : vec3(0, 1, 0);
+    }
+
+    /**
+     * Outside the mesh towards its inner region, same rays for every build
+     */
+    std::vector<CS350::Ray> RandomRays(std::vector<CS350::Triangle> const& triangles) {
+        vec3 bv_min(std::numeric_limits<float>::max());
+        vec3 bv_max(-std::numeric_limits<float>::max());
+        for (auto const& tri : triangles) {
+            for (int v = 0; v < 3; ++v) {
+                bv_min = glm::min(bv_min, tri[v]);
+                bv_max = glm::max(bv_max, tri[v]);
+            }
+        }
+        vec3  center = (bv_min + bv_max) * 0.5f;
+        float radius = glm::length(bv_max - bv_min) * 0.5f;
+
+        std::mt19937                          rng(cRaySeed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<CS350::Ray>               rays;
+        for (size_t i = 0; i < cRayCount; ++i) {
+            vec3 origin = center + RandomUnitVector(rng) * radius * (1.0f + 2.0f * unit(rng));
+            vec3 target = center + RandomUnitVector(rng) * radius * 0.5f * unit(rng);
+            rays.emplace_back(origin, target - origin);
+        }
+        return rays;
+    }
+}
+
+int main(int argc, char** argv) {
+    try {
+        std::string            record_file;
+        std::string            compare_file;
+        std::string            report_file;
+        unsigned               repetitions  = 7;
+        std::string            host_key;
+        bool                   any_host     = false;
+        bool                   counted_only = false;
+        CS350::PerfGateOptions options;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            std::string value;
+            if (ReadFlag(arg, "record", value)) {
+                record_file = value;
+            } else if (ReadFlag(arg, "compare", value)) {
+                compare_file = value;
+            } else if (ReadFlag(arg, "report", value)) {
+                report_file = value;
+            } else if (ReadFlag(arg, "tolerance", value)) {
+                options.tolerance = std::stod(value);
+            } else if (ReadFlag(arg, "timed_tolerance", value)) {
+                options.timed_tolerance = std::stod(value);
+            } else if (ReadFlag(arg, "confidence", value)) {
+                options.confidence = std::stod(value);
+            } else if (ReadFlag(arg, "repetitions", value)) {
+                repetitions = unsigned(std::stoul(value));
+            } else if (ReadFlag(arg, "host_key", value)) {
+                host_key = value;
+            } else if (arg == "--any_host") {
+                any_host = true;
+            } else if (arg == "--counted_only") {
+                counted_only = true;
+            } else {
+                std::cerr << "Unknown argument " << arg << "\n";
+                return 1;
+            }
+        }
+        if (record_file.empty() == compare_file.empty()) {
+            std::cerr << "Usage: " << argv[0] << " --record=<baseline.json> | --compare=<baseline.json>"
+                      << " [--tolerance=F] [--timed_tolerance=F] [--confidence=F] [--repetitions=N] [--report=gate.json] [--any_host]"
+                      << " [--host_key=K] [--counted_only]\n";
+            return 1;
+        }
+        // Read first, a bad path fails before minutes of measurements. Output paths are relative to where we were started
+        CS350::PerfBaseline baseline;
+        if (!compare_file.empty()) {
+            baseline = CS350::LoadPerfBaseline(compare_file);
+        }
+        record_file = record_file.empty() ? record_file : std::filesystem::absolute(record_file).string();
+        report_file = report_file.empty() ? report_file : std::filesystem::absolute(report_file).string();
+
+        CS350::ChangeWorkdir();
+        std::vector<std::vector<CS350::Triangle>> meshes;
+        meshes.reserve(std::size(cMeshes));
+        std::vector<CS350::PerfWorkload> workloads;
+        for (auto const* mesh : cMeshes) {
+            meshes.push_back(CS350::TrianglesFromPrimitive(CS350::LoadCS350Binary(fmt::format("./assets/cs350/{}.cs350_binary", mesh))));
+            auto rays = RandomRays(meshes.back());
+            for (auto const& config : cConfigs) {
+                CS350::PerfWorkload workload;
+                workload.name                     = fmt::format("{}/cost_intersection:{}/min_triangles:{}", mesh, config.cost_intersection, config.min_triangles);
+                workload.triangles                = &meshes.back();
+                workload.config.cost_intersection = config.cost_intersection;
+                workload.config.min_triangles     = config.min_triangles;
+                workload.config.max_depth         = 0;
+                workload.rays                     = rays;
+                workloads.push_back(std::move(workload));
+            }
+        }
+        auto current = CS350::MeasurePerf(workloads, repetitions);
+        if (!host_key.empty()) {
+            current.host = host_key;
+        }
+
+        if (!record_file.empty()) {
+            if (counted_only) {
+                for (auto it = current.metrics.begin(); it != current.metrics.end();) {
+                    it = it->second.timed ? current.metrics.erase(it) : std::next(it);
+                }
+            }
+            CS350::SavePerfBaseline(record_file, current);
+            std::cout << fmt::format("{} metrics written to {}\n", current.metrics.size(), record_file);
+            return 0;
+        }
+
+        options.compare_timed = any_host || baseline.host == current.host;
+        if (!options.compare_timed) {
+            std::cout << fmt::format("Baseline host \"{}\" is not this host \"{}\", timed metrics are skipped\n", baseline.host, current.host);
+        }
+        auto report = CS350::ComparePerf(baseline, current, options);
+        std::cout << report.to_text();
+        if (!report_file.empty()) {
+            std::ofstream(report_file) << report.to_json();
+        }
+        return report.passed ? 0 : 1;
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+}
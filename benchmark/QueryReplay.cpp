@@ -0,0 +1,92 @@
+/**
+ * @file QueryReplay.cpp
+ * @brief Replays a recorded query log against a mesh, with any tree configuration
+ *
+ *     cs350-replay <mesh.cs350_binary> <log.cs350_queries> [--max_depth=N] [--min_triangles=N]
+ *                  [--cost_traversal=F] [--cost_intersection=F] [--repetitions=N] [--json=report.json]
+ *
+ * Logs are written by CS350::QueryRecorder.
+ */
+#include "CS350Loader.hpp"
+#include "KdTree.hpp"
+#include "QueryLog.hpp"
+#include "SceneLoader.hpp"
+
+#include <fmt/format.h>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace {
+    bool ReadFlag(std::string const& arg, char const* name, std::string& value) {
+        std::string prefix = fmt::format("--{}=", name);
+        if (arg.rfind(prefix, 0) != 0) {
+            return false;
+        }
+        value = arg.substr(prefix.size());
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <mesh.cs350_binary> <log.cs350_queries> [--max_depth=N] [--min_triangles=N]"
+                  << " [--cost_traversal=F] [--cost_intersection=F] [--repetitions=N] [--json=report.json]\n";
+        return 1;
+    }
+    try {
+        CS350::KdTree::Config config;
+        config.max_depth = 0;
+
+        unsigned    repetitions = 1;
+        std::string json_file;
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            std::string value;
+            if (ReadFlag(arg, "max_depth", value)) {
+                config.max_depth = std::stoi(value);
+            } else if (ReadFlag(arg, "min_triangles", value)) {
+                config.min_triangles = std::stoi(value);
+            } else if (ReadFlag(arg, "cost_traversal", value)) {
+                config.cost_traversal = std::stof(value);
+            } else if (ReadFlag(arg, "cost_intersection", value)) {
+                config.cost_intersection = std::stof(value);
+            } else if (ReadFlag(arg, "repetitions", value)) {
+                repetitions = unsigned(std::stoul(value));
+            } else if (ReadFlag(arg, "json", value)) {
+                json_file = value;
+            } else {
+                std::cerr << "Unknown argument " << arg << "\n";
+                return 1;
+            }
+        }
+
+        auto triangles   = CS350::TrianglesFromPrimitive(CS350::LoadCS350Binary(argv[1]));
+        auto log         = CS350::LoadQueryLogView(argv[2]);
+        auto build_start = std::chrono::steady_clock::now();
+        CS350::KdTree kdtree;
+        kdtree.build(triangles, config);
+        double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+
+        auto report = CS350::ReplayQueries(kdtree, triangles, log.records, repetitions);
+        std::cout << fmt::format("{} triangles, {} nodes, built in {:.1f}ms\n", triangles.size(), kdtree.nodes().size(), build_ms);
+        std::cout << fmt::format("{} queries, {} hits, {:.0f} queries/s\n", report.queries, report.hits, report.queries_per_second);
+        std::cout << fmt::format("closest: {} records, {} hits; occlusion (answered as closest hit): {} records, {} hits\n",
+                                 report.closest_queries, report.closest_hits, report.occlusion_queries, report.occlusion_hits);
+        if (report.ranged_queries != 0) {
+            std::cout << fmt::format("{} records with t_min > 0 are timed but not counted in the hits (no range limited traversal)\n", report.ranged_queries);
+        }
+        std::cout << fmt::format("latency p50 {:.0f}ns, p90 {:.0f}ns, p99 {:.0f}ns, p99.9 {:.0f}ns, max {:.0f}ns\n",
+                                 report.p50_ns, report.p90_ns, report.p99_ns, report.p999_ns, report.max_ns);
+        if (!json_file.empty()) {
+            std::ofstream(json_file) << report.to_json();
+        }
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
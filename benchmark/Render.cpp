@@ -0,0 +1,133 @@
+/**
+ * @file Render.cpp
+ * @brief Renders a mesh headlessly to a PNG: shaded, or as a traversal cost heatmap
+ *
+ *     cs350-render <mesh.cs350_binary> <out.png> [--mode=shaded|nodes|triangles] [--width=N] [--height=N]
+ *                  [--max_depth=N] [--min_triangles=N] [--cost_traversal=F] [--cost_intersection=F]
+ *                  [--ao=N] [--no_shadows] [--heatmap_max=N] [--threads=N] [--eye=x,y,z] [--target=x,y,z] [--fov=deg]
+ *
+ * The camera frames the mesh bounds unless --eye/--target are given. Render with a fixed --heatmap_max
+ * to compare the heatmaps of two configurations.
+ */
+#include "CS350Loader.hpp"
+#include "KdTree.hpp"
+#include "RayCaster.hpp"
+#include "SceneLoader.hpp"
+#include "ThreadPool.hpp"
+
+#include <fmt/format.h>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace {
+    bool ReadFlag(std::string const& arg, char const* name, std::string& value) {
+        std::string prefix = fmt::format("--{}=", name);
+        if (arg.rfind(prefix, 0) != 0) {
+            return false;
+        }
+        value = arg.substr(prefix.size());
+        return true;
+    }
+
+    vec3 ParseVec3(std::string const& value) {
+        vec3 result(0.0f);
+        if (std::sscanf(value.c_str(), "%f,%f,%f", &result.x, &result.y, &result.z) != 3) {
+            throw std::runtime_error("Expected x,y,z: " + value);
+        }
+        return result;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <mesh.cs350_binary> <out.png> [--mode=shaded|nodes|triangles] [--width=N] [--height=N]"
+                  << " [--max_depth=N] [--min_triangles=N] [--cost_traversal=F] [--cost_intersection=F] [--ao=N] [--no_shadows]"
+                  << " [--heatmap_max=N] [--threads=N] [--eye=x,y,z] [--target=x,y,z] [--fov=deg]\n";
+        return 1;
+    }
+    try {
+        CS350::KdTree::Config config;
+        config.max_depth = 0;
+        CS350::RenderSettings settings;
+        unsigned              threads = std::max(1u, std::thread::hardware_concurrency());
+        std::unique_ptr<vec3> eye;
+        std::unique_ptr<vec3> target;
+        float                 fov = 45.0f;
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            std::string value;
+            if (ReadFlag(arg, "mode", value)) {
+                settings.mode = CS350::ParseRenderMode(value);
+            } else if (ReadFlag(arg, "width", value)) {
+                settings.width = unsigned(std::stoul(value));
+            } else if (ReadFlag(arg, "height", value)) {
+                settings.height = unsigned(std::stoul(value));
+            } else if (ReadFlag(arg, "max_depth", value)) {
+                config.max_depth = std::stoi(value);
+            } else if (ReadFlag(arg, "min_triangles", value)) {
+                config.min_triangles = std::stoi(value);
+            } else if (ReadFlag(arg, "cost_traversal", value)) {
+                config.cost_traversal = std::stof(value);
+            } else if (ReadFlag(arg, "cost_intersection", value)) {
+                config.cost_intersection = std::stof(value);
+            } else if (ReadFlag(arg, "ao", value)) {
+                settings.ao_samples = unsigned(std::stoul(value));
+            } else if (arg == "--no_shadows") {
+                settings.shadows = false;
+            } else if (ReadFlag(arg, "heatmap_max", value)) {
+                settings.heatmap_max = unsigned(std::stoul(value));
+            } else if (ReadFlag(arg, "threads", value)) {
+                threads = std::max(1u, unsigned(std::stoul(value)));
+            } else if (ReadFlag(arg, "eye", value)) {
+                eye = std::make_unique<vec3>(ParseVec3(value));
+            } else if (ReadFlag(arg, "target", value)) {
+                target = std::make_unique<vec3>(ParseVec3(value));
+            } else if (ReadFlag(arg, "fov", value)) {
+                fov = std::stof(value);
+            } else {
+                std::cerr << "Unknown argument " << arg << "\n";
+                return 1;
+            }
+        }
+
+        auto          triangles   = CS350::TrianglesFromPrimitive(CS350::LoadCS350Binary(argv[1]));
+        auto          build_start = std::chrono::steady_clock::now();
+        CS350::KdTree kdtree;
+        kdtree.build(triangles, config);
+        double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+
+        auto const& bounds = kdtree.aabbs()[0];
+        vec3        center = (bounds.min + bounds.max) * 0.5f;
+        float       radius = glm::length(bounds.max - bounds.min) * 0.5f;
+        CS350::Camera camera;
+        camera.SetProjection(fov, ivec2(int(settings.width), int(settings.height)), radius * 0.01f, radius * 10.0f);
+        camera.SetPosition(eye ? *eye : center + vec3(0.0f, 0.3f, 1.0f) * radius * 2.5f);
+        camera.SetTarget(target ? *target : center);
+
+        // The calling thread renders too
+        std::unique_ptr<CS350::ThreadPool> pool;
+        if (threads > 1) {
+            pool          = std::make_unique<CS350::ThreadPool>(threads - 1);
+            settings.pool = pool.get();
+        }
+        auto result = CS350::RenderKdTree(camera, kdtree, triangles, settings);
+        CS350::SavePng(argv[2], result.image);
+
+        std::cout << fmt::format("{} triangles, {} nodes, built in {:.1f}ms\n", triangles.size(), kdtree.nodes().size(), build_ms);
+        std::cout << fmt::format("{}x{} {} in {:.1f}ms on {} threads, {:.2f} MRays/s\n", settings.width, settings.height, CS350::RenderModeName(settings.mode),
+                                 result.stats.elapsed_ms, result.stats.threads, result.stats.mrays_per_second);
+        if (settings.mode != CS350::RenderMode::Shaded) {
+            std::cout << fmt::format("{} per primary ray: mean {:.2f}, max {} (scale max {})\n", CS350::RenderModeName(settings.mode), result.stats.heatmap_mean,
+                                     result.stats.heatmap_max, settings.heatmap_max != 0 ? settings.heatmap_max : result.stats.heatmap_max);
+        }
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+#!/bin/sh
+# Checks that Instrumentation::None costs nothing: the None queries of src/KdTree.cpp must compile to the same code
+# as the query path with the instrumentation hooks removed by the preprocessor (CS350_INSTRUMENTATION_HOOKS=0).
+#
+#     benchmark/check_instrumentation.sh [compiler flags, e.g. -I<glm and fmt include folders>]
+#
+# GCC or Clang ($CXX, c++ by default), -O2 unless the flags say otherwise. Prints the compared functions,
+# exits with 1 and shows the difference when the code differs.
+set -eu
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+cxx=${CXX:-c++}
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# GCC would otherwise merge the identical Counters and Trace instantiations of the hookless build into the None ones
+flags="-std=c++17 -O2 -S -fno-asynchronous-unwind-tables"
+if ! "$cxx" --version | grep -qi clang; then
+    flags="$flags -fno-ipa-icf"
+fi
+
+for hooks in 1 0; do
+    # shellcheck disable=SC2086
+    "$cxx" $flags -I"$root/src" "$@" -DCS350_INSTRUMENTATION_HOOKS=$hooks "$root/src/KdTree.cpp" -o "$tmp/hooks$hooks.s"
+
+    # Bodies of the None instantiations (mangled as "...InstrumentationE0E..."), local labels renumbered per function.
+    # Lines are prefixed by their function and sorted by it, the compiler may emit the functions in another order
+    awk '
+        /^[^.\t ][^ ]*:$/ {
+            name = substr($0, 1, length($0) - 1)
+            keep = index(name, "InstrumentationE0E") > 0
+            if (keep) { print name "|"; delete labels; count = 0 }
+            next
+        }
+        /^\t\.size\t/ { keep = 0; next }
+        keep && !/^\t\.(p2align|align|type|globl|weak|section|text|loc|file)/ {
+            line = $0
+            out  = ""
+            while (match(line, /\.L[A-Za-z_]*[0-9]+/)) {
+                label = substr(line, RSTART, RLENGTH)
+                if (!(label in labels)) { labels[label] = ".L" count++ }
+                out  = out substr(line, 1, RSTART - 1) labels[label]
+                line = substr(line, RSTART + RLENGTH)
+            }
+            print name "|" out line
+        }
+    ' "$tmp/hooks$hooks.s" | sort -s -t '|' -k1,1 > "$tmp/none$hooks.txt"
+done
+
+functions=$(grep -c '|$' "$tmp/none1.txt" || true)
+if [ "$functions" -eq 0 ]; then
+    echo "No Instrumentation::None function found in the generated code" >&2
+    exit 1
+fi
+grep '|$' "$tmp/none1.txt" | sed -e 's/^/    /' -e 's/|$//'
+if diff -u "$tmp/none0.txt" "$tmp/none1.txt"; then
+    echo "$functions None functions, same code as without the instrumentation hooks"
+else
+    echo "Instrumentation::None differs from the query path without hooks (- without, + with)" >&2
+    exit 1
+fi
@@ -4,10 +4,10 @@
 #include "Shapes.hpp"
 #include "ImGui.hpp"
 #include "Stats.hpp"
+#include "VertexWelding.hpp"
 
 #include <filesystem>
 #include <fmt/format.h>
-#include <functional>
 #include <glm/common.hpp>
 #include <imgui.h>
 #include <memory>
@@ -28,36 +28,14 @@ namespace { // Asset related
         }
         return all_triangles;
     }
-
-    std::vector<CS350::Triangle> IndicesToTriangle(std::vector<CS350::Triangle> const& all_triangles, std ::vector<size_t> const& indices) {
-        std::vector<CS350::Triangle> result;
-        result.reserve(indices.size());
-        for (auto idx : indices) {
-            result.push_back(all_triangles.at(idx));
-        }
-        return result;
-    }
-
-    std::shared_ptr<CS350::Primitive> PrimitiveFromTriangles(std::vector<CS350::Triangle> const& triangles) {
-        std::vector<vec3> positions;
-        positions.reserve(triangles.size() * 3);
-        for (auto const& t : triangles) {
-            positions.push_back(t[0]);
-            positions.push_back(t[1]);
-            positions.push_back(t[2]);
-        }
-        return std::make_shared<CS350::Primitive>(CS350::Primitive(positions));
-    }
 }
 
 namespace CS350 {
 
     DemoScene::DemoScene() {
-        auto data            = CS350::LoadCS350Binary(cAssetPath);
-        mTriangles           = ToTriangles(data);
-        mPrimitive           = PrimitiveFromTriangles(mTriangles);
+        mPrimitive           = std::make_shared<CS350::Primitive>();
         mKdTreeCfg.max_depth = 50; // By default, no depth limit
-        build_kdtree();
+        load_mesh(CS350::LoadCS350Binary(cAssetPath));
     }
 
     DemoScene::~DemoScene() {
@@ -94,87 +72,87 @@ namespace CS350 {
         mDebug.ActivateShader();
 
         { // Big shape
-            mDebug.DrawPrimitiveWireframeImmediate(mCamera.viewProj(), mat4(1), mPrimitive.get(), { 0.5f, 0.5f, 0.5f, 1.0f });
+            DrawNode(0, { 0.5f, 0.5f, 0.5f, 1.0f }, true); // The root covers every triangle
         }
 
         { // Render leaves
             if (mOptions.draw_all_leaves) {
-                for (size_t i = 0; i < mLeavesPrimitives.size(); ++i) {
-                    mDebug.DrawPrimitiveImmediate(mCamera.viewProj(), mat4(1), mLeavesPrimitives[i].get(), mLeavesColors[i]);
+                for (size_t i = 0; i < mLeaves.size(); ++i) {
+                    DrawNode(mLeaves[i], mLeavesColors[i]);
                 }
             }
         }
 
+        { // Every node box (instanced)
+            if (mOptions.draw_all_nodes) {
+                vec4 color(1, 1, 1, 0.15f);
+                mDebug.SetBlend(DebugBlend::Alpha);
+                mDebug.DrawAabbs(mKdTree.aabbs(), { &color, 1 }, true);
+            }
+        }
+
         // Selectede node debug
         if (!mCurrentNodePath.empty()) {
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-            glDepthMask(GL_FALSE);
-            glEnable(GL_DEPTH_TEST);
-            glDisable(GL_CULL_FACE);
             auto        n_index = mCurrentNodePath.back();
             auto const& node    = mKdTree.nodes().at(n_index);
             auto const& aabb    = mKdTree.aabbs().at(n_index);
-            mDebug.DrawAabbWireframeImmediate(mCamera.viewProj(), aabb, { 1, 1, 1, 0.5f }); // Box
+            mDebug.SetBlend(DebugBlend::Alpha);
+            mDebug.DrawAabbWireframe(aabb, { 1, 1, 1, 0.5f }); // Box
 
             // Splitting plane
             if (node.is_internal()) {
-                vec3 splitPlanePosition         = aabb.GetCenter();
+                vec3 splitPlanePosition         = aabb.center();
                 splitPlanePosition[node.axis()] = node.split();
                 vec3 normal                     = {};
                 normal[node.axis()]             = 1;
-                mDebug.DrawPlaneImmediate(mCamera.viewProj(), splitPlanePosition, normal, (aabb.max[node.axis()] - aabb.min[node.axis()]) * 1.1f, { 0.5, 0.5, 0.9, 0.75f });
+                mDebug.DrawPlane(splitPlanePosition, normal, (aabb.max[node.axis()] - aabb.min[node.axis()]) * 1.1f, { 0.5, 0.5, 0.9, 0.75f });
             }
         }
 
-        // Rays
+        // Rays (batched, submitted by Render below)
         if (mOptions.traversal_test) {
             { // Traversed debug
                 // Draw traversed nodes
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-                glDepthMask(GL_FALSE);
-                glEnable(GL_DEPTH_TEST);
-
                 if (mOptions.traversal_inspected >= int(mKdTreeStats.traversed_nodes.size()) || mOptions.show_all_traversed_nodes) {
-                    for (size_t i = 0; i < mKdTreeStats.traversed_nodes.size(); ++i) {
-                        auto const& aabb  = mKdTree.aabbs().at(mKdTreeStats.traversed_nodes.at(i));
-                        vec4        color = glm::mix(vec4(1, 0, 0, 0.1f), vec4(0.2, 0.6, 1, 0.05), 1.0f - float(i) / float(mKdTreeStats.traversed_nodes.size()));
-                        mDebug.DrawAabbImmediate(mCamera.viewProj(), aabb, color);
+                    std::vector<vec4> colors(mKdTreeStats.traversed_nodes.size());
+                    for (size_t i = 0; i < colors.size(); ++i) {
+                        colors[i] = glm::mix(vec4(1, 0, 0, 0.1f), vec4(0.2, 0.6, 1, 0.05), 1.0f - float(i) / float(colors.size()));
                     }
+                    mDebug.SetBlend(DebugBlend::Additive);
+                    mDebug.DrawAabbs(mKdTree.aabbs(), mKdTreeStats.traversed_nodes, colors); // Instanced, a single draw call
                 } else {
                     auto        node_idx = mKdTreeStats.traversed_nodes.at(size_t(mOptions.traversal_inspected));
                     auto const& aabb     = mKdTree.aabbs().at(node_idx);
                     float       t        = 1.0f - float(mOptions.traversal_inspected) / float(mKdTreeStats.traversed_nodes.size());
                     vec4        color    = glm::mix(vec4(1, 0, 0, 0.85), vec4(0.2, 0.6, 1, 0.85), t);
-                    glEnable(GL_BLEND);
-                    mDebug.DrawAabbImmediate(mCamera.viewProj(), aabb, color); // Draw the box
-                    glDisable(GL_BLEND);
-                    mDebug.DrawAabbWireframeImmediate(mCamera.viewProj(), aabb, { 1, 1, 1, 1 }); // Draw box outline
+                    mDebug.SetBlend(DebugBlend::Additive);
+                    mDebug.DrawAabb(aabb, color); // Draw the box
+                    mDebug.SetBlend(DebugBlend::Opaque);
+                    mDebug.DrawAabbWireframe(aabb, { 1, 1, 1, 1 }); // Draw box outline
                     glDisable(GL_CULL_FACE);
-                    mDebug.DrawPrimitiveImmediate(mCamera.viewProj(), mat4(1), mNodesPrimitives[node_idx].get(), { 0.940, 0.583, 0.0470, 1.0f }); // Draw all triangles
+                    DrawNode(node_idx, { 0.940, 0.583, 0.0470, 1.0f }); // Draw all triangles
                 }
 
-                glDisable(GL_BLEND);
                 // Draw tested triangles
+                mDebug.SetBlend(DebugBlend::Opaque);
                 for (size_t i = 0; i < mKdTreeStats.tested_triangles.size(); ++i) {
                     auto const& triangle = mTriangles.at(mKdTreeStats.tested_triangles.at(i));
-                    mDebug.DrawTriangleImmediate(mCamera.viewProj(), triangle[0], triangle[1], triangle[2], vec4(0.0174, 0.870, 0.344, 1));
+                    mDebug.DrawTriangle(triangle[0], triangle[1], triangle[2], vec4(0.0174, 0.870, 0.344, 1));
                 }
             }
 
             { // RAY
-                mDebug.DrawSphereImmediate(mCamera.viewProj(), mCamera.position(), mRayStart, 0.1f, { 1, 0, 0, 1 });
-                mDebug.DrawSphereImmediate(mCamera.viewProj(), mCamera.position(), mRayEnd, 0.1f, { 0, 0, 0, 1 });
-                mDebug.DrawSegmentImmediate(mCamera.viewProj(), mRayStart, mRayEnd, { 0.2, 0.2, 0.2, 1 });
+                mDebug.DrawSphere(mCamera.position(), mRayStart, 0.1f, { 1, 0, 0, 1 });
+                mDebug.DrawSphere(mCamera.position(), mRayEnd, 0.1f, { 0, 0, 0, 1 });
+                mDebug.DrawSegment(mRayStart, mRayEnd, { 0.2, 0.2, 0.2, 1 });
 
                 if (mIntersection) {
                     auto pt = mRayStart + (mRayEnd - mRayStart) * mIntersection.t;
 
                     auto const& tri = mTriangles.at(mIntersection.triangle_index);
-                    mDebug.DrawSphereImmediate(mCamera.viewProj(), mCamera.position(), pt, 0.5f, { 1, 0, 1, 1 });
-                    mDebug.DrawSegmentImmediate(mCamera.viewProj(), mRayStart, pt, { 1, 0, 0, 1 });
-                    mDebug.DrawTriangleImmediate(mCamera.viewProj(), tri[0], tri[1], tri[2], { 1, 1, 1, 1 });
+                    mDebug.DrawSphere(mCamera.position(), pt, 0.5f, { 1, 0, 1, 1 });
+                    mDebug.DrawSegment(mRayStart, pt, { 1, 0, 0, 1 });
+                    mDebug.DrawTriangle(tri[0], tri[1], tri[2], { 1, 1, 1, 1 });
                 }
             }
         }
@@ -194,10 +172,7 @@ namespace CS350 {
                         }
                         if (it.path().extension().string().find("binary") != std::string::npos) {
                             if (ImGui::Selectable(it.path().string().c_str())) {
-                                auto data  = CS350::LoadCS350Binary(it.path().string());
-                                mTriangles = ToTriangles(data);
-                                mPrimitive = PrimitiveFromTriangles(mTriangles);
-                                build_kdtree();
+                                load_mesh(CS350::LoadCS350Binary(it.path().string()));
                             }
                         }
                     }
@@ -207,6 +182,7 @@ namespace CS350 {
 
             // Options
             ImGui::Checkbox("Draw all leaves", &mOptions.draw_all_leaves);
+            ImGui::Checkbox("Draw all nodes", &mOptions.draw_all_nodes);
             ImGui::DragFloat("cost_intersection", &mKdTreeCfg.cost_intersection, 0.01f, 0.0f, FLT_MAX);
             ImGui::DragFloat("cost_traversal", &mKdTreeCfg.cost_traversal, 0.01f, 0.0f, FLT_MAX);
             ImGui::DragInt("max_depth", &mKdTreeCfg.max_depth, 0.2f, 0, 9999);
@@ -338,41 +314,54 @@ namespace CS350 {
 
     void DemoScene::debug_draw_tris(int n_index) {
         mDebug.DrawAabbWireframe(mKdTree.aabbs().at(size_t(n_index)), { 1, 1, 1, 1 });
-        mDebug.DrawPrimitive(mat4(1), mNodesPrimitives.at(size_t(n_index)).get(), { 1, 1, 1, 1 });
+        DrawNode(size_t(n_index), { 1, 1, 1, 1 });
+    }
+
+    void DemoScene::DrawNode(size_t node_index, vec4 const& color, bool wireframe) {
+        if (mNodesRanges.empty()) {
+            return; // Empty mesh, not even a root
+        }
+        auto const& range = mNodesRanges.at(node_index);
+        mDebug.DrawPrimitivePartImmediate(mCamera.viewProj(), mPrimitive.get(), GLint(range.first * 3), GLsizei(range.count * 3), color, wireframe);
+    }
+
+    void DemoScene::load_mesh(CS350::CS350PrimitiveData const& data) {
+        mTriangles = ToTriangles(data);
+        mMesh      = CS350::WeldVertices(data);
+        build_kdtree();
     }
 
     void DemoScene::build_kdtree() {
         mKdTree.build(mTriangles, mKdTreeCfg);
         mCurrentNodePath = {};
 
-        // Clear nodes
-        mLeavesPrimitives.clear();
+        // Leaves are stored depth first: the triangles of any subtree are a contiguous run of the indices,
+        // so a single buffer in that order serves every node (no per node copies)
+        mNodesRanges = mKdTree.index_ranges();
+        std::vector<GLuint> indices;
+        indices.reserve(mKdTree.indices().size() * 3);
+        for (size_t triangle : mKdTree.indices()) {
+            for (int corner : mMesh.polygons.at(triangle)) {
+                indices.push_back(GLuint(corner));
+            }
+        }
+        mPrimitive->SetupIndexedBuffer(mMesh.positions, indices);
+
+        // Leaves
+        mLeaves.clear();
         mLeavesColors.clear();
-        mNodesPrimitives.clear();
-        mNodesPrimitives.resize(mKdTree.nodes().size());
-
-        // Create leaves
-        std::function<void(int node_index)> generate_leaves;
-        generate_leaves = [&](int node_index) {
-            auto const& n                           = mKdTree.nodes().at(size_t(node_index));                              // Current node
-            auto        tris_indices                = mKdTree.get_triangles(size_t(node_index));                           // Triangles of the current node
-            auto        pri                         = PrimitiveFromTriangles(IndicesToTriangle(mTriangles, tris_indices)); // Primitive of the current node
-            mNodesPrimitives.at(size_t(node_index)) = pri;                                                                 // Submit primitive
-
-            if (n.is_internal()) {
-                generate_leaves(node_index + 1);
-                generate_leaves(int(n.next_child()));
-            } else {
-                mLeavesPrimitives.push_back(pri);
-
-                // Random color
-                vec3 hsv = {};
-                hsv[0]   = glm::linearRand(0.0f, 360.0f);
-                hsv[1]   = glm::linearRand(0.75f, 1.0f);
-                hsv[2]   = glm::linearRand(0.75f, 1.0f);
-                mLeavesColors.push_back(vec4(glm::rgbColor(hsv), 1));
+        for (size_t node_index = 0; node_index < mKdTree.nodes().size(); ++node_index) {
+            if (mKdTree.nodes()[node_index].is_internal()) {
+                continue;
             }
-        };
-        generate_leaves(0);
+            mLeaves.push_back(node_index);
+
+            // Random color
+            vec3 hsv = {};
+            hsv[0]   = glm::linearRand(0.0f, 360.0f);
+            hsv[1]   = glm::linearRand(0.75f, 1.0f);
+            hsv[2]   = glm::linearRand(0.75f, 1.0f);
+            mLeavesColors.push_back(vec4(glm::rgbColor(hsv), 1));
+        }
     }
 }
@@ -6,6 +6,7 @@
 #include "Shapes.hpp"
 #include "KdTree.hpp"
 #include "DebugRenderer.hpp"
+#include "CS350Loader.hpp"
 #include <memory>
 
 // BVH usage
@@ -16,14 +17,15 @@ namespace CS350 {
         Camera                            mCamera;
         DebugRenderer                     mDebug;
         std::vector<CS350::Triangle>      mTriangles;   // All the triangles of the current mesh
-        std::shared_ptr<CS350::Primitive> mPrimitive;   // The actual mesh to draw (all triangles)
+        CS350::CS350PrimitiveData         mMesh;        // Welded mesh, face i is mTriangles[i]
+        std::shared_ptr<CS350::Primitive> mPrimitive;   // Welded vertices, indices in leaf order (3 per entry of mKdTree.indices())
         CS350::KdTree::Config             mKdTreeCfg;   // KdTree configuration
         CS350::KdTree                     mKdTree;      //
         CS350::KdTree::DebugStats         mKdTreeStats; //
 
-        std::vector<std::shared_ptr<CS350::Primitive>> mNodesPrimitives;  // Primitives representing the triangles of ALL CHILDREN RECURSIVELY
-        std::vector<std::shared_ptr<CS350::Primitive>> mLeavesPrimitives; // Colored triangles
-        std::vector<vec4>                              mLeavesColors;     // Colors of leaves
+        std::vector<CS350::KdTree::IndexRange> mNodesRanges;  // Triangles of ALL CHILDREN RECURSIVELY, a range of mPrimitive
+        std::vector<size_t>                    mLeaves;       // Node indices of the leaves
+        std::vector<vec4>                      mLeavesColors; // Colors of leaves
 
         std::vector<size_t> mCurrentNodePath; // Vector of node indices until currently inspected node
         std::string         mCurrentNodeInfo; // Information of selected node
@@ -39,6 +41,7 @@ namespace CS350 {
             bool traversal_test      = true;
             int  traversal_inspected = 0; // Currently inspected node, if ==max, disabled
             bool draw_all_leaves     = false;
+            bool draw_all_nodes      = false; // Wireframe box of every node
             bool show_all_traversed_nodes = true; // If true, no slider
         } mOptions;
 
@@ -61,7 +64,9 @@ namespace CS350 {
 
       private:
         void PassDebug();
+        void DrawNode(size_t node_index, vec4 const& color, bool wireframe = false);
         void debug_draw_tris(int n_index);
+        void load_mesh(CS350::CS350PrimitiveData const& data);
         void build_kdtree();
     };
 }
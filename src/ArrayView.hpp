@@ -0,0 +1,88 @@
+#ifndef ARRAY_VIEW_HPP
+#define ARRAY_VIEW_HPP
+
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace CS350 {
+    /**
+     * Non-owning, read-only view over a contiguous array.
+     * Used to expose data that may live either in a std::vector or in a memory mapped file.
+     */
+    template <typename T>
+    class ArrayView {
+      private:
+        T const* m_data = nullptr;
+        size_t   m_size = 0;
+
+      public:
+        ArrayView() = default;
+        ArrayView(T const* data, size_t size)
+        : m_data(data)
+        , m_size(size) {}
+        ArrayView(std::vector<T> const& v) // NOLINT(google-explicit-constructor)
+        : m_data(v.data())
+        , m_size(v.size()) {}
+
+        [[nodiscard]] T const* data() const noexcept { return m_data; }
+        [[nodiscard]] size_t   size() const noexcept { return m_size; }
+        [[nodiscard]] bool     empty() const noexcept { return m_size == 0; }
+        [[nodiscard]] T const* begin() const noexcept { return m_data; }
+        [[nodiscard]] T const* end() const noexcept { return m_data + m_size; }
+        [[nodiscard]] T const& front() const { return at(0); }
+        [[nodiscard]] T const& back() const { return at(m_size - 1); }
+
+        T const& operator[](size_t i) const noexcept { return m_data[i]; }
+        [[nodiscard]] T const& at(size_t i) const {
+            if (i >= m_size) {
+                throw std::out_of_range("ArrayView index out of range");
+            }
+            return m_data[i];
+        }
+    };
+
+    /**
+     * Non-owning, read-only view over elements placed every `stride` bytes (e.g. one attribute of interleaved vertices).
+     * Elements must be suitably aligned for T.
+     */
+    template <typename T>
+    class StridedView {
+      private:
+        char const* m_data   = nullptr;
+        size_t      m_size   = 0;
+        size_t      m_stride = sizeof(T);
+
+      public:
+        StridedView() = default;
+        StridedView(void const* data, size_t size, size_t stride)
+        : m_data(static_cast<char const*>(data))
+        , m_size(size)
+        , m_stride(stride) {}
+
+        [[nodiscard]] size_t size() const noexcept { return m_size; }
+        [[nodiscard]] bool   empty() const noexcept { return m_size == 0; }
+        [[nodiscard]] size_t stride() const noexcept { return m_stride; }
+        [[nodiscard]] bool   contiguous() const noexcept { return m_stride == sizeof(T); }
+
+        T const& operator[](size_t i) const noexcept { return *reinterpret_cast<T const*>(m_data + i * m_stride); } // NOLINT
+        [[nodiscard]] T const& at(size_t i) const {
+            if (i >= m_size) {
+                throw std::out_of_range("StridedView index out of range");
+            }
+            return (*this)[i];
+        }
+
+        /**
+         * Plain array view, only valid when contiguous()
+         */
+        [[nodiscard]] ArrayView<T> as_array() const {
+            if (!contiguous()) {
+                throw std::logic_error("StridedView is not contiguous");
+            }
+            return ArrayView<T>(reinterpret_cast<T const*>(m_data), m_size); // NOLINT
+        }
+    };
+}
+
+#endif // ARRAY_VIEW_HPP
@@ -1,6 +1,13 @@
 #include "CS350Loader.hpp"
+#include "ChromeTrace.hpp"
 #include "Utils.hpp"
 
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
 
 //std::istream& operator>>(std::istream& is, glm::mat4& matrix) {
 //    for (int i = 0; i < 4; ++i) {
@@ -15,167 +22,495 @@ namespace CS350
 {
    // using mat4 = glm::mat4;
 
-    bool ReadBoolean(std::ifstream& input) 
-    {
-        bool value = false;
-        input.read(reinterpret_cast<char*>(&value), sizeof(value));
-        return value;
-    }
+    namespace {
+        size_t const cHeaderSize = 16; // Signature (5), vertex count (4), index count (4), attribute flags (3)
 
-    uint32_t ReadUInt32(std::ifstream& input)
-    {
-        uint32_t value =0;
-        input.read(reinterpret_cast<char*>(&value), sizeof(value));
-        return value;
-    }
+        char const     cQuantizedSignature[8] = { 'C', 'S', '3', '5', '0', 'Q', 'N', 'T' };
+        uint32_t const cQuantizedVersion      = 1;
+        size_t const   cQuantizedHeaderSize   = 48; // Signature (8), version (4), counts (8), flags (3 + 1), bvMin/bvMax (24)
 
-    glm::vec3 ReadVec3(std::ifstream& input) 
-    {
-        glm::vec3 value(0.0f, 0.0f, 0.0f);
-        input.read(reinterpret_cast<char*>(&value), sizeof(value));
-        return value;
-    }
+        char const     cSceneSignature[8]  = { 'C', 'S', '3', '5', '0', 'S', 'C', 'N' };
+        uint32_t const cSceneVersion       = 1;
+        size_t const   cSceneHeaderSize    = 16; // Signature (8), version (4), object count (4)
 
-    glm::vec2 ReadVec2(std::ifstream& input) 
-    {
-        glm::vec2 value;
-        input.read(reinterpret_cast<char*>(&value), sizeof(value));
-        return value;
-    }
+        // Binary scene records are mapped as is
+        static_assert(sizeof(CS350SceneObject) == sizeof(int) + 16 * sizeof(float), "Scene objects must be packed");
+        static_assert(std::is_trivially_copyable_v<CS350SceneObject>, "Scene objects must be trivially copyable");
 
-    void VerifySignature(std::ifstream& input, const std::string& file) 
-    {
-        char signature[5];
-        input.read(signature, 5);
-        if (std::string(signature, 5) != "CS350") {
-            throw std::runtime_error("Invalid file signature in file: " + file);
+        bool IsSceneBinary(std::string const& file)
+        {
+            char signature[sizeof(cSceneSignature)] = {};
+            std::ifstream is(file, std::ios::binary);
+            is.read(signature, sizeof(signature));
+            return is && std::memcmp(signature, cSceneSignature, sizeof(signature)) == 0;
         }
-    }
-
-    void ReadAttributes(std::ifstream& input, bool& hasPositions, bool& hasNormals, bool& hasUVs) 
-    {
-        hasPositions = ReadBoolean(input);
-        hasNormals = ReadBoolean(input);
-        hasUVs = ReadBoolean(input);
-    }
 
-    void ReadVertices(std::ifstream& input, CS350PrimitiveData& data, uint32_t vertexCount, bool hasPositions, bool hasNormals, bool hasUVs) 
-    {
-        for (uint32_t i = 0; i < vertexCount; ++i)
+        /**
+         * Minimal text scanner over the whole scene file
+         */
+        class SceneTextParser
         {
-            if (hasPositions) 
+        public:
+            SceneTextParser(std::string const& file, char const* begin, char const* end)
+                : mFile(file), mCurrent(begin), mEnd(end) {}
+
+            bool AtEnd() const { return mCurrent == mEnd; }
+
+            // Skips blank lines, returns false at the end of the file
+            bool NextLine()
+            {
+                while (mCurrent != mEnd && std::isspace(static_cast<unsigned char>(*mCurrent))) {
+                    if (*mCurrent == '\n') {
+                        ++mLine;
+                    }
+                    ++mCurrent;
+                }
+                return mCurrent != mEnd;
+            }
+
+            void SkipLine()
             {
-                data.positions.push_back(ReadVec3(input));
+                while (mCurrent != mEnd && *mCurrent != '\n') {
+                    ++mCurrent;
+                }
             }
-            if (hasNormals) 
+
+            template <typename T>
+            T Read()
             {
-                data.normals.push_back(ReadVec3(input));
+                // Separators within a line: blanks and a comma
+                while (mCurrent != mEnd && (*mCurrent == ' ' || *mCurrent == '\t' || *mCurrent == ',' || *mCurrent == '\r')) {
+                    ++mCurrent;
+                }
+                if (mCurrent != mEnd && *mCurrent == '+') {
+                    ++mCurrent;
+                }
+                T value{};
+                auto [ptr, ec] = std::from_chars(mCurrent, mEnd, value);
+                if (ec != std::errc()) {
+                    throw std::runtime_error("Invalid number in file " + mFile + " at line " + std::to_string(mLine));
+                }
+                mCurrent = ptr;
+                return value;
             }
-            if (hasUVs) 
+
+        private:
+            std::string const& mFile;
+            char const* mCurrent;
+            char const* mEnd;
+            size_t mLine = 1;
+        };
+
+        /**
+         * De-interleaves one attribute into a preallocated array (single copy when not interleaved)
+         */
+        template <typename T>
+        void CopyAttribute(StridedView<T> const& view, std::vector<T>& out)
+        {
+            out.resize(view.size());
+            if (view.empty()) {
+                return;
+            }
+            if (view.contiguous()) {
+                std::memcpy(out.data(), &view[0], view.size() * sizeof(T));
+                return;
+            }
+            for (size_t i = 0; i < view.size(); ++i) {
+                out[i] = view[i];
+            }
+        }
+
+        template <typename T>
+        void CalculateBoundingVolume(T const& positions, vec3& bvMin, vec3& bvMax)
+        {
+            if (!positions.empty())
             {
-                data.uvs.push_back(ReadVec2(input));
+                bvMin = bvMax = positions[0];
+                for (size_t i = 0; i < positions.size(); ++i)
+                {
+                    bvMin = glm::min(bvMin, positions[i]);
+                    bvMax = glm::max(bvMax, positions[i]);
+                }
+            }
+        }
+
+        size_t AlignTo4(size_t offset) { return (offset + 3) & ~size_t(3); }
+
+        bool IsQuantized(std::byte const* data, size_t size)
+        {
+            return size >= sizeof(cQuantizedSignature) && std::memcmp(data, cQuantizedSignature, sizeof(cQuantizedSignature)) == 0;
+        }
+
+        /**
+         * Location of every array of a quantized file
+         */
+        struct QuantizedLayout
+        {
+            uint32_t vertexCount = 0;
+            size_t faceCount = 0;
+            vec3 bvMin{ 0.0f };
+            vec3 bvMax{ 0.0f };
+            std::byte const* positions = nullptr;
+            std::byte const* normals = nullptr;
+            std::byte const* uvs = nullptr;
+            std::byte const* faces = nullptr;
+        };
+
+        QuantizedLayout ParseQuantized(std::string const& file, std::byte const* data, size_t size)
+        {
+            if (size < cQuantizedHeaderSize) {
+                throw std::runtime_error("Unexpected end of file: " + file);
+            }
+            QuantizedLayout layout;
+            uint32_t version = 0;
+            uint32_t indexCount = 0;
+            std::memcpy(&version, data + 8, sizeof(version));
+            std::memcpy(&layout.vertexCount, data + 12, sizeof(layout.vertexCount));
+            std::memcpy(&indexCount, data + 16, sizeof(indexCount));
+            std::memcpy(&layout.bvMin, data + 24, sizeof(vec3));
+            std::memcpy(&layout.bvMax, data + 36, sizeof(vec3));
+            if (version != cQuantizedVersion) {
+                throw std::runtime_error("Unsupported quantized version " + std::to_string(version) + " in file: " + file);
+            }
+            layout.faceCount = indexCount / 3;
+
+            size_t offset = cQuantizedHeaderSize;
+            auto section = [&](bool present, size_t elementSize) -> std::byte const* {
+                if (!present) {
+                    return nullptr;
+                }
+                std::byte const* start = data + offset;
+                offset = AlignTo4(offset + size_t(layout.vertexCount) * elementSize);
+                return start;
+            };
+            layout.positions = section(data[20] != std::byte{ 0 }, sizeof(QuantizedPosition));
+            layout.normals = section(data[21] != std::byte{ 0 }, sizeof(OctahedralNormal));
+            layout.uvs = section(data[22] != std::byte{ 0 }, sizeof(HalfVec2));
+            if (offset + layout.faceCount * sizeof(CS350PrimitiveData::Face) > size) {
+                throw std::runtime_error("Unexpected end of file: " + file);
+            }
+            layout.faces = data + offset;
+            return layout;
+        }
+
+        /**
+         * Decoding loops, branch free over plain arrays so the compiler can vectorize them
+         */
+        void DecodePositions(std::byte const* src, PositionQuantizer const& quantizer, std::vector<vec3>& out)
+        {
+            std::vector<QuantizedPosition> codes(out.size());
+            std::memcpy(codes.data(), src, codes.size() * sizeof(QuantizedPosition));
+            for (size_t i = 0; i < out.size(); ++i) {
+                out[i] = quantizer.decode(codes[i]);
+            }
+        }
+
+        void DecodeNormals(std::byte const* src, std::vector<vec3>& out)
+        {
+            std::vector<OctahedralNormal> codes(out.size());
+            std::memcpy(codes.data(), src, codes.size() * sizeof(OctahedralNormal));
+            for (size_t i = 0; i < out.size(); ++i) {
+                out[i] = DecodeOctahedral(codes[i]);
+            }
+        }
+
+        void DecodeUvs(std::byte const* src, std::vector<vec2>& out)
+        {
+            std::vector<HalfVec2> codes(out.size());
+            std::memcpy(codes.data(), src, codes.size() * sizeof(HalfVec2));
+            for (size_t i = 0; i < out.size(); ++i) {
+                out[i] = vec2(HalfToFloat(codes[i][0]), HalfToFloat(codes[i][1]));
+            }
+        }
+
+        CS350PrimitiveData LoadQuantized(std::string const& file, MappedFile const& mapping)
+        {
+            QuantizedLayout layout = ParseQuantized(file, mapping.data(), mapping.size());
+
+            CS350_TRACE_SCOPE("loader", "decode", "vertices", layout.vertexCount);
+            CS350PrimitiveData data;
+            if (layout.positions != nullptr) {
+                data.positions.resize(layout.vertexCount);
+                DecodePositions(layout.positions, PositionQuantizer(layout.bvMin, layout.bvMax), data.positions);
+            }
+            if (layout.normals != nullptr) {
+                data.normals.resize(layout.vertexCount);
+                DecodeNormals(layout.normals, data.normals);
+            }
+            if (layout.uvs != nullptr) {
+                data.uvs.resize(layout.vertexCount);
+                DecodeUvs(layout.uvs, data.uvs);
             }
+            data.polygons.resize(layout.faceCount);
+            std::memcpy(data.polygons.data(), layout.faces, layout.faceCount * sizeof(CS350PrimitiveData::Face));
+            CalculateBoundingVolume(data.positions, data.bvMin, data.bvMax);
+            return data;
         }
     }
 
-    void ReadPolygons(std::ifstream& input, CS350PrimitiveData& data, uint32_t indexCount) 
+    CS350PrimitiveView LoadCS350BinaryView(std::string const& file)
     {
-        for (uint32_t i = 0; i < indexCount / 3; ++i) {
-            CS350PrimitiveData::Face face;
-            input.read(reinterpret_cast<char*>(&face), sizeof(face));
-            data.polygons.push_back(face);
-        }
+        return LoadCS350BinaryView(file, std::make_shared<MappedFile const>(file));
     }
 
-    void CalculateBoundingVolume(CS350PrimitiveData& data) 
+    CS350PrimitiveView LoadCS350BinaryView(std::string const& file, std::shared_ptr<MappedFile const> mapping)
     {
-        if (!data.positions.empty()) 
+        CS350PrimitiveView view;
+        view.mapping = std::move(mapping);
+        std::byte const* data = view.mapping->data();
+        size_t size = view.mapping->size();
+
+        if (IsQuantized(data, size)) {
+            throw std::runtime_error("Quantized files can not be viewed, use LoadCS350Binary: " + file);
+        }
+        if (size < cHeaderSize || std::string(reinterpret_cast<char const*>(data), 5) != "CS350") {
+            throw std::runtime_error("Invalid file signature in file: " + file);
+        }
+
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+        std::memcpy(&vertexCount, data + 5, sizeof(vertexCount));
+        std::memcpy(&indexCount, data + 9, sizeof(indexCount));
+        bool hasPositions = data[13] != std::byte{ 0 };
+        bool hasNormals = data[14] != std::byte{ 0 };
+        bool hasUVs = data[15] != std::byte{ 0 };
+
+        // Interleaved vertices: [POS][NORMAL][UV] per vertex, then faces
+        size_t stride = (hasPositions ? sizeof(vec3) : 0) + (hasNormals ? sizeof(vec3) : 0) + (hasUVs ? sizeof(vec2) : 0);
+        size_t facesOffset = cHeaderSize + size_t(vertexCount) * stride;
+        size_t faceCount = indexCount / 3;
+        if (facesOffset + faceCount * sizeof(CS350PrimitiveData::Face) > size) {
+            throw std::runtime_error("Unexpected end of file: " + file);
+        }
+
+        std::byte const* attribute = data + cHeaderSize;
+        if (hasPositions)
         {
-            data.bvMin = data.bvMax = data.positions[0];
-            for (const auto& pos : data.positions) 
-            {
-                data.bvMin = glm::min(data.bvMin, pos);
-                data.bvMax = glm::max(data.bvMax, pos);
-            }
+            view.positions = StridedView<vec3>(attribute, vertexCount, stride);
+            attribute += sizeof(vec3);
+        }
+        if (hasNormals)
+        {
+            view.normals = StridedView<vec3>(attribute, vertexCount, stride);
+            attribute += sizeof(vec3);
         }
+        if (hasUVs)
+        {
+            view.uvs = StridedView<vec2>(attribute, vertexCount, stride);
+        }
+        view.polygons = ArrayView<CS350PrimitiveData::Face>(reinterpret_cast<CS350PrimitiveData::Face const*>(data + facesOffset), faceCount);
+
+        // First pass over the mapping, page faults (the actual reads) land here
+        CS350_TRACE_SCOPE("loader", "bounds", "vertices", view.positions.size());
+        CalculateBoundingVolume(view.positions, view.bvMin, view.bvMax);
+        return view;
     }
 
     CS350PrimitiveData LoadCS350Binary(const std::string& file) 
     {
-        CS350PrimitiveData data;
-        std::ifstream input(file, std::ios::binary);
-        if (!input) 
+        CS350_TRACE_SCOPE("loader", "LoadCS350Binary");
+        std::shared_ptr<MappedFile const> mapping;
         {
-            throw std::runtime_error("Failed to open file");
+            CS350_TRACE_SCOPE("loader", "io");
+            mapping = std::make_shared<MappedFile const>(file);
         }
+        if (IsQuantized(mapping->data(), mapping->size())) {
+            return LoadQuantized(file, *mapping);
+        }
+        CS350PrimitiveView view = LoadCS350BinaryView(file, mapping);
 
-        VerifySignature(input, file);
-
-        uint32_t vertexCount = ReadUInt32(input);
-        uint32_t indexCount = ReadUInt32(input);
-
-        bool hasPositions = false;
-        bool hasNormals =false;
-        bool hasUVs = false;
-        ReadAttributes(input, hasPositions, hasNormals, hasUVs);
-
-        ReadVertices(input, data, vertexCount, hasPositions, hasNormals, hasUVs);
+        CS350_TRACE_SCOPE("loader", "decode", "vertices", view.positions.size());
+        CS350PrimitiveData data;
+        CopyAttribute(view.positions, data.positions);
+        CopyAttribute(view.normals, data.normals);
+        CopyAttribute(view.uvs, data.uvs);
+        data.polygons.assign(view.polygons.begin(), view.polygons.end());
+        data.bvMin = view.bvMin;
+        data.bvMax = view.bvMax;
+        return data;
+    }
 
-        if (indexCount != 0) {
-            ReadPolygons(input, data, indexCount);
+    void SaveCS350BinaryQuantized(std::string const& file, CS350PrimitiveData const& primitive)
+    {
+        vec3 bvMin(0.0f);
+        vec3 bvMax(0.0f);
+        CalculateBoundingVolume(primitive.positions, bvMin, bvMax);
+        bool hasNormals = !primitive.normals.empty();
+        bool hasUVs = !primitive.uvs.empty();
+        if ((hasNormals && primitive.normals.size() != primitive.positions.size()) || (hasUVs && primitive.uvs.size() != primitive.positions.size())) {
+            throw std::runtime_error("Every attribute should have one element per vertex: " + file);
         }
 
-        CalculateBoundingVolume(data);
+        std::vector<std::byte> content(cQuantizedHeaderSize);
+        uint32_t vertexCount = static_cast<uint32_t>(primitive.positions.size());
+        uint32_t indexCount = static_cast<uint32_t>(primitive.polygons.size() * 3);
+        std::memcpy(content.data(), cQuantizedSignature, sizeof(cQuantizedSignature));
+        std::memcpy(content.data() + 8, &cQuantizedVersion, sizeof(cQuantizedVersion));
+        std::memcpy(content.data() + 12, &vertexCount, sizeof(vertexCount));
+        std::memcpy(content.data() + 16, &indexCount, sizeof(indexCount));
+        content[20] = std::byte{ 1 };
+        content[21] = static_cast<std::byte>(hasNormals);
+        content[22] = static_cast<std::byte>(hasUVs);
+        std::memcpy(content.data() + 24, &bvMin, sizeof(vec3));
+        std::memcpy(content.data() + 36, &bvMax, sizeof(vec3));
+
+        auto append = [&content](void const* src, size_t bytes) {
+            size_t offset = content.size();
+            content.resize(AlignTo4(offset + bytes));
+            if (bytes != 0) {
+                std::memcpy(content.data() + offset, src, bytes);
+            }
+        };
+        PositionQuantizer quantizer(bvMin, bvMax);
+        std::vector<QuantizedPosition> positions(primitive.positions.size());
+        for (size_t i = 0; i < positions.size(); ++i) {
+            positions[i] = quantizer.encode(primitive.positions[i]);
+        }
+        append(positions.data(), positions.size() * sizeof(QuantizedPosition));
+        if (hasNormals) {
+            std::vector<OctahedralNormal> normals(primitive.normals.size());
+            for (size_t i = 0; i < normals.size(); ++i) {
+                normals[i] = EncodeOctahedral(primitive.normals[i]);
+            }
+            append(normals.data(), normals.size() * sizeof(OctahedralNormal));
+        }
+        if (hasUVs) {
+            std::vector<HalfVec2> uvs(primitive.uvs.size());
+            for (size_t i = 0; i < uvs.size(); ++i) {
+                uvs[i] = { FloatToHalf(primitive.uvs[i].x), FloatToHalf(primitive.uvs[i].y) };
+            }
+            append(uvs.data(), uvs.size() * sizeof(HalfVec2));
+        }
+        append(primitive.polygons.data(), primitive.polygons.size() * sizeof(CS350PrimitiveData::Face));
 
-        return data;
+        std::ofstream outputFile(file, std::ios::binary | std::ios::trunc);
+        outputFile.write(reinterpret_cast<char const*>(content.data()), static_cast<std::streamsize>(content.size()));
+        if (!outputFile) {
+            throw std::runtime_error("Cannot write file: " + file);
+        }
     }
 
-    template <typename T>
-    inline std::istream& GenericVecRead(std::istream& is, T& v)
+    QuantizedTriangles LoadCS350BinaryQuantized(std::string const& file)
     {
-        for (int i = 0; i < T::length(); ++i) {
-            is >> v[i];
-            if (i + 1 != T::length()) {
-                is.ignore(1, ',');
+        // Quantized files are used as stored, plain ones are quantized against their bounding volume
+        PositionQuantizer quantizer;
+        std::vector<QuantizedPosition> codes;
+        std::vector<CS350PrimitiveData::Face> faces;
+        auto mapping = std::make_shared<MappedFile const>(file);
+        if (IsQuantized(mapping->data(), mapping->size())) {
+            QuantizedLayout layout = ParseQuantized(file, mapping->data(), mapping->size());
+            quantizer = PositionQuantizer(layout.bvMin, layout.bvMax);
+            codes.resize(layout.positions != nullptr ? layout.vertexCount : 0);
+            std::memcpy(codes.data(), layout.positions, codes.size() * sizeof(QuantizedPosition));
+            faces.resize(layout.faceCount);
+            std::memcpy(faces.data(), layout.faces, faces.size() * sizeof(CS350PrimitiveData::Face));
+        } else {
+            CS350PrimitiveView view = LoadCS350BinaryView(file, mapping);
+            quantizer = PositionQuantizer(view.bvMin, view.bvMax);
+            codes.resize(view.positions.size());
+            for (size_t i = 0; i < codes.size(); ++i) {
+                codes[i] = quantizer.encode(view.positions[i]);
+            }
+            faces.assign(view.polygons.begin(), view.polygons.end());
+        }
+
+        if (faces.empty()) {
+            codes.resize(codes.size() / 3 * 3);
+            return QuantizedTriangles(quantizer, std::move(codes));
+        }
+        std::vector<QuantizedPosition> soup;
+        soup.reserve(faces.size() * 3);
+        for (auto const& face : faces) {
+            for (int index : face) {
+                soup.push_back(codes.at(size_t(index)));
             }
         }
-        return is;
+        return QuantizedTriangles(quantizer, std::move(soup));
     }
 
     std::vector<CS350SceneObject> LoadCS350Scene(std::string const& file)
     {
-        std::vector<CS350SceneObject> sceneObjects{};
-
-        std::ifstream inputFile(file);
+        if (IsSceneBinary(file)) {
+            CS350SceneView view = LoadCS350SceneBinaryView(file);
+            return std::vector<CS350SceneObject>(view.objects.begin(), view.objects.end());
+        }
 
+        std::ifstream inputFile(file, std::ios::binary);
         if (!inputFile) {
             throw std::runtime_error("Cannot open file: " + file);
         }
+        std::string content((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
 
-        std::string line;
-
-        while (std::getline(inputFile, line))
+        std::vector<CS350SceneObject> sceneObjects{};
+        SceneTextParser parser(file, content.data(), content.data() + content.size());
+        while (parser.NextLine())
         {
             CS350SceneObject sceneObject{};
 
             // Read the asset index
-            std::istringstream indexStream(line);
-            indexStream >> sceneObject.primitiveIndex;
+            sceneObject.primitiveIndex = parser.Read<int>();
+            parser.SkipLine();
 
             // Read the next line for the m2w matrix
-            if (!std::getline(inputFile, line))
+            if (!parser.NextLine())
             {
                 throw std::runtime_error("Unexpected end of file while reading m2w matrix");
             }
-
-            std::istringstream matrixStream(line);
-            GenericVecRead(matrixStream, sceneObject.m2w);
+            for (int column = 0; column < 4; ++column) {
+                for (int row = 0; row < 4; ++row) {
+                    sceneObject.m2w[column][row] = parser.Read<float>();
+                }
+            }
+            parser.SkipLine();
 
             sceneObjects.push_back(sceneObject);
         }
-
-        inputFile.close();
         return sceneObjects;
     }
 
+    CS350SceneView LoadCS350SceneBinaryView(std::string const& file)
+    {
+        CS350SceneView view;
+        view.mapping = std::make_shared<MappedFile const>(file);
+        std::byte const* data = view.mapping->data();
+        size_t size = view.mapping->size();
+
+        if (size < cSceneHeaderSize || std::memcmp(data, cSceneSignature, sizeof(cSceneSignature)) != 0) {
+            throw std::runtime_error("Invalid file signature in file: " + file);
+        }
+        uint32_t version = 0;
+        uint32_t objectCount = 0;
+        std::memcpy(&version, data + 8, sizeof(version));
+        std::memcpy(&objectCount, data + 12, sizeof(objectCount));
+        if (version != cSceneVersion) {
+            throw std::runtime_error("Unsupported scene version " + std::to_string(version) + " in file: " + file);
+        }
+        if (cSceneHeaderSize + size_t(objectCount) * sizeof(CS350SceneObject) > size) {
+            throw std::runtime_error("Unexpected end of file: " + file);
+        }
+        view.objects = ArrayView<CS350SceneObject>(reinterpret_cast<CS350SceneObject const*>(data + cSceneHeaderSize), objectCount);
+        return view;
+    }
+
+    void SaveCS350SceneBinary(std::string const& file, ArrayView<CS350SceneObject> objects)
+    {
+        std::ofstream outputFile(file, std::ios::binary | std::ios::trunc);
+        if (!outputFile) {
+            throw std::runtime_error("Cannot open file: " + file);
+        }
+        uint32_t objectCount = static_cast<uint32_t>(objects.size());
+        outputFile.write(cSceneSignature, sizeof(cSceneSignature));
+        outputFile.write(reinterpret_cast<char const*>(&cSceneVersion), sizeof(cSceneVersion));
+        outputFile.write(reinterpret_cast<char const*>(&objectCount), sizeof(objectCount));
+        outputFile.write(reinterpret_cast<char const*>(objects.data()), static_cast<std::streamsize>(objects.size() * sizeof(CS350SceneObject)));
+        if (!outputFile) {
+            throw std::runtime_error("Cannot write file: " + file);
+        }
+    }
+
+    void ConvertCS350Scene(std::string const& input_file, std::string const& output_file)
+    {
+        SaveCS350SceneBinary(output_file, LoadCS350Scene(input_file));
+    }
+
 }
@@ -15,6 +15,7 @@
 #include <vector>
 #include <string>
 #include <array>
+#include <memory>
 
 #include <fstream>
 #include <sstream>
@@ -25,6 +26,9 @@
 #include "Geometry.hpp"
 #include "Logging.hpp"
 #include "ShapeUtils.hpp"
+#include "ArrayView.hpp"
+#include "MappedFile.hpp"
+#include "Quantization.hpp"
 namespace CS350 {
 
     /**
@@ -50,6 +54,22 @@ namespace CS350 {
      *
      */
 
+    /**
+     * Quantized CS350_binary format description (same contents, about half the size).
+     *
+     * 	- Filename example: "mirlo_0.cs350_binary".
+     * 	- File starts with the signature "CS350QNT" (8 bytes).
+     * 	- A format version follows (unsigned 4 bytes).
+     * 	- Vertex count and index count follow (unsigned 4 bytes each), as in the plain format.
+     * 	- Positions/normals/uvs presence follow (1 byte bool each), then 1 byte of padding.
+     * 	- bvMin and bvMax follow (3 floats each).
+     * 	- Attributes follow, each one as a separate array padded to 4 bytes:
+     * 		- Positions (if present): 3 unsigned 16 bit integers, spanning [bvMin, bvMax]
+     * 		- Normals (if present): 2 signed 16 bit integers, octahedral encoding
+     * 		- Uvs (if present): 2 half floats
+     * 	- [index_count / 3] faces follow (3 ints each).
+     */
+
     /**
      * Describes a single simple primitive.
      * 	- It WILL have positions
@@ -73,6 +93,25 @@ namespace CS350 {
 
     };
 
+    /**
+     * Zero-copy view of a CS350_binary file.
+     * 	- Attributes point directly into the file mapping (interleaved, hence strided), which the view keeps alive
+     * 	- Empty views for attributes not present in the file
+     * 	- For non-indexed files with positions only, positions.contiguous() is true and the data can be used as is
+     */
+    struct CS350PrimitiveView
+    {
+        StridedView<vec3> positions;
+        StridedView<vec2> uvs;
+        StridedView<vec3> normals;
+        ArrayView<CS350PrimitiveData::Face> polygons;
+        vec3 bvMin;
+        vec3 bvMax;
+        std::shared_ptr<MappedFile const> mapping;
+
+        CS350PrimitiveView() : bvMin(vec3(0.0f)), bvMax(vec3(0.0f)) {}
+    };
+
 
     
     /**
@@ -89,14 +128,67 @@ namespace CS350 {
     };
 
     /**
+     * CS350 binary scene format description.
      *
+     * 	- Filename example: "scene.cs350_scene".
+     * 	- File starts with the signature "CS350SCN" (8 bytes).
+     * 	- A format version follows (unsigned 4 bytes).
+     * 	- An object count follows (unsigned 4 bytes).
+     * 	- [object_count] packed records follow, laid out exactly as CS350SceneObject:
+     * 		- The primitive index (signed 4 bytes)
+     * 		- The m2w matrix, column major (16 floats)
+     */
+
+    /**
+     * Zero-copy view of a binary scene, objects point directly into the file mapping
+     */
+    struct CS350SceneView
+    {
+        ArrayView<CS350SceneObject> objects;
+        std::shared_ptr<MappedFile const> mapping;
+    };
+
+    /**
+     * Loads a CS350_binary file, attributes are copied (de-interleaved) into exactly sized arrays
      */
     CS350PrimitiveData LoadCS350Binary(std::string const& file);
 
     /**
-     *
+     * Maps a CS350_binary file, no attribute is copied. Quantized files can not be viewed
+     */
+    CS350PrimitiveView LoadCS350BinaryView(std::string const& file);
+    CS350PrimitiveView LoadCS350BinaryView(std::string const& file, std::shared_ptr<MappedFile const> mapping); // Already mapped
+
+    /**
+     * Writes a primitive in the quantized CS350_binary format, LoadCS350Binary decodes either format
+     */
+    void SaveCS350BinaryQuantized(std::string const& file, CS350PrimitiveData const& primitive);
+
+    /**
+     * Loads the triangles of a CS350_binary file (either format), keeping positions quantized in memory
+     */
+    QuantizedTriangles LoadCS350BinaryQuantized(std::string const& file);
+
+    /**
+     * Loads a scene, either in the text format or in the binary one (detected by its signature)
+     * 	- Text format: for each object, a line with the primitive index and a line with the 16 comma separated m2w floats
      */
     std::vector<CS350SceneObject> LoadCS350Scene(std::string const& file);
+
+    /**
+     * Maps a binary scene, no object is copied
+     */
+    CS350SceneView LoadCS350SceneBinaryView(std::string const& file);
+
+    /**
+     * Writes a binary scene
+     */
+    void SaveCS350SceneBinary(std::string const& file, ArrayView<CS350SceneObject> objects);
+
+    /**
+     * Converts a scene file (text or binary) into the binary format
+     */
+    void ConvertCS350Scene(std::string const& input_file, std::string const& output_file);
 }
 
 #endif // CS350LOADER_HPP
@@ -0,0 +1,83 @@
+#include "ChromeTrace.hpp"
+
+#include <fmt/format.h>
+#include <fstream>
+#include <stdexcept>
+
+namespace CS350 {
+    namespace {
+        int64_t SteadyNowNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    ChromeTrace& ChromeTrace::Instance()
+    {
+        static ChromeTrace instance;
+        return instance;
+    }
+
+    void ChromeTrace::start()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_events.clear();
+        m_origin_ns.store(SteadyNowNs(), std::memory_order_relaxed);
+        m_enabled.store(true, std::memory_order_release);
+    }
+
+    void ChromeTrace::stop()
+    {
+        m_enabled.store(false, std::memory_order_release);
+    }
+
+    void ChromeTrace::record(Event const& event)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_events.push_back(event);
+    }
+
+    double ChromeTrace::now_us() const
+    {
+        return double(SteadyNowNs() - m_origin_ns.load(std::memory_order_relaxed)) * 1e-3;
+    }
+
+    std::vector<ChromeTrace::Event> ChromeTrace::events() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_events;
+    }
+
+    std::string ChromeTrace::to_json() const
+    {
+        auto        events = this->events();
+        std::string json   = "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        json += "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"cs350\"}}";
+        for (auto const& event : events) {
+            json += fmt::format(",\n{{\"name\": \"{}\", \"cat\": \"{}\", \"ph\": \"X\", \"ts\": {:.3f}, \"dur\": {:.3f}, \"pid\": 1, \"tid\": {}",
+                                event.name, event.category, event.begin_us, event.duration_us, event.tid);
+            if (event.arg_name != nullptr) {
+                json += fmt::format(", \"args\": {{\"{}\": {}}}", event.arg_name, event.arg_value);
+            }
+            json += "}";
+        }
+        json += "\n]}\n";
+        return json;
+    }
+
+    void ChromeTrace::save(std::string const& path) const
+    {
+        std::ofstream os(path, std::ios::trunc);
+        os << to_json();
+        if (!os) {
+            throw std::runtime_error(fmt::format("Could not write file {}", path));
+        }
+    }
+
+    uint32_t ChromeTrace::ThreadId()
+    {
+        static std::atomic<uint32_t> next{ 1 };
+        thread_local uint32_t const  id = next.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+}
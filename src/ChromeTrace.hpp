@@ -0,0 +1,99 @@
+#ifndef CHROME_TRACE_HPP
+#define CHROME_TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Scoped build/load trace events. 0 compiles every CS350_TRACE_SCOPE out
+#ifndef CS350_CHROME_TRACE
+#define CS350_CHROME_TRACE 1
+#endif
+
+namespace CS350 {
+    /**
+     * Process wide recorder of timed scopes, saved in the Chrome trace event format
+     * (chrome://tracing, https://ui.perfetto.dev).
+     * 	- Disabled by default, a disabled scope costs one relaxed atomic load
+     * 	- Category, name and argument names must be string literals (only the pointers are kept)
+     * 	- Threads get small sequential ids, in order of their first event
+     */
+    class ChromeTrace {
+      public:
+        struct Event {
+            char const* category;
+            char const* name;
+            char const* arg_name; // Optional single numeric argument
+            uint64_t    arg_value;
+            double      begin_us; // Since start()
+            double      duration_us;
+            uint32_t    tid;
+        };
+
+        static ChromeTrace& Instance();
+
+        // Clears previous events and starts recording
+        void start();
+        void stop();
+        // Acquire, pairs with the release in start(): a thread that sees the trace enabled also sees its origin
+        [[nodiscard]] bool enabled() const noexcept { return m_enabled.load(std::memory_order_acquire); }
+
+        void                             record(Event const& event);
+        [[nodiscard]] double             now_us() const;
+        [[nodiscard]] std::vector<Event> events() const;
+        [[nodiscard]] std::string        to_json() const;
+        void                             save(std::string const& path) const;
+
+        [[nodiscard]] static uint32_t ThreadId();
+
+      private:
+        ChromeTrace() = default;
+
+        std::atomic<bool>    m_enabled{ false };
+        std::atomic<int64_t> m_origin_ns{ 0 }; // steady_clock
+        mutable std::mutex   m_mutex;
+        std::vector<Event>   m_events;
+    };
+
+    /**
+     * Records a complete event for its lifetime, when the trace is enabled (and active is true)
+     */
+    class ChromeTraceScope {
+      public:
+        ChromeTraceScope(char const* category, char const* name, char const* arg_name = nullptr, uint64_t arg_value = 0)
+            : ChromeTraceScope(true, category, name, arg_name, arg_value) {}
+        ChromeTraceScope(bool active, char const* category, char const* name, char const* arg_name = nullptr, uint64_t arg_value = 0)
+            : m_event{ category, name, arg_name, arg_value, -1.0, 0.0, 0 } {
+            if (active && ChromeTrace::Instance().enabled()) {
+                m_event.begin_us = ChromeTrace::Instance().now_us();
+            }
+        }
+        ~ChromeTraceScope() {
+            if (m_event.begin_us >= 0.0) {
+                m_event.duration_us = ChromeTrace::Instance().now_us() - m_event.begin_us;
+                m_event.tid         = ChromeTrace::ThreadId();
+                ChromeTrace::Instance().record(m_event);
+            }
+        }
+        ChromeTraceScope(ChromeTraceScope const&)            = delete;
+        ChromeTraceScope& operator=(ChromeTraceScope const&) = delete;
+
+      private:
+        ChromeTrace::Event m_event;
+    };
+}
+
+#define CS350_TRACE_CONCAT_IMPL(a, b) a##b
+#define CS350_TRACE_CONCAT(a, b)      CS350_TRACE_CONCAT_IMPL(a, b)
+#if CS350_CHROME_TRACE
+#define CS350_TRACE_SCOPE(...)         ::CS350::ChromeTraceScope CS350_TRACE_CONCAT(cs350_trace_scope_, __LINE__)(__VA_ARGS__)
+#define CS350_TRACE_SCOPE_IF(cond, ...) ::CS350::ChromeTraceScope CS350_TRACE_CONCAT(cs350_trace_scope_, __LINE__)(bool(cond), __VA_ARGS__)
+#else
+#define CS350_TRACE_SCOPE(...)          ((void)0)
+#define CS350_TRACE_SCOPE_IF(cond, ...) ((void)0)
+#endif
+
+#endif // CHROME_TRACE_HPP
@@ -0,0 +1,146 @@
+#include "ConfigTuner.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fmt/format.h>
+#include <sstream>
+#include <stdexcept>
+
+namespace CS350 {
+    namespace {
+        using Clock = std::chrono::steady_clock;
+
+        double MillisecondsSince(Clock::time_point start)
+        {
+            return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+
+        struct Contender
+        {
+            TunerCandidate      candidate;
+            KdTree              tree;
+            std::vector<double> rays_per_second; // Samples of the current round
+        };
+    }
+
+    TunerReport TuneConfig(std::vector<Triangle> const& triangles, ArrayView<Ray> rays, TunerOptions const& options)
+    {
+        if (triangles.empty() || rays.empty()) {
+            throw std::runtime_error("Config tuning needs triangles and rays");
+        }
+        auto const start = Clock::now();
+
+        std::vector<Contender> contenders;
+        for (float traversal : options.cost_traversal) {
+            for (float intersection : options.cost_intersection) {
+                for (int depth : options.max_depth) {
+                    for (int min_triangles : options.min_triangles) {
+                        Contender contender;
+                        contender.candidate.config = { traversal, intersection, depth, min_triangles };
+                        contenders.push_back(std::move(contender));
+                    }
+                }
+            }
+        }
+        if (contenders.empty()) {
+            throw std::runtime_error("Config tuning needs at least one candidate");
+        }
+
+        auto build = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                auto& contender   = contenders[i];
+                auto  build_start = Clock::now();
+                contender.tree.build(triangles, contender.candidate.config);
+                contender.candidate.build_ms   = MillisecondsSince(build_start);
+                contender.candidate.node_count = contender.tree.nodes().size();
+                contender.candidate.sah_cost   = contender.tree.quality_report().sah_cost;
+            }
+        };
+        if (options.pool != nullptr) {
+            options.pool->parallel_for(contenders.size(), build);
+        } else {
+            build(0, contenders.size());
+        }
+
+        TunerReport                 report;
+        std::vector<TunerCandidate> eliminated;
+        size_t                      ray_count    = std::min(std::max<size_t>(options.initial_rays, 1), rays.size());
+        size_t const                keep_divisor = std::max<size_t>(options.keep_divisor, 2);
+        unsigned const              repetitions  = std::max(options.repetitions, 1u);
+        for (;;) {
+            ++report.rounds;
+            auto pass = [&](Contender& contender) {
+                auto   query_start = Clock::now();
+                size_t hits        = 0;
+                for (size_t i = 0; i < ray_count; ++i) {
+                    hits += contender.tree.get_closest<Instrumentation::None>(triangles, rays[i], nullptr) ? 1 : 0;
+                }
+                double ms                     = std::max(MillisecondsSince(query_start), 1e-6);
+                contender.candidate.hit_ratio = double(hits) / double(ray_count);
+                return double(ray_count) * 1000.0 / ms;
+            };
+            for (auto& contender : contenders) { // Warm up pass
+                (void)pass(contender);
+                contender.rays_per_second.clear();
+            }
+            for (unsigned r = 0; r < repetitions; ++r) {
+                for (auto& contender : contenders) {
+                    contender.rays_per_second.push_back(pass(contender));
+                }
+            }
+            for (auto& contender : contenders) {
+                auto& samples = contender.rays_per_second;
+                std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+                contender.candidate.rays_per_second = samples[samples.size() / 2];
+                contender.candidate.rounds          = report.rounds;
+            }
+            std::stable_sort(contenders.begin(), contenders.end(), [](Contender const& lhs, Contender const& rhs) {
+                return lhs.candidate.rays_per_second > rhs.candidate.rays_per_second;
+            });
+
+            bool const last_round = ray_count == rays.size();
+            size_t     keep       = last_round ? 1 : std::max<size_t>(1, contenders.size() / keep_divisor);
+            for (size_t i = keep; i < contenders.size(); ++i) {
+                eliminated.push_back(contenders[i].candidate);
+            }
+            contenders.resize(keep); // Frees the trees of the eliminated candidates
+            if (last_round || keep == 1) {
+                break;
+            }
+            ray_count = std::min(ray_count * 2, rays.size());
+        }
+
+        report.best       = contenders.front().candidate.config;
+        report.candidates = std::move(eliminated);
+        report.candidates.push_back(contenders.front().candidate);
+        std::stable_sort(report.candidates.begin(), report.candidates.end(), [](TunerCandidate const& lhs, TunerCandidate const& rhs) {
+            if (lhs.rounds != rhs.rounds) {
+                return lhs.rounds > rhs.rounds;
+            }
+            return lhs.rays_per_second > rhs.rays_per_second;
+        });
+        report.elapsed_ms = MillisecondsSince(start);
+        return report;
+    }
+
+    std::string TunerReport::to_json() const
+    {
+        std::ostringstream os;
+        os << "{\n"
+           << fmt::format("  \"best\": {{ \"cost_traversal\": {}, \"cost_intersection\": {}, \"max_depth\": {}, \"min_triangles\": {} }},\n",
+                          best.cost_traversal, best.cost_intersection, best.max_depth, best.min_triangles)
+           << fmt::format("  \"rounds\": {},\n", rounds)
+           << fmt::format("  \"elapsed_ms\": {:.3f},\n", elapsed_ms)
+           << "  \"candidates\": [";
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            auto const& c = candidates[i];
+            os << (i == 0 ? "\n" : ",\n")
+               << fmt::format("    {{ \"cost_traversal\": {}, \"cost_intersection\": {}, \"max_depth\": {}, \"min_triangles\": {}, "
+                              "\"rays_per_second\": {:.1f}, \"hit_ratio\": {:.4f}, \"build_ms\": {:.3f}, \"node_count\": {}, \"sah_cost\": {}, \"rounds\": {} }}",
+                              c.config.cost_traversal, c.config.cost_intersection, c.config.max_depth, c.config.min_triangles,
+                              c.rays_per_second, c.hit_ratio, c.build_ms, c.node_count, c.sah_cost, c.rounds);
+        }
+        os << "\n  ]\n}\n";
+        return os.str();
+    }
+}
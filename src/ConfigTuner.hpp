@@ -0,0 +1,59 @@
+#ifndef CONFIG_TUNER_HPP
+#define CONFIG_TUNER_HPP
+
+#include <string>
+#include <vector>
+#include "ArrayView.hpp"
+#include "KdTree.hpp"
+#include "Shapes.hpp"
+#include "ThreadPool.hpp"
+
+namespace CS350 {
+    /**
+     * Search space and budget of TuneConfig. Candidates are every combination of the value lists
+     */
+    struct TunerOptions {
+        std::vector<float> cost_traversal    = { 1.0f };
+        std::vector<float> cost_intersection = { 1.0f, 2.0f, 5.0f, 10.0f, 20.0f, 40.0f, 80.0f };
+        std::vector<int>   max_depth         = { 0, 16, 24 };
+        std::vector<int>   min_triangles     = { 1, 4, 16, 64 };
+
+        size_t      initial_rays = 256;     // Rays timed per candidate in the first round, doubled every round
+        size_t      keep_divisor = 2;       // 1 / keep_divisor of the candidates survive each round
+        unsigned    repetitions  = 5;       // Timed passes per candidate and round, after an untimed one, ranked by their median
+        ThreadPool* pool         = nullptr; // When set, candidate trees are built in parallel (queries are always timed on the calling thread)
+    };
+
+    struct TunerCandidate {
+        KdTree::Config config;
+        double         rays_per_second = 0.0; // Median of the last round the candidate took part in
+        double         hit_ratio       = 0.0; // Same for every candidate, a sanity check
+        double         build_ms        = 0.0;
+        size_t         node_count      = 0;
+        float          sah_cost        = 0.0f;
+        int            rounds          = 0;   // Rounds survived (the best one survived them all)
+    };
+
+    struct TunerReport {
+        KdTree::Config              best;
+        std::vector<TunerCandidate> candidates; // Best first: by rounds survived, then by rays per second
+        int                         rounds     = 0;
+        double                      elapsed_ms = 0.0;
+
+        [[nodiscard]] std::string to_json() const;
+    };
+
+    /**
+     * Picks the Config that answers the given rays the fastest, by successive halving:
+     * every candidate tree is built and timed on the first rays, the fastest 1/keep_divisor go to the next round,
+     * which times twice as many rays, until one candidate is left or the rays run out.
+     * 	- Each round warms every candidate up with one untimed pass, then times repetitions passes, interleaved
+     * 	  (every candidate once per repetition) so that clock and cache drifts are shared, and ranks by the median
+     * 	- Every candidate tree is built up front and kept in memory until the candidate is eliminated
+     * 	- Throws if there are no triangles, no rays or no candidates
+     * 	- Synchronous: at service startup, run it through ThreadPool::submit and build with the result
+     */
+    TunerReport TuneConfig(std::vector<Triangle> const& triangles, ArrayView<Ray> rays, TunerOptions const& options = {});
+}
+
+#endif // CONFIG_TUNER_HPP
@@ -0,0 +1,249 @@
+#include "CostCalibration.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "MeshGenerator.hpp"
+#include "ShapeUtils.hpp"
+#include "Utils.hpp"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace CS350 {
+    namespace {
+        size_t const   cSampleCount = 1024; // Rays/boxes/triangles, small enough to stay in L1
+        size_t const   cIterations  = 1 << 18;
+        int const      cRepetitions = 7; // The fastest repetition is kept
+        uint32_t const cSeed        = 0x350;
+
+        /**
+         * Rays aimed around the given triangles, part of the tests hit
+         */
+        std::vector<Ray> AimedRays(std::vector<Triangle> const& triangles)
+        {
+            std::vector<Ray> rays;
+            rays.reserve(triangles.size());
+            for (size_t i = 0; i < triangles.size(); ++i) {
+                // Origins and jitter come from the triangles themselves (deterministic and spread)
+                auto const& tri    = triangles[i];
+                auto const& other  = triangles[(i * 7 + 3) % triangles.size()];
+                vec3        center = (tri[0] + tri[1] + tri[2]) / 3.0f;
+                vec3        target = center + (other[0] - other[1]) * 0.5f;
+                vec3        origin = glm::normalize(other[2] + vec3(0.001f)) * 4.0f;
+                rays.emplace_back(origin, target - origin);
+            }
+            return rays;
+        }
+
+        template <typename F>
+        float FastestNanoseconds(F const& f)
+        {
+            double best = 0.0;
+            for (int r = 0; r < cRepetitions; ++r) {
+                auto   start = std::chrono::steady_clock::now();
+                f();
+                double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / double(cIterations);
+                best      = r == 0 ? ns : std::min(best, ns);
+            }
+            return float(best);
+        }
+
+        std::string Sanitize(std::string text)
+        {
+            std::replace_if(text.begin(), text.end(), [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+            return text;
+        }
+
+        std::string HostName()
+        {
+#ifdef _WIN32
+            char const* name = std::getenv("COMPUTERNAME");
+            return name != nullptr ? name : "unknown";
+#else
+            char name[256] = {};
+            return gethostname(name, sizeof(name) - 1) == 0 ? name : "unknown";
+#endif
+        }
+
+        std::string CpuModel()
+        {
+            std::ifstream is("/proc/cpuinfo");
+            std::string   line;
+            while (std::getline(is, line)) {
+                if (line.rfind("model name", 0) == 0 && line.find(':') != std::string::npos) {
+                    return line.substr(line.find(':') + 2);
+                }
+            }
+            return "unknown cpu";
+        }
+    }
+
+    KdTree::Config CostCalibration::apply(KdTree::Config cfg) const
+    {
+        cfg.cost_traversal    = 1.0f;
+        cfg.cost_intersection = traversal_ns > 0.0f ? intersection_ns / traversal_ns : cfg.cost_intersection;
+        return cfg;
+    }
+
+    CostCalibration CalibrateCosts()
+    {
+        MeshGeneratorConfig generator;
+        generator.shape          = MeshShape::Soup;
+        generator.triangle_count = cSampleCount;
+        generator.seed           = cSeed;
+        auto const triangles     = GenerateTriangles(generator);
+        auto const rays          = AimedRays(triangles);
+
+        // Internal nodes whose children are neighbour boxes, as in a depth first layout
+        std::vector<Aabb>         aabbs;
+        std::vector<KdTree::Node> nodes(cSampleCount);
+        for (size_t i = 0; i < cSampleCount; ++i) {
+            aabbs.push_back(triangles[i].GetBoundingBox());
+            nodes[i].set_internal(unsigned(i % 3), 0.0f, unsigned((i + 2) % cSampleCount));
+        }
+
+        CostCalibration result;
+        result.host = CostCalibrationHostId();
+
+        // One traversal step, as in the closest hit loop: pop, fetch, test both children, push the hits
+        volatile float sink = 0.0f;
+        result.traversal_ns = FastestNanoseconds([&] {
+            struct Pending {
+                unsigned node;
+                float    t;
+            };
+            std::array<Pending, 4> stack{};
+            size_t                 stack_size = 1;
+            float                  sum        = 0.0f;
+            for (size_t i = 0; i < cIterations; ++i) {
+                Pending     current = stack[--stack_size];
+                auto        index   = unsigned((current.node + i) % cSampleCount);
+                auto const& node    = nodes[index];
+                auto const& ray     = rays[i % cSampleCount];
+                if (node.is_internal()) {
+                    unsigned left_index = (index + 1) % cSampleCount;
+                    Pending  left{ left_index, IntersectionTimeRayAabb<Instrumentation::None>(ray, aabbs[left_index]) };
+                    Pending  right{ node.next_child(), IntersectionTimeRayAabb<Instrumentation::None>(ray, aabbs[node.next_child()]) };
+                    if (left.t >= 0.0f && right.t >= 0.0f && left.t < right.t) {
+                        std::swap(left, right);
+                    }
+                    if (left.t >= 0.0f) {
+                        stack[stack_size++] = left;
+                    }
+                    if (right.t >= 0.0f) {
+                        stack[stack_size++] = right;
+                    }
+                    sum += current.t;
+                }
+                stack_size = std::clamp<size_t>(stack_size, 1, 2); // Keeps a steady depth, the sample nodes never end
+            }
+            sink = sum;
+        });
+
+        result.intersection_ns = FastestNanoseconds([&] {
+            float sum = 0.0f;
+            for (size_t i = 0; i < cIterations; ++i) {
+                sum += IntersectionTimeRayTriangle<Instrumentation::None>(rays[i % cSampleCount], triangles[(i * 5) % cSampleCount]);
+            }
+            sink = sum;
+        });
+        (void)sink;
+        return result;
+    }
+
+    CostCalibration LoadOrCalibrateCosts(std::string const& cache_file)
+    {
+        std::string const        host = CostCalibrationHostId();
+        std::vector<std::string> others;
+        {
+            std::ifstream is(cache_file);
+            std::string   line;
+            while (std::getline(is, line)) {
+                std::istringstream fields(line);
+                std::string        entry_host;
+                CostCalibration    entry;
+                if (!std::getline(fields, entry_host, '\t')) {
+                    continue;
+                }
+                if (entry_host != host) {
+                    others.push_back(line);
+                    continue;
+                }
+                if (fields >> entry.traversal_ns >> entry.intersection_ns && entry.traversal_ns > 0.0f && entry.intersection_ns > 0.0f) {
+                    entry.host = host;
+                    return entry;
+                }
+                // Corrupt entry of this host, measured again below
+            }
+        }
+
+        CostCalibration result = CalibrateCosts();
+        std::error_code error;
+        auto            folder = std::filesystem::path(cache_file).parent_path();
+        if (!folder.empty()) {
+            std::filesystem::create_directories(folder, error);
+        }
+        // Readers (other processes sharing the file) see the old or the new file, never a partial one
+        std::string   tmp_path = UniqueTempPath(cache_file);
+        std::ofstream os(tmp_path, std::ios::trunc);
+        for (auto const& line : others) {
+            os << line << '\n';
+        }
+        os << fmt::format("{}\t{}\t{}\n", result.host, result.traversal_ns, result.intersection_ns);
+        os.close();
+        if (!os) {
+            std::filesystem::remove(tmp_path, error);
+            throw std::runtime_error(fmt::format("Could not write file {}", tmp_path));
+        }
+        std::filesystem::rename(tmp_path, cache_file);
+        return result;
+    }
+
+    CostCalibration LoadOrCalibrateCosts()
+    {
+        return LoadOrCalibrateCosts(DefaultCostCacheFile());
+    }
+
+    std::string MachineBuildId()
+    {
+#if defined(__clang__)
+        std::string compiler = fmt::format("clang {}.{}", __clang_major__, __clang_minor__);
+#elif defined(__GNUC__)
+        std::string compiler = fmt::format("gcc {}.{}", __GNUC__, __GNUC_MINOR__);
+#elif defined(_MSC_VER)
+        std::string compiler = fmt::format("msvc {}", _MSC_VER);
+#else
+        std::string compiler = "unknown compiler";
+#endif
+        return Sanitize(fmt::format("{}|{} threads|{}|instrumentation {}", CpuModel(), std::thread::hardware_concurrency(), compiler, CS350_INSTRUMENTATION));
+    }
+
+    std::string CostCalibrationHostId()
+    {
+        return Sanitize(fmt::format("{}|{}", HostName(), MachineBuildId()));
+    }
+
+    std::string DefaultCostCacheFile()
+    {
+        std::filesystem::path folder;
+        if (char const* xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0') {
+            folder = xdg;
+        } else if (char const* home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+            folder = std::filesystem::path(home) / ".cache";
+        } else {
+            std::error_code error;
+            folder = std::filesystem::temp_directory_path(error);
+        }
+        return (folder / "cs350" / "sah_costs.txt").string();
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef COST_CALIBRATION_HPP
+#define COST_CALIBRATION_HPP
+
+#include <string>
+#include "KdTree.hpp"
+
+namespace CS350 {
+    /**
+     * Measured cost of the two operations the SAH weighs, on this machine and build
+     * 	- traversal_ns: one internal node step of the closest hit traversal (node fetch, both child ray/aabb tests, stack push/pop)
+     * 	- intersection_ns: one ray/triangle test
+     * Both use the uninstrumented kernels, with data resident in L1 (memory effects depend on the workload, not the host).
+     */
+    struct CostCalibration {
+        std::string host;
+        float       traversal_ns    = 0.0f;
+        float       intersection_ns = 0.0f;
+
+        // cost_traversal = 1, cost_intersection = intersection_ns / traversal_ns, the rest of cfg is kept
+        [[nodiscard]] KdTree::Config apply(KdTree::Config cfg) const;
+    };
+
+    /**
+     * Runs the microbenchmarks (a few tens of milliseconds)
+     */
+    CostCalibration CalibrateCosts();
+
+    /**
+     * Cached calibration: returns the entry of this host from cache_file, or calibrates and adds it.
+     * The file keeps one line per host ("host<TAB>traversal_ns<TAB>intersection_ns"), so it can be shared (e.g. a home folder)
+     */
+    CostCalibration LoadOrCalibrateCosts(std::string const& cache_file);
+    CostCalibration LoadOrCalibrateCosts(); // DefaultCostCacheFile()
+
+    /**
+     * Identifies the host and the build: host name, CPU model, thread count, compiler and instrumentation level.
+     * Tabs and new lines are replaced by spaces
+     */
+    std::string CostCalibrationHostId();
+
+    /**
+     * Same without the host name: machines of the same model running the same build share it (e.g. CI runners)
+     */
+    std::string MachineBuildId();
+
+    /**
+     * $XDG_CACHE_HOME/cs350/sah_costs.txt, ~/.cache/cs350/sah_costs.txt, or the temporary folder
+     */
+    std::string DefaultCostCacheFile();
+}
+
+#endif // COST_CALIBRATION_HPP
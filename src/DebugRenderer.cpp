@@ -14,18 +14,163 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
 #include <Shader.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
 #include <variant>
 
+namespace {
+    // Batched geometry carries its color per vertex, so a whole batch is a single draw call
+    const char* const cBatchVertexShaderSource = R"(
+        #version 330 core
+        layout(location = 0) in vec3 attr_position;
+        layout(location = 1) in vec4 attr_color;
+        uniform mat4 uniform_mvp;
+        out vec4 color;
+        void main()
+        {
+            color = attr_color;
+            gl_Position = uniform_mvp * vec4(attr_position, 1.0f);
+        }
+    )";
+
+    const char* const cBatchFragmentShaderSource = R"(
+        #version 330 core
+        in vec4 color;
+        out vec4 out_color;
+        void main()
+        {
+            out_color = color;
+        }
+    )";
+
+    // Boxes are instances of the unit cube, stretched from their min to their max
+    const char* const cBoxVertexShaderSource = R"(
+        #version 330 core
+        layout(location = 0) in vec3 attr_corner;
+        layout(location = 1) in vec3 attr_min;
+        layout(location = 2) in vec3 attr_max;
+        layout(location = 3) in vec4 attr_color;
+        uniform mat4 uniform_mvp;
+        out vec4 color;
+        void main()
+        {
+            color = attr_color;
+            gl_Position = uniform_mvp * vec4(mix(attr_min, attr_max, attr_corner), 1.0f);
+        }
+    )";
+
+    constexpr CS350::DebugBlend cBlendOrder[] = { CS350::DebugBlend::Opaque, CS350::DebugBlend::Alpha, CS350::DebugBlend::Additive };
+    constexpr GLenum            cBatchModes[] = { GL_LINES, GL_TRIANGLES };
+
+    // Box corners: bit 0 is x, bit 1 is y, bit 2 is z (set is max)
+    std::array<glm::vec3, 8> AabbCorners(const CS350::Aabb& aabb) {
+        std::array<glm::vec3, 8> corners;
+        for (int i = 0; i < 8; ++i) {
+            corners[size_t(i)] = { (i & 1) ? aabb.max.x : aabb.min.x, (i & 2) ? aabb.max.y : aabb.min.y, (i & 4) ? aabb.max.z : aabb.min.z };
+        }
+        return corners;
+    }
+
+    constexpr int cAabbEdges[24] = {
+        0, 1, 2, 3, 4, 5, 6, 7, // Along x
+        0, 2, 1, 3, 4, 6, 5, 7, // Along y
+        0, 4, 1, 5, 2, 6, 3, 7  // Along z
+    };
+
+    constexpr int cAabbTriangles[36] = {
+        0, 2, 1, 1, 2, 3, // -z
+        4, 5, 6, 5, 7, 6, // +z
+        0, 4, 2, 2, 4, 6, // -x
+        1, 3, 5, 3, 7, 5, // +x
+        0, 1, 4, 1, 5, 4, // -y
+        2, 6, 3, 3, 6, 7  // +y
+    };
+
+    /**
+     * Uploads every batch into a stream buffer, one after the other: grown geometrically, otherwise orphaned
+     * so the driver does not wait for the previous frame to be done with it. Returns the first element of each batch
+     */
+    template <typename T>
+    std::array<GLint, 6> StreamBatches(GLuint vbo, size_t& capacity, std::array<std::vector<T>, 6> const& batches) {
+        size_t total = 0;
+        for (auto const& batch : batches) {
+            total += batch.size();
+        }
+        std::array<GLint, 6> first{};
+        if (total == 0) {
+            return first;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        if (total > capacity) {
+            capacity = std::max(total, capacity * 2);
+        }
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(capacity * sizeof(T)), nullptr, GL_STREAM_DRAW);
+        GLint offset = 0;
+        for (size_t i = 0; i < batches.size(); ++i) {
+            first[i] = offset;
+            if (!batches[i].empty()) {
+                glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(offset) * static_cast<GLintptr>(sizeof(T)),
+                                static_cast<GLsizeiptr>(batches[i].size() * sizeof(T)), batches[i].data());
+            }
+            offset += static_cast<GLint>(batches[i].size());
+        }
+        return first;
+    }
+}
+
 namespace CS350 {
 
 
     DebugRenderer::DebugRenderer() {
         // Create and compile the shader program
         mShader.CompileAndLinkShaders();
+        mBatchShader.CompileAndLinkShaders(cBatchVertexShaderSource, cBatchFragmentShaderSource);
+
+        // Streaming buffer of the batches, allocated by the first Render
+        glGenVertexArrays(1, &mStreamVAO);
+        glGenBuffers(1, &mStreamVBO);
+        glBindVertexArray(mStreamVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, mStreamVBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), reinterpret_cast<void*>(offsetof(BatchVertex, position)));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), reinterpret_cast<void*>(offsetof(BatchVertex, color)));
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+
+        // Instanced boxes: static unit cube, instance attributes are pointed at each batch by Render
+        mBoxShader.CompileAndLinkShaders(cBoxVertexShaderSource, cBatchFragmentShaderSource);
+        auto                cube = AabbCorners(Aabb(glm::vec3(0.0f), glm::vec3(1.0f)));
+        std::vector<GLuint> cubeIndices(std::begin(cAabbTriangles), std::end(cAabbTriangles));
+        cubeIndices.insert(cubeIndices.end(), std::begin(cAabbEdges), std::end(cAabbEdges));
+        glGenVertexArrays(1, &mBoxVAO);
+        glGenBuffers(1, &mCubeVBO);
+        glGenBuffers(1, &mCubeEBO);
+        glGenBuffers(1, &mInstanceVBO);
+        glBindVertexArray(mBoxVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, mCubeVBO);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(cube)), cube.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mCubeEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(cubeIndices.size() * sizeof(GLuint)), cubeIndices.data(), GL_STATIC_DRAW);
+        for (GLuint attribute = 1; attribute <= 3; ++attribute) {
+            glEnableVertexAttribArray(attribute);
+            glVertexAttribDivisor(attribute, 1);
+        }
+        glBindVertexArray(0);
     }
 
     DebugRenderer::~DebugRenderer() {
-        // Clean up is handled by Shader destructor
+        // Shaders are cleaned up by the Shader destructor
+        glDeleteBuffers(1, &mStreamVBO);
+        glDeleteVertexArrays(1, &mStreamVAO);
+        glDeleteBuffers(1, &mInstanceVBO);
+        glDeleteBuffers(1, &mCubeEBO);
+        glDeleteBuffers(1, &mCubeVBO);
+        glDeleteVertexArrays(1, &mBoxVAO);
     }
 
     void DebugRenderer::ActivateShader() const {
@@ -40,10 +185,10 @@ namespace CS350 {
         ActivateShader();
 
         // Set up the projection matrix
-        glUniformMatrix4fv(glGetUniformLocation(mShader.GetProgramID(), "uniform_mvp"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+        mShader.SetUniform("uniform_mvp", viewProjection);
 
         // Set up the point color
-        glUniform4fv(glGetUniformLocation(mShader.GetProgramID(), "uniform_color"), 1, glm::value_ptr(color));
+        mShader.SetUniform("uniform_color", color);
 
         // Create a temporary VAO and VBO
         GLuint vao = 0;
@@ -100,8 +245,8 @@ namespace CS350 {
         glEnableVertexAttribArray(0);
 
         // Set shader uniforms
-        glUniformMatrix4fv(glGetUniformLocation(mShader.GetProgramID(), "uniform_mvp"), 1, GL_FALSE, glm::value_ptr(viewProjection));
-        glUniform4fv(glGetUniformLocation(mShader.GetProgramID(), "uniform_color"), 1, glm::value_ptr(color));
+        mShader.SetUniform("uniform_mvp", viewProjection);
+        mShader.SetUniform("uniform_color", color);
 
         // Set point size
         glPointSize(size);
@@ -150,8 +295,8 @@ namespace CS350 {
         mPrimitive.SetupBuffer(vertices);
 
         // Set the uniform variables in the shader
-        glUniformMatrix4fv(glGetUniformLocation(mShader.GetProgramID(), "uniform_mvp"), 1, GL_FALSE, glm::value_ptr(viewProjection));
-        glUniform4fv(glGetUniformLocation(mShader.GetProgramID(), "uniform_color"), 1, glm::value_ptr(color));
+        mShader.SetUniform("uniform_mvp", viewProjection);
+        mShader.SetUniform("uniform_color", color);
 
         // Draw the line segment using Primitive helper function
         mPrimitive.Draw(GL_LINES);
@@ -167,9 +312,9 @@ namespace CS350 {
         trianglePrimitive.SetupBuffer({ v0, v1, v2 });
 
         // Set the uniform variables in the shader
-        GLint mvpLocation = glGetUniformLocation(mShader.GetProgramID(), "uniform_mvp");
+        GLint mvpLocation = mShader.GetUniformLocation("uniform_mvp");
         glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(viewProjection));
-        GLint colorLocation = glGetUniformLocation(mShader.GetProgramID(), "uniform_color");
+        GLint colorLocation = mShader.GetUniformLocation("uniform_color");
         glUniform4fv(colorLocation, 1, glm::value_ptr(color));
 
         // Draw the triangle from the Primitive
@@ -207,8 +352,8 @@ namespace CS350 {
         // First render the solid cube
         glUseProgram(mShader.GetProgramID());
 
-        glUniformMatrix4fv(glGetUniformLocation(mShader.GetProgramID(), "uniform_mvp"), 1, GL_FALSE, glm::value_ptr(mvp));
-        glUniform4fv(glGetUniformLocation(mShader.GetProgramID(), "uniform_color"), 1, glm::value_ptr(color));
+        mShader.SetUniform("uniform_mvp", mvp);
+        mShader.SetUniform("uniform_color", color);
 
         glDisable(GL_CULL_FACE);
 
@@ -267,7 +412,7 @@ namespace CS350 {
 
         // Use black color for wireframe
         glm::vec4 wireframeColor = glm::vec4(0, 0, 0, 1);
-        glUniform4fv(glGetUniformLocation(mShader.GetProgramID(), "uniform_color"), 1, glm::value_ptr(wireframeColor));
+        mShader.SetUniform("uniform_color", wireframeColor);
 
         glDrawElements(GL_LINES, static_cast<GLsizei>(wireframeIndices.size()), GL_UNSIGNED_INT, 0);
 
@@ -341,9 +486,9 @@ namespace CS350 {
 
 
         // Set the uniform variables in the shader
-        GLint mvpLocation = glGetUniformLocation(mShader.GetProgramID(), "uniform_mvp");
+        GLint mvpLocation = mShader.GetUniformLocation("uniform_mvp");
         glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(viewProjection));
-        GLint colorLocation = glGetUniformLocation(mShader.GetProgramID(), "uniform_color");
+        GLint colorLocation = mShader.GetUniformLocation("uniform_color");
         glUniform4fv(colorLocation, 1, glm::value_ptr(color));
 
         // Draw the AABB wireframe
@@ -368,9 +513,9 @@ namespace CS350 {
         glUseProgram(mShader.GetProgramID());
 
         // Set the uniform variables in the shader
-        GLint mvpLocation = glGetUniformLocation(mShader.GetProgramID(), "uniform_mvp");
+        GLint mvpLocation = mShader.GetUniformLocation("uniform_mvp");
         glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(viewProjection));
-        GLint colorLocation = glGetUniformLocation(mShader.GetProgramID(), "uniform_color");
+        GLint colorLocation = mShader.GetUniformLocation("uniform_color");
         glUniform4fv(colorLocation, 1, glm::value_ptr(color));
 
         // Draw the plane
@@ -421,9 +566,9 @@ namespace CS350 {
 
         glUseProgram(mShader.GetProgramID());
 
-        GLint mvpLocation = glGetUniformLocation(mShader.GetProgramID(), "uniform_mvp");
+        GLint mvpLocation = mShader.GetUniformLocation("uniform_mvp");
         glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(viewProjection));
-        GLint colorLocation = glGetUniformLocation(mShader.GetProgramID(), "uniform_color");
+        GLint colorLocation = mShader.GetUniformLocation("uniform_color");
         glUniform4fv(colorLocation, 1, glm::value_ptr(color));
 
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -446,22 +591,10 @@ namespace CS350 {
 
 
 
-    void SetShaderUniforms(GLuint shaderProgram, const glm::mat4& viewProjection, const glm::vec4& color) {
-        GLint vpLoc = glGetUniformLocation(shaderProgram, "uniform_mvp");
-        if (vpLoc != -1) {
-            glUniformMatrix4fv(vpLoc, 1, GL_FALSE, glm::value_ptr(viewProjection));
-        }
-        else {
-            std::cerr << "Uniform 'uniform_mvp' not found in shader program." << std::endl;
-        }
-
-        GLint colorLoc = glGetUniformLocation(shaderProgram, "uniform_color");
-        if (colorLoc != -1) {
-            glUniform4fv(colorLoc, 1, glm::value_ptr(color));
-        }
-        else {
-            std::cerr << "Uniform 'uniform_color' not found in shader program." << std::endl;
-        }
+    void SetShaderUniforms(const Shader& shader, const glm::mat4& viewProjection, const glm::vec4& color) {
+        // Locations are cached by the shader, missing uniforms are reported once
+        shader.SetUniform("uniform_mvp", viewProjection);
+        shader.SetUniform("uniform_color", color);
     }
 
     void DebugRenderer::DrawFrustumImmediate(const glm::mat4& viewProj, const glm::mat4& frustumVP, const glm::vec4& color) const {
@@ -503,7 +636,7 @@ namespace CS350 {
         glUseProgram(mShader.GetProgramID());
 
         // Set shader uniforms
-        SetShaderUniforms(mShader.GetProgramID(), viewProj, color);
+        SetShaderUniforms(mShader, viewProj, color);
 
         // Ensure correct OpenGL state
         glDepthMask(GL_FALSE);   // No Depth-Writing
@@ -547,7 +680,7 @@ namespace CS350 {
 
 
         glm::vec4 edgeColor(0, 0, 0, 1); // Black color for edges
-        SetShaderUniforms(mShader.GetProgramID(), viewProj, edgeColor);
+        SetShaderUniforms(mShader, viewProj, edgeColor);
         // glBufferData(GL_ELEMENT_ARRAY_BUFFER, edgeIndices.size() * sizeof(GLuint), edgeIndices.data(), GL_DYNAMIC_DRAW);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(edgeIndices.size()) * static_cast<GLsizeiptr>(sizeof(GLuint)), edgeIndices.data(), GL_DYNAMIC_DRAW);
 
@@ -588,7 +721,7 @@ namespace CS350 {
         glUseProgram(mShader.GetProgramID());
 
         // Set shader uniforms
-        SetShaderUniforms(mShader.GetProgramID(), viewProj, color);
+        SetShaderUniforms(mShader, viewProj, color);
 
         // Ensure correct OpenGL state
         glDepthMask(GL_FALSE);   // No Depth-Writing
@@ -642,10 +775,10 @@ namespace CS350 {
         ActivateShader();
 
         // Set the transformation matrix
-        glUniformMatrix4fv(glGetUniformLocation(mShader.GetProgramID(), "uniform_mvp"), 1, GL_FALSE, glm::value_ptr(m2w));
+        mShader.SetUniform("uniform_mvp", m2w);
 
         // Set the color for wireframe drawing
-        glUniform4fv(glGetUniformLocation(mShader.GetProgramID(), "uniform_color"), 1, glm::value_ptr(color));
+        mShader.SetUniform("uniform_color", color);
 
         // Bind the VAO of the primitive
         primitive->Bind();
@@ -659,4 +792,205 @@ namespace CS350 {
         DeactivateShader();
     }
 
+    void DebugRenderer::DrawPrimitivePartImmediate(const glm::mat4& viewProjection, const Primitive* primitive, GLint first, GLsizei count, const glm::vec4& color, bool wireframe) {
+        if (!primitive || count <= 0) return;
+
+        ActivateShader();
+        mShader.SetUniform("uniform_mvp", viewProjection);
+        mShader.SetUniform("uniform_color", color);
+        if (wireframe) {
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        }
+
+        // A range of a shared buffer, no copy of the triangles
+        primitive->DrawPart(GL_TRIANGLES, first, count);
+
+        if (wireframe) {
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        }
+        DeactivateShader();
+    }
+
+    void DebugRenderer::DrawSegment(const glm::vec3& start, const glm::vec3& end, const glm::vec4& color) {
+        auto& batch = Batch(GL_LINES);
+        batch.push_back({ start, color });
+        batch.push_back({ end, color });
+    }
+
+    void DebugRenderer::DrawTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const glm::vec4& color) {
+        auto& batch = Batch(GL_TRIANGLES);
+        batch.push_back({ v0, color });
+        batch.push_back({ v1, color });
+        batch.push_back({ v2, color });
+    }
+
+    void DebugRenderer::DrawAabb(const Aabb& aabb, const glm::vec4& color) {
+        Boxes(false).push_back({ aabb.min, aabb.max, color });
+    }
+
+    void DebugRenderer::DrawAabbWireframe(const Aabb& aabb, const glm::vec4& color) {
+        Boxes(true).push_back({ aabb.min, aabb.max, color });
+    }
+
+    void DebugRenderer::DrawAabbs(ArrayView<Aabb> aabbs, ArrayView<glm::vec4> colors, bool wireframe) {
+        if (colors.size() != 1 && colors.size() != aabbs.size()) {
+            throw std::runtime_error("DrawAabbs: expected one color, or one per box");
+        }
+        auto& boxes = Boxes(wireframe);
+        boxes.reserve(boxes.size() + aabbs.size());
+        for (size_t i = 0; i < aabbs.size(); ++i) {
+            boxes.push_back({ aabbs[i].min, aabbs[i].max, colors[colors.size() == 1 ? 0 : i] });
+        }
+    }
+
+    void DebugRenderer::DrawAabbs(ArrayView<Aabb> aabbs, const std::vector<size_t>& indices, ArrayView<glm::vec4> colors, bool wireframe) {
+        if (colors.size() != 1 && colors.size() != indices.size()) {
+            throw std::runtime_error("DrawAabbs: expected one color, or one per index");
+        }
+        auto& boxes = Boxes(wireframe);
+        boxes.reserve(boxes.size() + indices.size());
+        for (size_t i = 0; i < indices.size(); ++i) {
+            auto const& aabb = aabbs.at(indices[i]);
+            boxes.push_back({ aabb.min, aabb.max, colors[colors.size() == 1 ? 0 : i] });
+        }
+    }
+
+    void DebugRenderer::DrawPlane(const glm::vec3& position, const glm::vec3& normal, float size, const glm::vec4& color) {
+        // Same square as Primitive::SetupPlane, with its normal in white
+        glm::vec3 up(0.0f, 1.0f, 0.0f);
+        glm::vec3 tangent1 = glm::dot(normal, up) > 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::normalize(glm::cross(normal, up));
+        glm::vec3 tangent2 = glm::normalize(glm::cross(normal, tangent1));
+        float     half     = size * 0.5f;
+        glm::vec3 v0       = position + (tangent1 + tangent2) * half;
+        glm::vec3 v1       = position + (-tangent1 + tangent2) * half;
+        glm::vec3 v2       = position - (tangent1 + tangent2) * half;
+        glm::vec3 v3       = position + (tangent1 - tangent2) * half;
+        DrawTriangle(v0, v1, v2, color);
+        DrawTriangle(v0, v2, v3, color);
+        DrawSegment(position, position + normal * size, { 1, 1, 1, 1 });
+    }
+
+    void DebugRenderer::DrawSphere(const glm::vec3& cameraPosition, const glm::vec3& centerPosition, float radius, const glm::vec4& color) {
+        // Same discs as Primitive::SetupSphere: the three axis planes and the silhouette facing the camera
+        std::vector<glm::vec3> xy;
+        std::vector<glm::vec3> xz;
+        std::vector<glm::vec3> yz;
+        Primitive::CreateSphereVertices(xy, xz, yz, centerPosition, radius * 0.9f);
+
+        glm::vec3 camToCenter = centerPosition - cameraPosition;
+        glm::vec3 right       = glm::normalize(glm::cross(camToCenter, glm::vec3(0.0f, 1.0f, 0.0f)));
+        glm::vec3 up          = glm::normalize(glm::cross(right, camToCenter));
+        std::vector<glm::vec3> silhouette;
+        for (int i = 0; i <= 36; ++i) {
+            float theta = static_cast<float>(i) * 2.0f * glm::pi<float>() / 36.0f;
+            silhouette.push_back(centerPosition + radius * (glm::cos(theta) * right + glm::sin(theta) * up));
+        }
+
+        for (auto const* disc : { &xy, &xz, &yz, &silhouette }) {
+            for (size_t i = 1; i < disc->size(); ++i) {
+                DrawSegment((*disc)[i - 1], (*disc)[i], color);
+            }
+        }
+    }
+
+    size_t DebugRenderer::BatchedVertexCount() const {
+        size_t count = 0;
+        for (auto const& batch : mBatches) {
+            count += batch.size();
+        }
+        return count;
+    }
+
+    size_t DebugRenderer::BatchedBoxCount() const {
+        size_t count = 0;
+        for (auto const& boxes : mBoxes) {
+            count += boxes.size();
+        }
+        return count;
+    }
+
+    void DebugRenderer::Render(const glm::mat4& viewProjection) {
+        if (BatchedVertexCount() == 0 && BatchedBoxCount() == 0) {
+            return;
+        }
+        auto firstVertex = StreamBatches(mStreamVBO, mStreamCapacity, mBatches);
+        auto firstBox    = StreamBatches(mInstanceVBO, mInstanceCapacity, mBoxes);
+
+        // State of the caller, restored at the end
+        GLboolean blendEnabled = glIsEnabled(GL_BLEND);
+        GLboolean cullEnabled  = glIsEnabled(GL_CULL_FACE);
+        GLboolean depthMask    = GL_TRUE;
+        GLint     blendSrc     = GL_ONE;
+        GLint     blendDst     = GL_ZERO;
+        glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+        glGetIntegerv(GL_BLEND_SRC_RGB, &blendSrc);
+        glGetIntegerv(GL_BLEND_DST_RGB, &blendDst);
+
+        // Uniforms are set on the program in use, and kept by it
+        mBatchShader.Use();
+        mBatchShader.SetUniform("uniform_mvp", viewProjection);
+        mBoxShader.Use();
+        mBoxShader.SetUniform("uniform_mvp", viewProjection);
+        glDisable(GL_CULL_FACE); // Boxes are seen from inside too
+        for (DebugBlend blend : cBlendOrder) {
+            if (blend == DebugBlend::Opaque) {
+                glDisable(GL_BLEND);
+                glDepthMask(GL_TRUE);
+            } else {
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, blend == DebugBlend::Additive ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+                glDepthMask(GL_FALSE);
+            }
+
+            mBatchShader.Use();
+            glBindVertexArray(mStreamVAO);
+            for (GLenum mode : cBatchModes) {
+                size_t index = BatchIndex(mode, blend);
+                if (!mBatches[index].empty()) {
+                    glDrawArrays(mode, firstVertex[index], static_cast<GLsizei>(mBatches[index].size()));
+                }
+            }
+
+            // Instance attributes start at the batch (no base instance in GL 3.3)
+            mBoxShader.Use();
+            glBindVertexArray(mBoxVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, mInstanceVBO);
+            for (GLenum mode : cBatchModes) {
+                size_t index = BatchIndex(mode, blend);
+                if (mBoxes[index].empty()) {
+                    continue;
+                }
+                size_t base = static_cast<size_t>(firstBox[index]) * sizeof(BoxInstance);
+                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BoxInstance), reinterpret_cast<void*>(base + offsetof(BoxInstance, min)));
+                glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(BoxInstance), reinterpret_cast<void*>(base + offsetof(BoxInstance, max)));
+                glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(BoxInstance), reinterpret_cast<void*>(base + offsetof(BoxInstance, color)));
+                if (mode == GL_LINES) {
+                    glDrawElementsInstanced(GL_LINES, static_cast<GLsizei>(std::size(cAabbEdges)), GL_UNSIGNED_INT,
+                                            reinterpret_cast<void*>(std::size(cAabbTriangles) * sizeof(GLuint)), static_cast<GLsizei>(mBoxes[index].size()));
+                } else {
+                    glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(std::size(cAabbTriangles)), GL_UNSIGNED_INT, (void*)0, static_cast<GLsizei>(mBoxes[index].size()));
+                }
+            }
+        }
+        glBindVertexArray(0);
+        glUseProgram(0);
+
+        if (blendEnabled == GL_FALSE) {
+            glDisable(GL_BLEND);
+        }
+        if (cullEnabled != GL_FALSE) {
+            glEnable(GL_CULL_FACE);
+        }
+        glDepthMask(depthMask);
+        glBlendFunc(static_cast<GLenum>(blendSrc), static_cast<GLenum>(blendDst));
+
+        // Capacity is kept for the next frame
+        for (auto& batch : mBatches) {
+            batch.clear();
+        }
+        for (auto& boxes : mBoxes) {
+            boxes.clear();
+        }
+    }
+
 } // namespace CS350
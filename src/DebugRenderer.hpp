@@ -13,12 +13,25 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream> 
+#include <array>
+#include <vector>
+#include "ArrayView.hpp"
+#include "Camera.hpp"
 #include "Shader.hpp"
 #include "Primitive.hpp"
+#include "Shapes.hpp"
 
 
 namespace CS350 {
 
+    /**
+     * How batched geometry is blended, set with DebugRenderer::SetBlend for the following Draw calls
+     * 	- Opaque:   No blending, writes depth
+     * 	- Alpha:    Alpha blending, depth tested but not written
+     * 	- Additive: Additive blending (overlapping boxes accumulate), depth tested but not written
+     */
+    enum class DebugBlend { Opaque, Alpha, Additive };
+
     class DebugRenderer {
     public:
         DebugRenderer();
@@ -43,12 +56,65 @@ namespace CS350 {
         void DrawFrustumImmediate(const glm::mat4& viewProj, const glm::mat4& frustumVP, const glm::vec4& color) const;
         void DrawFrustumWireframeImmediate(const glm::mat4& viewProj, const glm::mat4& frustumVP, const glm::vec4& color)const;
         void DrawPrimitiveWireframe(const glm::mat4& m2w, const Primitive* primitive, const glm::vec4& color);
+        void DrawPrimitivePartImmediate(const glm::mat4& viewProjection, const Primitive* primitive, GLint first, GLsizei count, const glm::vec4& color, bool wireframe = false); // Triangles, see Primitive::DrawPart
+
+        // Batched drawing: geometry is accumulated on the CPU during the frame and drawn by Render,
+        // one draw call per primitive type and blend mode (colors are per vertex)
+        void SetBlend(DebugBlend blend) { mBlend = blend; }
+        void DrawSegment(const glm::vec3& start, const glm::vec3& end, const glm::vec4& color);
+        void DrawTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const glm::vec4& color);
+        void DrawAabb(const Aabb& aabb, const glm::vec4& color);
+        void DrawAabbWireframe(const Aabb& aabb, const glm::vec4& color);
+        void DrawPlane(const glm::vec3& position, const glm::vec3& normal, float size, const glm::vec4& color);
+        void DrawSphere(const glm::vec3& cameraPosition, const glm::vec3& centerPosition, float radius, const glm::vec4& color);
+        void Render(const glm::mat4& viewProjection); // Draws and clears the batches, GL state is restored
+        void Render(const Camera& camera) { Render(camera.viewProj()); }
+        size_t BatchedVertexCount() const;
+        size_t BatchedBoxCount() const;
+
+        // Batched boxes are instances of a unit cube (DrawAabb and DrawAabbWireframe too): a whole array is a single
+        // draw call per blend mode. Colors are one per box, or a single one for all of them
+        void DrawAabbs(ArrayView<Aabb> aabbs, ArrayView<glm::vec4> colors, bool wireframe = false);
+        void DrawAabbs(ArrayView<Aabb> aabbs, const std::vector<size_t>& indices, ArrayView<glm::vec4> colors, bool wireframe = false); // Boxes aabbs[indices[i]], colors[i]
+
 
        // glm::vec3 intersectPlanePlanePlane(const glm::vec4& plane1, const glm::vec4& plane2, const glm::vec4& plane3);
     private:
+        struct BatchVertex {
+            glm::vec3 position;
+            glm::vec4 color;
+        };
+
+        struct BoxInstance {
+            glm::vec3 min;
+            glm::vec3 max;
+            glm::vec4 color;
+        };
+
         Shader mShader;
         Primitive mPrimitive;
 
+        // Batches: lines and triangles of every blend mode, see BatchIndex
+        DebugBlend                              mBlend = DebugBlend::Opaque;
+        std::array<std::vector<BatchVertex>, 6> mBatches;
+        Shader                                  mBatchShader;        // Per vertex colors
+        GLuint                                  mStreamVAO      = 0;
+        GLuint                                  mStreamVBO      = 0; // Persistent, orphaned every frame
+        size_t                                  mStreamCapacity = 0; // In vertices
+
+        // Box batches: wireframe (GL_LINES) and solid (GL_TRIANGLES) of every blend mode, see BatchIndex
+        std::array<std::vector<BoxInstance>, 6> mBoxes;
+        Shader                                  mBoxShader;
+        GLuint                                  mBoxVAO           = 0;
+        GLuint                                  mCubeVBO          = 0; // Unit cube corners
+        GLuint                                  mCubeEBO          = 0; // Triangles, then edges
+        GLuint                                  mInstanceVBO      = 0; // Persistent, orphaned every frame
+        size_t                                  mInstanceCapacity = 0; // In boxes
+
+        static size_t             BatchIndex(GLenum mode, DebugBlend blend) { return (mode == GL_LINES ? 0 : 1) + 2 * static_cast<size_t>(blend); }
+        std::vector<BatchVertex>& Batch(GLenum mode) { return mBatches[BatchIndex(mode, mBlend)]; }
+        std::vector<BoxInstance>& Boxes(bool wireframe) { return mBoxes[BatchIndex(wireframe ? GL_LINES : GL_TRIANGLES, mBlend)]; }
+
         static void CheckCompileErrors(GLuint shaderID, const std::string& type);
         static void CheckLinkErrors(GLuint programID);
     };
@@ -1,21 +1,492 @@
+#include <array>
 #include <cassert>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <functional>
 #include <glm/gtc/epsilon.hpp>
 #include <iterator>
+#include <numeric>
 #include <sstream>
 #include <algorithm>
 #include <stdexcept>
+#include <type_traits>
 #include <unordered_set>
 #include <vector>
 #include "KdTree.hpp"
+#include "ChromeTrace.hpp"
 #include "Geometry.hpp"
+#include "MappedFile.hpp"
+#include "Quantization.hpp"
+#include "ShapeUtils.hpp"
+#include "Utils.hpp"
 
 namespace {
     float const cEpsilon = 0.001f;
+
+    // Hard limit of the tree depth (also when Config::max_depth is 0), bounds the traversal stack
+    constexpr int cMaxTreeDepth = 64;
+
+    // Only subtrees at least this large get build trace events, smaller ones would flood the trace
+    size_t const cTraceMinTriangles = 1024;
+
+    /**
+     * Recursive SAH builder. Nodes are stored depth first: the left child of a node
+     * is always the next node, the right child is referenced by the node itself.
+     */
+    class Builder {
+      private:
+        using Node = CS350::KdTree::Node;
+
+        std::vector<CS350::Aabb> const& m_tri_bounds;
+        CS350::KdTree::Config const&    m_cfg;
+        std::vector<size_t>&            m_indices;
+        std::vector<Node>&              m_nodes;
+        std::vector<CS350::Aabb>&       m_aabbs;
+
+        struct Split {
+            unsigned axis     = 0;
+            float    position = 0.0f;
+            float    cost     = 0.0f;
+        };
+
+        [[nodiscard]] CS350::Aabb bounds_of(std::vector<size_t> const& triangles) const {
+            CS350::Aabb result = m_tri_bounds[triangles.front()];
+            for (auto idx : triangles) {
+                result.min = glm::min(result.min, m_tri_bounds[idx].min);
+                result.max = glm::max(result.max, m_tri_bounds[idx].max);
+            }
+            return result;
+        }
+
+        /**
+         * Surface area heuristic, candidate planes are the triangle bounds on each axis
+         */
+        [[nodiscard]] bool find_split(std::vector<size_t> const& triangles, CS350::Aabb const& bounds, Split& best) const {
+            float const area = bounds.SurfaceArea();
+            if (area <= 0.0f) {
+                return false;
+            }
+            float const n = static_cast<float>(triangles.size());
+            best.cost     = m_cfg.cost_intersection * n; // Cost of not splitting
+            bool found    = false;
+
+            std::vector<float> mins(triangles.size());
+            std::vector<float> maxs(triangles.size());
+            for (unsigned axis = 0; axis < 3; ++axis) {
+                if (bounds.max[axis] <= bounds.min[axis]) {
+                    continue;
+                }
+                for (size_t i = 0; i < triangles.size(); ++i) {
+                    mins[i] = m_tri_bounds[triangles[i]].min[axis];
+                    maxs[i] = m_tri_bounds[triangles[i]].max[axis];
+                }
+                std::sort(mins.begin(), mins.end());
+                std::sort(maxs.begin(), maxs.end());
+
+                // Sweep both event lists: left count is min < p, right count is max > p
+                size_t i_min = 0;
+                size_t i_max = 0;
+                while (i_min < mins.size() || i_max < maxs.size()) {
+                    float p = i_max == maxs.size() || (i_min < mins.size() && mins[i_min] < maxs[i_max]) ? mins[i_min] : maxs[i_max];
+                    while (i_min < mins.size() && mins[i_min] < p) {
+                        ++i_min;
+                    }
+                    size_t n_left = i_min;
+                    while (i_max < maxs.size() && maxs[i_max] <= p) {
+                        ++i_max;
+                    }
+                    size_t n_right = maxs.size() - i_max;
+                    while (i_min < mins.size() && mins[i_min] <= p) {
+                        ++i_min;
+                    }
+                    if (p <= bounds.min[axis] || p >= bounds.max[axis]) {
+                        continue;
+                    }
+
+                    CS350::Aabb left  = bounds;
+                    CS350::Aabb right = bounds;
+                    left.max[axis]    = p;
+                    right.min[axis]   = p;
+                    float cost        = m_cfg.cost_traversal +
+                                 m_cfg.cost_intersection * (left.SurfaceArea() * static_cast<float>(n_left) + right.SurfaceArea() * static_cast<float>(n_right)) / area;
+                    if (cost < best.cost) {
+                        best  = { axis, p, cost };
+                        found = true;
+                    }
+                }
+            }
+            return found;
+        }
+
+      public:
+        Builder(std::vector<CS350::Aabb> const& tri_bounds, CS350::KdTree::Config const& cfg,
+                std::vector<size_t>& indices, std::vector<Node>& nodes, std::vector<CS350::Aabb>& aabbs)
+        : m_tri_bounds(tri_bounds)
+        , m_cfg(cfg)
+        , m_indices(indices)
+        , m_nodes(nodes)
+        , m_aabbs(aabbs) {}
+
+        void build(std::vector<size_t> const& triangles, int depth) {
+            [[maybe_unused]] bool const traced = triangles.size() >= cTraceMinTriangles;
+            CS350_TRACE_SCOPE_IF(traced, "kdtree", "subtree", "triangles", triangles.size());
+            size_t node_index = m_nodes.size();
+            m_nodes.emplace_back();
+            {
+                CS350_TRACE_SCOPE_IF(traced, "kdtree", "node_bounds");
+                m_aabbs.push_back(bounds_of(triangles));
+            }
+
+            bool  depth_left = (m_cfg.max_depth <= 0 || depth < m_cfg.max_depth) && depth < cMaxTreeDepth;
+            Split split{};
+            bool  found = false;
+            if (depth_left && triangles.size() > 1 && static_cast<int>(triangles.size()) >= m_cfg.min_triangles) {
+                CS350_TRACE_SCOPE_IF(traced, "kdtree", "find_split");
+                found = find_split(triangles, m_aabbs.back(), split);
+            }
+            if (found) {
+                std::vector<size_t> left;
+                std::vector<size_t> right;
+                {
+                    CS350_TRACE_SCOPE_IF(traced, "kdtree", "partition");
+                    for (auto idx : triangles) {
+                        auto const& bv = m_tri_bounds[idx];
+                        if (bv.min[split.axis] < split.position || bv.max[split.axis] <= split.position) {
+                            left.push_back(idx);
+                        }
+                        if (bv.max[split.axis] > split.position) {
+                            right.push_back(idx);
+                        }
+                    }
+                }
+
+                // Only split when both sides make progress
+                if (!left.empty() && !right.empty() && left.size() < triangles.size() && right.size() < triangles.size()) {
+                    build(left, depth + 1);
+                    auto right_index = static_cast<unsigned>(m_nodes.size());
+                    build(right, depth + 1);
+                    m_nodes[node_index].set_internal(split.axis, split.position, right_index);
+                    return;
+                }
+            }
+
+            m_nodes[node_index].set_leaf(static_cast<unsigned>(m_indices.size()), static_cast<unsigned>(triangles.size()));
+            m_indices.insert(m_indices.end(), triangles.begin(), triangles.end());
+        }
+    };
+
+    /**
+     * Closest hit traversal, generic over how leaf triangles are fetched (plain, quantized or indexed)
+     * and over the instrumentation level
+     */
+    template <CS350::Instrumentation Level, typename Triangles>
+    CS350::KdTree::Intersection ClosestHit(CS350::KdTree const& tree, Triangles const& all_triangles, CS350::Ray const& r, [[maybe_unused]] CS350::KdTree::DebugStats* stats) {
+        using namespace CS350;
+        auto const&          nodes   = tree.nodes();
+        auto const&          aabbs   = tree.aabbs();
+        auto const&          indices = tree.indices();
+        KdTree::Intersection closest{ 0, -1.0f };
+        if (nodes.empty()) {
+            return closest;
+        }
+
+        struct Pending {
+            unsigned node;
+            float    t;
+        };
+        std::array<Pending, cMaxTreeDepth + 1> stack{};
+        size_t                                 stack_size = 0;
+        stack[stack_size++]                               = { 0, 0.0f };
+        while (stack_size > 0) {
+            Pending current = stack[--stack_size];
+            if (closest && current.t > closest.t) {
+                continue;
+            }
+#if CS350_INSTRUMENTATION_HOOKS
+            if constexpr (Level == Instrumentation::Trace) {
+                if (stats != nullptr) {
+                    stats->on_node(current.node);
+                }
+            }
+#endif
+
+            KdTree::Node const& node = nodes[current.node];
+            if (node.is_internal()) {
+                Pending left{ current.node + 1, IntersectionTimeRayAabb<Level>(r, aabbs[current.node + 1]) };
+                Pending right{ node.next_child(), IntersectionTimeRayAabb<Level>(r, aabbs[node.next_child()]) };
+                if (left.t >= 0.0f && right.t >= 0.0f && left.t < right.t) {
+                    std::swap(left, right); // Push the furthest first
+                }
+                if (left.t >= 0.0f) {
+                    stack[stack_size++] = left;
+                }
+                if (right.t >= 0.0f) {
+                    stack[stack_size++] = right;
+                }
+                continue;
+            }
+
+            for (unsigned i = node.primitive_start(); i < node.primitive_start() + node.primitive_count(); ++i) {
+                size_t tri_index = indices[i];
+#if CS350_INSTRUMENTATION_HOOKS
+                if constexpr (Level == Instrumentation::Trace) {
+                    if (stats != nullptr) {
+                        stats->on_triangle(tri_index);
+                    }
+                }
+#endif
+                float t = IntersectionTimeRayTriangle<Level>(r, all_triangles[tri_index]);
+                if (t >= 0.0f && (!closest || t < closest.t)) {
+                    closest = { tri_index, t };
+                }
+            }
+        }
+        return closest;
+    }
 }
 
 namespace CS350 {
 
+    void KdTree::Node::set_leaf(unsigned first_primitive_index, unsigned primitive_count) {
+        assert(primitive_count < (1u << 30u));
+        m_first_primitive = first_primitive_index;
+        m_flags           = (primitive_count << 2u) | 3u;
+    }
+
+    void KdTree::Node::set_internal(unsigned axis, float split_point, unsigned subnode_index) {
+        assert(axis < 3 && subnode_index < (1u << 30u));
+        m_split = split_point;
+        m_flags = (subnode_index << 2u) | axis;
+    }
+
+    bool     KdTree::Node::is_leaf() const noexcept { return (m_flags & 3u) == 3u; }
+    bool     KdTree::Node::is_internal() const noexcept { return !is_leaf(); }
+    unsigned KdTree::Node::primitive_count() const noexcept { return m_flags >> 2u; }
+    unsigned KdTree::Node::primitive_start() const noexcept { return m_first_primitive; }
+    unsigned KdTree::Node::next_child() const noexcept { return m_flags >> 2u; }
+    float    KdTree::Node::split() const noexcept { return m_split; }
+    unsigned KdTree::Node::axis() const noexcept { return m_flags & 3u; }
+
+    void KdTree::set_storage(std::shared_ptr<Storage const> storage) {
+        m_indices = ArrayView<size_t>(storage->indices);
+        m_nodes   = ArrayView<Node>(storage->nodes);
+        m_aabbs   = ArrayView<Aabb>(storage->aabbs);
+        m_backing = std::move(storage);
+    }
+
+    /**
+     * @brief
+     *  Builds the tree with the surface area heuristic
+     */
+    void KdTree::build(std::vector<Triangle> const& all_triangles, const Config& cfg) {
+        CS350_TRACE_SCOPE("kdtree", "build", "triangles", all_triangles.size());
+        m_cfg            = cfg;
+        m_triangle_count = all_triangles.size();
+        auto storage = std::make_shared<Storage>();
+        if (!all_triangles.empty()) {
+            std::vector<Aabb> tri_bounds;
+            {
+                CS350_TRACE_SCOPE("kdtree", "triangle_bounds");
+                tri_bounds.reserve(all_triangles.size());
+                for (auto const& tri : all_triangles) {
+                    tri_bounds.push_back(tri.GetBoundingBox());
+                }
+            }
+            std::vector<size_t> root(all_triangles.size());
+            std::iota(root.begin(), root.end(), size_t(0));
+
+            Builder builder(tri_bounds, m_cfg, storage->indices, storage->nodes, storage->aabbs);
+            builder.build(root, 1);
+        }
+        set_storage(std::move(storage));
+    }
+
+    /**
+     * @brief
+     *  Front to back traversal. Child boxes are tested from the parent and visited by entry time,
+     *  subtrees further than the current closest hit are skipped. The root is always entered.
+     */
+    KdTree::Intersection KdTree::get_closest(ArrayView<Triangle> all_triangles, Ray r, DebugStats* stats) const {
+        return get_closest<cDefaultInstrumentation>(all_triangles, r, stats);
+    }
+
+    KdTree::Intersection KdTree::get_closest(Ray r, DebugStats* stats) const {
+        // Indices are only known to be below m_triangle_count (checked when loaded)
+        if (m_triangles.empty() || m_triangles.size() < m_triangle_count) {
+            throw std::runtime_error("KdTree has no stored triangles, pass the triangles it was built from");
+        }
+        return get_closest<cDefaultInstrumentation>(m_triangles, r, stats);
+    }
+
+    KdTree::Intersection KdTree::get_closest(QuantizedTriangles const& all_triangles, Ray r, DebugStats* stats) const {
+        return get_closest<cDefaultInstrumentation>(all_triangles, r, stats);
+    }
+
+    KdTree::Intersection KdTree::get_closest(IndexedTriangles const& all_triangles, Ray r, DebugStats* stats) const {
+        return get_closest<cDefaultInstrumentation>(all_triangles, r, stats);
+    }
+
+    template <Instrumentation Level>
+    KdTree::Intersection KdTree::get_closest(ArrayView<Triangle> all_triangles, Ray r, DebugStats* stats) const {
+        return ClosestHit<Level>(*this, all_triangles, r, stats);
+    }
+
+    template <Instrumentation Level>
+    KdTree::Intersection KdTree::get_closest(QuantizedTriangles const& all_triangles, Ray r, DebugStats* stats) const {
+        return ClosestHit<Level>(*this, all_triangles, r, stats); // Each tested triangle is dequantized on the fly
+    }
+
+    template <Instrumentation Level>
+    KdTree::Intersection KdTree::get_closest(IndexedTriangles const& all_triangles, Ray r, DebugStats* stats) const {
+        return ClosestHit<Level>(*this, all_triangles, r, stats);
+    }
+
+#define CS350_KDTREE_INSTANTIATE_QUERIES(LEVEL)                                                                                             \
+    template KdTree::Intersection KdTree::get_closest<LEVEL>(ArrayView<Triangle>, Ray, DebugStats*) const;                              \
+    template KdTree::Intersection KdTree::get_closest<LEVEL>(QuantizedTriangles const&, Ray, DebugStats*) const;                        \
+    template KdTree::Intersection KdTree::get_closest<LEVEL>(IndexedTriangles const&, Ray, DebugStats*) const;
+    CS350_KDTREE_INSTANTIATE_QUERIES(Instrumentation::None)
+    CS350_KDTREE_INSTANTIATE_QUERIES(Instrumentation::Counters)
+    CS350_KDTREE_INSTANTIATE_QUERIES(Instrumentation::Trace)
+#undef CS350_KDTREE_INSTANTIATE_QUERIES
+
+    /**
+     * @brief
+     *  All the (unique) triangles contained in the subtree of a node
+     */
+    std::vector<size_t> KdTree::get_triangles(size_t node_index) const {
+        std::vector<size_t> result;
+        std::vector<size_t> pending = { node_index };
+        while (!pending.empty()) {
+            Node const& node = m_nodes.at(pending.back());
+            size_t      n    = pending.back();
+            pending.pop_back();
+            if (node.is_internal()) {
+                pending.push_back(n + 1);
+                pending.push_back(node.next_child());
+            } else {
+                result.insert(result.end(), m_indices.begin() + node.primitive_start(), m_indices.begin() + node.primitive_start() + node.primitive_count());
+            }
+        }
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+    std::vector<KdTree::IndexRange> KdTree::index_ranges() const {
+        // Children come after their parent, so they are done first in reverse order
+        std::vector<IndexRange> ranges(m_nodes.size());
+        for (size_t n = m_nodes.size(); n-- > 0;) {
+            Node const& node = m_nodes[n];
+            if (node.is_leaf()) {
+                ranges[n] = { node.primitive_start(), node.primitive_count() };
+                continue;
+            }
+            IndexRange const& left  = ranges[n + 1];
+            IndexRange const& right = ranges[node.next_child()];
+            if (left.first + left.count != right.first) {
+                throw std::runtime_error("KdTree leaves are not stored depth first");
+            }
+            ranges[n] = { left.first, left.count + right.count };
+        }
+        return ranges;
+    }
+
+    int KdTree::height() const {
+        return m_nodes.empty() ? 0 : height(0);
+    }
+
+    int KdTree::height(int node_idx) const {
+        Node const& node = m_nodes.at(size_t(node_idx));
+        if (node.is_leaf()) {
+            return 1;
+        }
+        return 1 + std::max(height(node_idx + 1), height(int(node.next_child())));
+    }
+
+    KdTree::QualityReport KdTree::quality_report() const {
+        QualityReport report;
+        report.node_count      = m_nodes.size();
+        report.reference_count = m_indices.size();
+        report.node_bytes      = m_nodes.size() * sizeof(Node);
+        report.aabb_bytes      = m_aabbs.size() * sizeof(Aabb);
+        report.index_bytes     = m_indices.size() * sizeof(size_t);
+        report.triangle_bytes  = m_triangles.size() * sizeof(Triangle);
+        if (m_nodes.empty()) {
+            return report;
+        }
+
+        float const root_area = m_aabbs[0].SurfaceArea();
+        std::vector<std::pair<size_t, int>> pending = { { 0, 0 } }; // Node, depth
+        while (!pending.empty()) {
+            auto [n, depth] = pending.back();
+            pending.pop_back();
+            Node const& node = m_nodes[n];
+            float       area = root_area > 0.0f ? m_aabbs[n].SurfaceArea() / root_area : 1.0f;
+            if (node.is_internal()) {
+                report.sah_cost += area * m_cfg.cost_traversal;
+                pending.push_back({ n + 1, depth + 1 });
+                pending.push_back({ node.next_child(), depth + 1 });
+                continue;
+            }
+
+            unsigned count = node.primitive_count();
+            report.sah_cost += area * m_cfg.cost_intersection * float(count);
+            report.max_depth = std::max(report.max_depth, depth);
+            ++report.leaf_count;
+            report.empty_leaf_count += count == 0 ? 1 : 0;
+
+            size_t bucket = 0;
+            while ((size_t(1) << bucket) <= count) {
+                ++bucket;
+            }
+            report.leaf_size_histogram.resize(std::max(report.leaf_size_histogram.size(), bucket + 1));
+            ++report.leaf_size_histogram[bucket];
+            report.depth_histogram.resize(std::max(report.depth_histogram.size(), size_t(depth) + 1));
+            ++report.depth_histogram[size_t(depth)];
+        }
+
+        std::vector<bool> referenced;
+        for (size_t index : m_indices) {
+            if (index >= referenced.size()) {
+                referenced.resize(index + 1);
+            }
+            report.triangle_count += referenced[index] ? 0 : 1;
+            referenced[index] = true;
+        }
+        report.duplication_factor = report.triangle_count > 0 ? float(report.reference_count) / float(report.triangle_count) : 0.0f;
+        report.average_leaf_size  = float(report.reference_count) / float(report.leaf_count);
+        return report;
+    }
+
+    std::string KdTree::QualityReport::to_json() const {
+        auto list = [](std::vector<size_t> const& values) {
+            std::string result;
+            for (size_t i = 0; i < values.size(); ++i) {
+                result += fmt::format("{}{}", i == 0 ? "" : ", ", values[i]);
+            }
+            return "[" + result + "]";
+        };
+        std::ostringstream os;
+        os << "{\n"
+           << fmt::format("  \"sah_cost\": {},\n", sah_cost)
+           << fmt::format("  \"node_count\": {},\n", node_count)
+           << fmt::format("  \"leaf_count\": {},\n", leaf_count)
+           << fmt::format("  \"empty_leaf_count\": {},\n", empty_leaf_count)
+           << fmt::format("  \"triangle_count\": {},\n", triangle_count)
+           << fmt::format("  \"reference_count\": {},\n", reference_count)
+           << fmt::format("  \"duplication_factor\": {},\n", duplication_factor)
+           << fmt::format("  \"max_depth\": {},\n", max_depth)
+           << fmt::format("  \"average_leaf_size\": {},\n", average_leaf_size)
+           << fmt::format("  \"leaf_size_histogram\": {},\n", list(leaf_size_histogram))
+           << fmt::format("  \"depth_histogram\": {},\n", list(depth_histogram))
+           << fmt::format("  \"memory_bytes\": {{ \"nodes\": {}, \"aabbs\": {}, \"indices\": {}, \"triangles\": {}, \"total\": {} }}\n",
+                          node_bytes, aabb_bytes, index_bytes, triangle_bytes, total_bytes())
+           << "}\n";
+        return os.str();
+    }
+
 
     /**
      *
@@ -98,4 +569,255 @@ namespace CS350 {
         os << "}";
         return os;
     }
+
+    /**
+     * KdTree file format (version 3). Little endian, written and mapped as is.
+     *
+     * 	- A 128 byte header (FileHeader): signature "CS350KDT", version, endianness tag, hash of the source mesh,
+     * 	  element sizes, the Config used to build the tree, [count, offset] of each array and the triangle count of the source mesh.
+     * 	- Four arrays follow: nodes, aabbs, indices and triangles (triangle_count may be 0). Each one starts at a
+     * 	  multiple of 64 bytes from the start of the file, so that they can be used in place from a mapping.
+     *
+     * 	- Visual guide of file contents:
+     * 		[header][pad][Node * node_count][pad][Aabb * aabb_count][pad][size_t * index_count][pad][Triangle * triangle_count]
+     */
+    namespace {
+        constexpr std::array<char, 8> cFileSignature    = { 'C', 'S', '3', '5', '0', 'K', 'D', 'T' };
+        constexpr std::uint32_t       cFileVersion      = 3;
+        constexpr std::uint32_t       cEndianTag        = 0x01020304;
+        constexpr std::uint64_t       cSectionAlignment = 64;
+
+        struct FileHeader {
+            std::array<char, 8> signature;
+            std::uint32_t       version;
+            std::uint32_t       endian_tag;
+            std::uint64_t       source_hash;
+            std::uint32_t       node_size;
+            std::uint32_t       aabb_size;
+            std::uint32_t       index_size;
+            std::uint32_t       reserved;
+            float               cost_traversal;
+            float               cost_intersection;
+            std::int32_t        max_depth;
+            std::int32_t        min_triangles;
+            std::uint64_t       node_count;
+            std::uint64_t       node_offset;
+            std::uint64_t       aabb_count;
+            std::uint64_t       aabb_offset;
+            std::uint64_t       index_count;
+            std::uint64_t       index_offset;
+            std::uint64_t       triangle_count;
+            std::uint64_t       triangle_offset;
+            std::uint64_t       source_triangle_count; // Indices are below it
+        };
+        static_assert(sizeof(FileHeader) == 128, "Unexpected padding in the file header");
+        static_assert(std::is_trivially_copyable_v<KdTree::Node>, "Nodes are written and mapped as raw memory");
+        static_assert(std::is_trivially_copyable_v<Aabb>, "Aabbs are written and mapped as raw memory");
+        static_assert(sizeof(Triangle) == sizeof(float) * 9, "Triangles are hashed, written and mapped as raw memory");
+
+        bool IsLittleEndian() {
+            std::uint32_t value = cEndianTag;
+            unsigned char first = 0;
+            std::memcpy(&first, &value, 1);
+            return first == 0x04;
+        }
+
+        std::uint64_t AlignUp(std::uint64_t offset) {
+            return (offset + cSectionAlignment - 1) / cSectionAlignment * cSectionAlignment;
+        }
+
+        bool SameConfig(KdTree::Config const& a, KdTree::Config const& b) {
+            return a.cost_traversal == b.cost_traversal && a.cost_intersection == b.cost_intersection &&
+                   a.max_depth == b.max_depth && a.min_triangles == b.min_triangles;
+        }
+
+        /**
+         * Node contents of a mapped file are used by the traversal without checks: a corrupted file must not
+         * read out of bounds nor overflow the traversal stack. One pass over the nodes and the indices
+         * 	- Children are inside the array, after their parent (nodes are stored depth first, no cycles)
+         * 	- Every node is reached once, at most cMaxTreeDepth levels deep
+         * 	- Leaf ranges are inside the indices, indices are below the triangle count of the source mesh
+         */
+        void ValidateTree(std::string const& path, ArrayView<KdTree::Node> nodes, ArrayView<size_t> indices, std::uint64_t triangle_count) {
+            auto invalid = [&](char const* reason) {
+                return std::runtime_error(fmt::format("Invalid kdtree file {}: {}", path, reason));
+            };
+            for (size_t index : indices) {
+                if (index >= triangle_count) {
+                    throw invalid("triangle index out of range");
+                }
+            }
+            if (nodes.empty()) {
+                return;
+            }
+
+            struct Pending {
+                size_t node;
+                int    depth;
+            };
+            std::vector<Pending> pending = { { 0, 1 } };
+            size_t               reached = 0;
+            while (!pending.empty()) {
+                auto [n, depth] = pending.back();
+                pending.pop_back();
+                if (++reached > nodes.size()) {
+                    throw invalid("nodes are reached more than once");
+                }
+                if (depth > cMaxTreeDepth) {
+                    throw invalid("tree is too deep");
+                }
+                auto const& node = nodes[n];
+                if (node.is_leaf()) {
+                    if (std::uint64_t(node.primitive_start()) + node.primitive_count() > indices.size()) {
+                        throw invalid("leaf range out of the indices");
+                    }
+                    continue;
+                }
+                if (n + 1 >= nodes.size() || node.next_child() <= n + 1 || node.next_child() >= nodes.size()) {
+                    throw invalid("child index out of range");
+                }
+                pending.push_back({ n + 1, depth + 1 });
+                pending.push_back({ node.next_child(), depth + 1 });
+            }
+            if (reached != nodes.size()) {
+                throw invalid("unreachable nodes");
+            }
+        }
+    }
+
+    std::uint64_t KdTree::content_hash(std::vector<Triangle> const& all_triangles) {
+        return HashBytes(all_triangles.data(), all_triangles.size() * sizeof(Triangle));
+    }
+
+    void KdTree::save(std::string const& path, std::uint64_t source_hash, ArrayView<Triangle> triangles) const {
+        if (!IsLittleEndian()) {
+            throw std::runtime_error("KdTree files can only be written on little endian hosts");
+        }
+
+        FileHeader header{};
+        header.signature             = cFileSignature;
+        header.version               = cFileVersion;
+        header.endian_tag            = cEndianTag;
+        header.source_hash           = source_hash;
+        header.node_size             = sizeof(Node);
+        header.aabb_size             = sizeof(Aabb);
+        header.index_size            = sizeof(size_t);
+        header.cost_traversal        = m_cfg.cost_traversal;
+        header.cost_intersection     = m_cfg.cost_intersection;
+        header.max_depth             = m_cfg.max_depth;
+        header.min_triangles         = m_cfg.min_triangles;
+        header.node_count            = m_nodes.size();
+        header.node_offset           = AlignUp(sizeof(FileHeader));
+        header.aabb_count            = m_aabbs.size();
+        header.aabb_offset           = AlignUp(header.node_offset + header.node_count * sizeof(Node));
+        header.index_count           = m_indices.size();
+        header.index_offset          = AlignUp(header.aabb_offset + header.aabb_count * sizeof(Aabb));
+        header.triangle_count        = triangles.size();
+        header.triangle_offset       = AlignUp(header.index_offset + header.index_count * sizeof(size_t));
+        header.source_triangle_count = m_triangle_count;
+
+        // Written aside and renamed, readers never map a half written file. The temporary name is unique,
+        // processes writing the same cache entry do not write into each other's file (the last rename wins)
+        std::string   tmp_path = UniqueTempPath(path);
+        std::ofstream os(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!os) {
+            throw std::runtime_error(fmt::format("Could not open file {}", tmp_path));
+        }
+        auto write_at = [&](std::uint64_t offset, void const* data, std::uint64_t size) {
+            std::array<char, cSectionAlignment> padding{};
+            os.write(padding.data(), static_cast<std::streamsize>(offset - static_cast<std::uint64_t>(os.tellp())));
+            os.write(static_cast<char const*>(data), static_cast<std::streamsize>(size));
+        };
+        write_at(0, &header, sizeof(header));
+        write_at(header.node_offset, m_nodes.data(), header.node_count * sizeof(Node));
+        write_at(header.aabb_offset, m_aabbs.data(), header.aabb_count * sizeof(Aabb));
+        write_at(header.index_offset, m_indices.data(), header.index_count * sizeof(size_t));
+        write_at(header.triangle_offset, triangles.data(), header.triangle_count * sizeof(Triangle));
+        os.close();
+        if (!os) {
+            std::error_code ignored;
+            std::filesystem::remove(tmp_path, ignored);
+            throw std::runtime_error(fmt::format("Could not write file {}", tmp_path));
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, path, ec);
+        if (ec) {
+            std::error_code ignored;
+            std::filesystem::remove(tmp_path, ignored);
+            throw std::runtime_error(fmt::format("Could not replace file {}: {}", path, ec.message()));
+        }
+    }
+
+    KdTree KdTree::load_mmap(std::string const& path, std::uint64_t source_hash) {
+        auto file = std::make_shared<MappedFile>(path);
+        if (file->size() < sizeof(FileHeader)) {
+            throw std::runtime_error(fmt::format("Invalid kdtree file {}: truncated header", path));
+        }
+        FileHeader header{};
+        std::memcpy(&header, file->data(), sizeof(header));
+        if (header.signature != cFileSignature) {
+            throw std::runtime_error(fmt::format("Invalid file signature in file: {}", path));
+        }
+        if (header.version != cFileVersion || header.endian_tag != cEndianTag) {
+            throw std::runtime_error(fmt::format("Unsupported kdtree file {} (version {})", path, header.version));
+        }
+        if (header.node_size != sizeof(Node) || header.aabb_size != sizeof(Aabb) || header.index_size != sizeof(size_t)) {
+            throw std::runtime_error(fmt::format("Incompatible kdtree file {}: element sizes differ", path));
+        }
+        if (header.source_hash != source_hash) {
+            throw std::runtime_error(fmt::format("Kdtree file {} was built from a different mesh", path));
+        }
+        if (header.node_count != header.aabb_count) {
+            throw std::runtime_error(fmt::format("Invalid kdtree file {}: node/aabb count mismatch", path));
+        }
+        if (header.triangle_count != 0 && header.triangle_count != header.source_triangle_count) {
+            throw std::runtime_error(fmt::format("Invalid kdtree file {}: stored triangles are not the source mesh", path));
+        }
+
+        // Array bounds, then contents (ValidateTree)
+        auto section = [&](std::uint64_t offset, std::uint64_t count, std::uint64_t element_size) {
+            if (offset % cSectionAlignment != 0 || offset > file->size() || count > (file->size() - offset) / element_size) {
+                throw std::runtime_error(fmt::format("Invalid kdtree file {}: array out of bounds", path));
+            }
+            return file->data() + offset;
+        };
+
+        KdTree tree;
+        tree.m_cfg.cost_traversal    = header.cost_traversal;
+        tree.m_cfg.cost_intersection = header.cost_intersection;
+        tree.m_cfg.max_depth         = header.max_depth;
+        tree.m_cfg.min_triangles     = header.min_triangles;
+        tree.m_nodes                 = ArrayView<Node>(reinterpret_cast<Node const*>(section(header.node_offset, header.node_count, sizeof(Node))), header.node_count);
+        tree.m_aabbs                 = ArrayView<Aabb>(reinterpret_cast<Aabb const*>(section(header.aabb_offset, header.aabb_count, sizeof(Aabb))), header.aabb_count);
+        tree.m_indices               = ArrayView<size_t>(reinterpret_cast<size_t const*>(section(header.index_offset, header.index_count, sizeof(size_t))), header.index_count);
+        tree.m_triangles             = ArrayView<Triangle>(reinterpret_cast<Triangle const*>(section(header.triangle_offset, header.triangle_count, sizeof(Triangle))), header.triangle_count);
+        tree.m_triangle_count        = header.source_triangle_count;
+        ValidateTree(path, tree.m_nodes, tree.m_indices, header.source_triangle_count);
+        tree.m_backing = std::move(file);
+        return tree;
+    }
+
+    KdTree KdTree::load_or_build(std::string const& cache_folder, std::vector<Triangle> const& all_triangles, const Config& cfg) {
+        std::uint64_t source_hash = content_hash(all_triangles);
+        std::uint64_t key         = HashBytes(&cfg, sizeof(cfg), source_hash);
+        auto          path        = (std::filesystem::path(cache_folder) / fmt::format("{:016x}.kdtree", key)).string();
+
+        if (std::filesystem::exists(path)) {
+            try {
+                // The key only hashes the configuration, the header holds the one the entry was built with
+                KdTree cached = load_mmap(path, source_hash);
+                if (SameConfig(cached.config(), cfg)) {
+                    return cached;
+                }
+            } catch (std::exception const& /* ex */) {
+                // Stale or corrupted entry, rebuild it
+            }
+        }
+
+        KdTree tree;
+        tree.build(all_triangles, cfg);
+        std::filesystem::create_directories(cache_folder);
+        tree.save(path, source_hash);
+        return tree;
+    }
 }
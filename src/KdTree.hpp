@@ -1,11 +1,19 @@
 #ifndef KDTREE_HPP
 #define KDTREE_HPP
 
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 #include <iostream>
+#include "ArrayView.hpp"
 #include "Shapes.hpp"
+#include "Stats.hpp"
+#include "TraceSink.hpp"
 
 namespace CS350 {
+    class QuantizedTriangles;
+
     /**
      * Basic KDTree
      */
@@ -27,6 +35,22 @@ namespace CS350 {
         struct DebugStats {
             std::vector<size_t> traversed_nodes;  // Node indices
             std::vector<size_t> tested_triangles; // Triangle indices
+            TraceSink*          sink = nullptr;   // When set, events go to the sink instead (no allocations)
+
+            void on_node(size_t node_index) {
+                if (sink != nullptr) {
+                    sink->record(TraceSink::Kind::Node, node_index);
+                } else {
+                    traversed_nodes.push_back(node_index);
+                }
+            }
+            void on_triangle(size_t triangle_index) {
+                if (sink != nullptr) {
+                    sink->record(TraceSink::Kind::Triangle, triangle_index);
+                } else {
+                    tested_triangles.push_back(triangle_index);
+                }
+            }
         };
 
         /**
@@ -48,6 +72,11 @@ namespace CS350 {
          */
         struct Node {
           private:
+            union {
+                float    m_split;           // Internal: split position along axis
+                unsigned m_first_primitive; // Leaf: first entry in the indices array
+            };
+            unsigned m_flags; // 2 lower bits: axis (3 means leaf). Upper bits: next child (internal) or primitive count (leaf)
 
           public:
             void set_leaf(unsigned first_primitive_index, unsigned primitive_count);
@@ -63,18 +92,96 @@ namespace CS350 {
             [[nodiscard]] unsigned axis() const noexcept;
         };
 
+        /**
+         * Entries of indices() referenced by a node and all its descendants
+         */
+        struct IndexRange {
+            unsigned first = 0;
+            unsigned count = 0;
+        };
+
+        /**
+         * Build quality, independent of any ray workload
+         * 	- sah_cost: expected cost of a ray through the root box, sum of SA(node)/SA(root) * (cost_traversal or cost_intersection * triangles)
+         * 	- leaf_size_histogram[0]: empty leaves, [k]: leaves with [2^(k-1), 2^k) triangles
+         * 	- depth_histogram[d]: leaves at depth d (root is 0)
+         * 	- duplication_factor: triangle references per referenced triangle (1 means no straddling triangle was duplicated)
+         */
+        struct QualityReport {
+            float               sah_cost           = 0.0f;
+            size_t              node_count         = 0;
+            size_t              leaf_count         = 0;
+            size_t              empty_leaf_count   = 0;
+            size_t              triangle_count     = 0; // Distinct referenced triangles
+            size_t              reference_count    = 0; // Entries in the indices array
+            float               duplication_factor = 0.0f;
+            int                 max_depth          = 0;
+            float               average_leaf_size  = 0.0f;
+            std::vector<size_t> leaf_size_histogram;
+            std::vector<size_t> depth_histogram;
+            size_t              node_bytes     = 0;
+            size_t              aabb_bytes     = 0;
+            size_t              index_bytes    = 0;
+            size_t              triangle_bytes = 0; // Stored triangles (trees loaded from self contained files)
+
+            [[nodiscard]] size_t      total_bytes() const { return node_bytes + aabb_bytes + index_bytes + triangle_bytes; }
+            [[nodiscard]] std::string to_json() const;
+        };
+
       private:
-        std::vector<size_t> m_indices;              // All recorded triangles (may contain duplicates)
-        std::vector<Node>   m_nodes;                // KDTree nodes
-        std::vector<Aabb>   m_aabbs;                // AABBs of nodes (same order)
-        Config              m_cfg;                  // Configuration
+        /**
+         * Owned tree arrays, immutable once built (shared between copies of the tree)
+         */
+        struct Storage {
+            std::vector<size_t> indices;
+            std::vector<Node>   nodes;
+            std::vector<Aabb>   aabbs;
+        };
+
+        ArrayView<size_t>           m_indices; // All recorded triangles (may contain duplicates)
+        ArrayView<Node>             m_nodes;   // KDTree nodes
+        ArrayView<Aabb>             m_aabbs;     // AABBs of nodes (same order)
+        ArrayView<Triangle>         m_triangles; // Source triangles, only when loaded from a file that stores them
+        size_t                      m_triangle_count = 0; // Of the source mesh, every index is below it
+        Config                      m_cfg;       // Configuration
+        std::shared_ptr<void const> m_backing;   // Keeps the viewed arrays alive (Storage or mapped file)
       public:
         void                       build(std::vector<Triangle> const& all_triangles, const Config& cfg);
-        [[nodiscard]] Intersection get_closest(std::vector<Triangle> const& all_triangles, Ray r, DebugStats* stats) const;
+        [[nodiscard]] Intersection get_closest(ArrayView<Triangle> all_triangles, Ray r, DebugStats* stats) const;
+        [[nodiscard]] Intersection get_closest(QuantizedTriangles const& all_triangles, Ray r, DebugStats* stats) const;
+        [[nodiscard]] Intersection get_closest(IndexedTriangles const& all_triangles, Ray r, DebugStats* stats) const;
+        [[nodiscard]] Intersection get_closest(Ray r, DebugStats* stats) const; // Stored triangles, throws if the tree has none (built trees, files saved without them)
+
+        /**
+         * Queries with an explicit instrumentation level, the overloads above use cDefaultInstrumentation.
+         * stats is only filled at Instrumentation::Trace
+         */
+        template <Instrumentation Level>
+        [[nodiscard]] Intersection get_closest(ArrayView<Triangle> all_triangles, Ray r, DebugStats* stats) const;
+        template <Instrumentation Level>
+        [[nodiscard]] Intersection get_closest(QuantizedTriangles const& all_triangles, Ray r, DebugStats* stats) const;
+        template <Instrumentation Level>
+        [[nodiscard]] Intersection get_closest(IndexedTriangles const& all_triangles, Ray r, DebugStats* stats) const;
+
+        /**
+         * Serialization. See KdTree.cpp for the file layout.
+         *  - save:          Writes the tree, tagged with the hash of the mesh it was built from.
+         *                   Optionally stores the triangles too, so the file is self contained
+         *  - load_mmap:     Maps a saved tree, nodes/indices/aabbs(/triangles) are used in place (no parsing, no copies).
+         *                   Throws if the file is invalid (header, array bounds and node contents are checked in one pass)
+         *                   or was built from a different mesh
+         *  - load_or_build: Cache keyed by mesh content and configuration, builds and saves on a miss
+         */
+        void                               save(std::string const& path, std::uint64_t source_hash, ArrayView<Triangle> triangles = {}) const;
+        [[nodiscard]] static KdTree        load_mmap(std::string const& path, std::uint64_t source_hash);
+        [[nodiscard]] static KdTree        load_or_build(std::string const& cache_folder, std::vector<Triangle> const& all_triangles, const Config& cfg);
+        [[nodiscard]] static std::uint64_t content_hash(std::vector<Triangle> const& all_triangles);
+        [[nodiscard]] const Config&        config() const noexcept { return m_cfg; }
 
         [[nodiscard]] const decltype(m_nodes)&   nodes() const noexcept { return m_nodes; }
         [[nodiscard]] const decltype(m_indices)& indices() const noexcept { return m_indices; }
         [[nodiscard]] const decltype(m_aabbs)&   aabbs() const noexcept { return m_aabbs; }
+        [[nodiscard]] const decltype(m_triangles)& triangles() const noexcept { return m_triangles; }
         [[nodiscard]] bool                       empty() const { return m_indices.empty(); }
 
         /**
@@ -83,11 +190,13 @@ namespace CS350 {
         std::ostream&                     dump(std::ostream&) const;
         std::ostream&                     dump_graph(std::ostream&) const;
         [[nodiscard]] std::vector<size_t> get_triangles(size_t node_index) const; // Debug
+        [[nodiscard]] std::vector<IndexRange> index_ranges() const; // Of every node: leaves are stored depth first, so subtrees are contiguous
         [[nodiscard]] int                 height() const;
         [[nodiscard]] int                 height(int node_idx) const;
+        [[nodiscard]] QualityReport       quality_report() const;
 
       private:
-        
+        void set_storage(std::shared_ptr<Storage const> storage);
     };
 }
 #endif // KDTREE_HPP
@@ -0,0 +1,257 @@
+#include "LatencyHistogram.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fmt/format.h>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CS350_HAS_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CS350_HAS_RDTSC 1
+#else
+#define CS350_HAS_RDTSC 0
+#endif
+
+namespace CS350 {
+    namespace {
+        using namespace std::chrono_literals;
+
+        unsigned const cMinPrecisionBits = 2;
+        unsigned const cMaxPrecisionBits = 20;
+
+        unsigned HighestBit(uint64_t value) noexcept
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            return 63u - unsigned(__builtin_clzll(value));
+#else
+            unsigned bit = 0;
+            while (value >>= 1) {
+                ++bit;
+            }
+            return bit;
+#endif
+        }
+
+        double CalibrateTicks()
+        {
+#if CS350_HAS_RDTSC
+            // Spins rather than sleeps, so the core does not change frequency state in between
+            auto const     start       = std::chrono::steady_clock::now();
+            uint64_t const start_ticks = CycleClock::Now();
+            auto           end         = start;
+            while (end - start < 10ms) {
+                end = std::chrono::steady_clock::now();
+            }
+            uint64_t const ticks = CycleClock::Now() - start_ticks;
+            return ticks != 0 ? std::chrono::duration<double, std::nano>(end - start).count() / double(ticks) : 1.0;
+#else
+            return 1.0;
+#endif
+        }
+
+        void WriteSummary(std::ostream& os, char const* name, Histogram const& histogram)
+        {
+            os << fmt::format("{:<17} count {:>8}, mean {:>10.1f}, p50 {:>8}, p90 {:>8}, p99 {:>8}, p99.9 {:>8}, max {:>8}\n",
+                              name, histogram.count(), histogram.mean(), histogram.percentile(0.5), histogram.percentile(0.9),
+                              histogram.percentile(0.99), histogram.percentile(0.999), histogram.max());
+        }
+
+        void TraceCounter(void* user, TraceSink::Event event)
+        {
+            auto* counts = static_cast<uint64_t*>(user);
+            ++counts[event.kind == TraceSink::Kind::Node ? 0 : 1];
+        }
+    }
+
+    uint64_t CycleClock::Now() noexcept
+    {
+#if CS350_HAS_RDTSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    double CycleClock::NanosecondsPerTick()
+    {
+        static double const cFactor = CalibrateTicks();
+        return cFactor;
+    }
+
+    Histogram::Histogram(unsigned precision_bits)
+        : m_precision_bits(precision_bits)
+    {
+        if (precision_bits < cMinPrecisionBits || precision_bits > cMaxPrecisionBits) {
+            throw std::runtime_error(fmt::format("Histogram precision should be between {} and {} bits, got {}", cMinPrecisionBits, cMaxPrecisionBits, precision_bits));
+        }
+        // Exact values [0, 2^bits), then 2^(bits-1) sub buckets for every remaining power of two
+        size_t const half = size_t(1) << (precision_bits - 1);
+        m_counts.resize((64 - precision_bits) * half + 2 * half);
+    }
+
+    size_t Histogram::index_of(uint64_t value) const noexcept
+    {
+        size_t const exact = size_t(1) << m_precision_bits;
+        if (value < exact) {
+            return size_t(value);
+        }
+        unsigned const shift = HighestBit(value) - m_precision_bits + 1;
+        return shift * (exact / 2) + size_t(value >> shift);
+    }
+
+    uint64_t Histogram::lowest_of(size_t index) const noexcept
+    {
+        size_t const exact = size_t(1) << m_precision_bits;
+        if (index < exact) {
+            return index;
+        }
+        size_t const shift = index / (exact / 2) - 1;
+        return uint64_t(index - shift * (exact / 2)) << shift;
+    }
+
+    uint64_t Histogram::highest_of(size_t index) const noexcept
+    {
+        size_t const exact = size_t(1) << m_precision_bits;
+        if (index < exact) {
+            return index;
+        }
+        size_t const shift = index / (exact / 2) - 1;
+        return (uint64_t(index - shift * (exact / 2) + 1) << shift) - 1; // Wraps to UINT64_MAX for the last bucket
+    }
+
+    void Histogram::record(uint64_t value, uint64_t count) noexcept
+    {
+        if (count == 0) {
+            return;
+        }
+        m_counts[index_of(value)] += count;
+        m_count += count;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+        m_sum += double(value) * double(count);
+    }
+
+    void Histogram::merge(Histogram const& other)
+    {
+        if (other.m_precision_bits != m_precision_bits) {
+            throw std::runtime_error(fmt::format("Cannot merge histograms of {} and {} bits of precision", m_precision_bits, other.m_precision_bits));
+        }
+        for (size_t i = 0; i < m_counts.size(); ++i) {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_count += other.m_count;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+        m_sum += other.m_sum;
+    }
+
+    void Histogram::reset() noexcept
+    {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_count = 0;
+        m_min   = UINT64_MAX;
+        m_max   = 0;
+        m_sum   = 0.0;
+    }
+
+    uint64_t Histogram::percentile(double fraction) const noexcept
+    {
+        if (m_count == 0) {
+            return 0;
+        }
+        auto const rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::clamp(fraction, 0.0, 1.0) * double(m_count))));
+        uint64_t   seen = 0;
+        for (size_t i = 0; i < m_counts.size(); ++i) {
+            seen += m_counts[i];
+            if (seen >= rank) {
+                return std::clamp(highest_of(i), m_min, m_max);
+            }
+        }
+        return m_max;
+    }
+
+    std::vector<Histogram::Bucket> Histogram::buckets() const
+    {
+        std::vector<Bucket> result;
+        for (size_t i = 0; i < m_counts.size(); ++i) {
+            if (m_counts[i] != 0) {
+                result.push_back({ lowest_of(i), highest_of(i), m_counts[i] });
+            }
+        }
+        return result;
+    }
+
+    std::string Histogram::to_json() const
+    {
+        std::ostringstream os;
+        os << fmt::format("{{ \"count\": {}, \"min\": {}, \"max\": {}, \"mean\": {:.3f}, ", m_count, min(), m_max, mean())
+           << fmt::format("\"p50\": {}, \"p90\": {}, \"p99\": {}, \"p999\": {}, ", percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999))
+           << "\"buckets\": [";
+        auto const all = buckets();
+        for (size_t i = 0; i < all.size(); ++i) {
+            os << fmt::format("{}[{}, {}, {}]", i == 0 ? "" : ", ", all[i].lowest, all[i].highest, all[i].count);
+        }
+        os << "] }";
+        return os.str();
+    }
+
+    void QueryHistograms::merge(QueryHistograms const& other)
+    {
+        latency_ns.merge(other.latency_ns);
+        nodes_visited.merge(other.nodes_visited);
+        triangles_tested.merge(other.triangles_tested);
+    }
+
+    void QueryHistograms::reset()
+    {
+        latency_ns.reset();
+        nodes_visited.reset();
+        triangles_tested.reset();
+    }
+
+    std::string QueryHistograms::to_json() const
+    {
+        std::ostringstream os;
+        os << "{\n"
+           << "  \"latency_ns\": " << latency_ns.to_json() << ",\n"
+           << "  \"nodes_visited\": " << nodes_visited.to_json() << ",\n"
+           << "  \"triangles_tested\": " << triangles_tested.to_json() << "\n"
+           << "}\n";
+        return os.str();
+    }
+
+    std::ostream& operator<<(std::ostream& os, QueryHistograms const& histograms)
+    {
+        WriteSummary(os, "latency (ns)", histograms.latency_ns);
+        WriteSummary(os, "nodes visited", histograms.nodes_visited);
+        WriteSummary(os, "triangles tested", histograms.triangles_tested);
+        return os;
+    }
+
+    KdTree::Intersection QueryProfiler::get_closest(KdTree const& tree, ArrayView<Triangle> triangles, Ray const& ray)
+    {
+        if (!m_count_work) {
+            uint64_t const start = CycleClock::Now();
+            auto           hit   = tree.get_closest<Instrumentation::None>(triangles, ray, nullptr);
+            m_histograms.latency_ns.record(CycleClock::ToNanoseconds(CycleClock::Now() - start));
+            return hit;
+        }
+
+        uint64_t           counts[2] = {}; // Nodes, triangles
+        TraceSink          sink(TraceCounter, counts);
+        KdTree::DebugStats stats;
+        stats.sink = &sink;
+
+        uint64_t const start = CycleClock::Now();
+        auto           hit   = tree.get_closest<Instrumentation::Trace>(triangles, ray, &stats);
+        m_histograms.latency_ns.record(CycleClock::ToNanoseconds(CycleClock::Now() - start));
+        m_histograms.nodes_visited.record(counts[0]);
+        m_histograms.triangles_tested.record(counts[1]);
+        return hit;
+    }
+}
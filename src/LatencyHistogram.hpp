@@ -0,0 +1,113 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ArrayView.hpp"
+#include "KdTree.hpp"
+#include "Shapes.hpp"
+
+namespace CS350 {
+    /**
+     * Cheap timestamps for timing single queries.
+     * 	- x86: the time stamp counter (rdtsc), converted with a factor calibrated once against steady_clock (~10ms, on first use)
+     * 	- Elsewhere: steady_clock nanoseconds (one tick is one nanosecond)
+     * Assumes an invariant TSC (every x86 CPU of the last decade), ticks of different cores are then comparable.
+     */
+    class CycleClock {
+      public:
+        [[nodiscard]] static uint64_t Now() noexcept;
+        [[nodiscard]] static double   NanosecondsPerTick();
+        [[nodiscard]] static uint64_t ToNanoseconds(uint64_t ticks) { return static_cast<uint64_t>(double(ticks) * NanosecondsPerTick() + 0.5); }
+    };
+
+    /**
+     * HDR-style histogram of non negative integers (latencies in nanoseconds, node counts, ...).
+     * 	- Values below 2^precision_bits are exact, larger ones share a bucket with values within 2^-(precision_bits - 1) of them
+     * 	- Constant time record, fixed memory (a few thousand counters at the default precision), any value up to 2^64 - 1
+     * 	- Percentiles return the highest value of the bucket (never under reports), clamped to the maximum recorded
+     * 	- Not thread safe: use one histogram per thread and merge() them
+     */
+    class Histogram {
+      public:
+        explicit Histogram(unsigned precision_bits = 7);
+
+        void record(uint64_t value, uint64_t count = 1) noexcept;
+        void merge(Histogram const& other); // Throws if the precisions differ
+        void reset() noexcept;
+
+        [[nodiscard]] uint64_t count() const noexcept { return m_count; }
+        [[nodiscard]] uint64_t min() const noexcept { return m_count != 0 ? m_min : 0; }
+        [[nodiscard]] uint64_t max() const noexcept { return m_max; }
+        [[nodiscard]] double   mean() const noexcept { return m_count != 0 ? m_sum / double(m_count) : 0.0; }
+        [[nodiscard]] uint64_t percentile(double fraction) const noexcept; // fraction in [0, 1], e.g. 0.999
+        [[nodiscard]] unsigned precision_bits() const noexcept { return m_precision_bits; }
+
+        /**
+         * Non empty buckets, in increasing order, for plotting
+         */
+        struct Bucket {
+            uint64_t lowest;
+            uint64_t highest;
+            uint64_t count;
+        };
+        [[nodiscard]] std::vector<Bucket> buckets() const;
+
+        // Count, min, max, mean, p50/p90/p99/p99.9 and the non empty buckets
+        [[nodiscard]] std::string to_json() const;
+
+      private:
+        [[nodiscard]] size_t   index_of(uint64_t value) const noexcept;
+        [[nodiscard]] uint64_t lowest_of(size_t index) const noexcept;
+        [[nodiscard]] uint64_t highest_of(size_t index) const noexcept;
+
+        unsigned              m_precision_bits;
+        std::vector<uint64_t> m_counts;
+        uint64_t              m_count = 0;
+        uint64_t              m_min   = UINT64_MAX;
+        uint64_t              m_max   = 0;
+        double                m_sum   = 0.0;
+    };
+
+    /**
+     * Per query distributions: latency, nodes visited and triangles tested
+     */
+    struct QueryHistograms {
+        Histogram latency_ns;
+        Histogram nodes_visited;
+        Histogram triangles_tested;
+
+        void merge(QueryHistograms const& other);
+        void reset();
+
+        [[nodiscard]] std::string to_json() const;
+    };
+
+    // One line per histogram: count, mean, p50, p90, p99, p99.9 and max
+    std::ostream& operator<<(std::ostream& os, QueryHistograms const& histograms);
+
+    /**
+     * Closest hit queries that feed QueryHistograms.
+     * 	- count_work: nodes and triangles are counted through a TraceSink callback (Instrumentation::Trace);
+     * 	  when false, only latency is recorded and the query runs uninstrumented
+     * 	- Latency is measured with CycleClock around the query, counting included
+     * 	- Not thread safe: one profiler per thread, merge the histograms
+     */
+    class QueryProfiler {
+      public:
+        explicit QueryProfiler(bool count_work = true) : m_count_work(count_work) {}
+
+        KdTree::Intersection get_closest(KdTree const& tree, ArrayView<Triangle> triangles, Ray const& ray);
+
+        [[nodiscard]] QueryHistograms&       histograms() noexcept { return m_histograms; }
+        [[nodiscard]] QueryHistograms const& histograms() const noexcept { return m_histograms; }
+
+      private:
+        QueryHistograms m_histograms;
+        bool            m_count_work;
+    };
+}
+
+#endif // LATENCY_HISTOGRAM_HPP
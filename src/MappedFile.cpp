@@ -0,0 +1,73 @@
+#include "MappedFile.hpp"
+#include <fmt/format.h>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace CS350 {
+
+#ifdef _WIN32
+    MappedFile::MappedFile(std::string const& path) {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error(fmt::format("Could not open file {}", path));
+        }
+        LARGE_INTEGER file_size{};
+        if (GetFileSizeEx(file, &file_size) == 0 || file_size.QuadPart == 0) {
+            CloseHandle(file);
+            throw std::runtime_error(fmt::format("Could not map empty file {}", path));
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void*  view    = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (view == nullptr) {
+            if (mapping != nullptr) {
+                CloseHandle(mapping);
+            }
+            CloseHandle(file);
+            throw std::runtime_error(fmt::format("Could not map file {}", path));
+        }
+        m_file    = file;
+        m_mapping = mapping;
+        m_data    = static_cast<std::byte const*>(view);
+        m_size    = static_cast<size_t>(file_size.QuadPart);
+    }
+
+    MappedFile::~MappedFile() {
+        UnmapViewOfFile(m_data);
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+    }
+#else
+    MappedFile::MappedFile(std::string const& path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error(fmt::format("Could not open file {}", path));
+        }
+        struct stat st {};
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            throw std::runtime_error(fmt::format("Could not map empty file {}", path));
+        }
+        void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd); // The mapping keeps its own reference to the file
+        if (view == MAP_FAILED) {
+            throw std::runtime_error(fmt::format("Could not map file {}", path));
+        }
+        m_data = static_cast<std::byte const*>(view);
+        m_size = static_cast<size_t>(st.st_size);
+    }
+
+    MappedFile::~MappedFile() {
+        munmap(const_cast<std::byte*>(m_data), m_size); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+    }
+#endif
+}
@@ -0,0 +1,34 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace CS350 {
+    /**
+     * Read-only memory mapping of a whole file.
+     * The mapping stays valid for the lifetime of the object. Throws on failure.
+     */
+    class MappedFile {
+      private:
+        std::byte const* m_data = nullptr;
+        size_t           m_size = 0;
+#ifdef _WIN32
+        void* m_file    = nullptr;
+        void* m_mapping = nullptr;
+#endif
+
+      public:
+        explicit MappedFile(std::string const& path);
+        ~MappedFile();
+        MappedFile(MappedFile const&)            = delete;
+        MappedFile& operator=(MappedFile const&) = delete;
+        MappedFile(MappedFile&&)                 = delete;
+        MappedFile& operator=(MappedFile&&)      = delete;
+
+        [[nodiscard]] std::byte const* data() const noexcept { return m_data; }
+        [[nodiscard]] size_t           size() const noexcept { return m_size; }
+    };
+}
+
+#endif // MAPPED_FILE_HPP
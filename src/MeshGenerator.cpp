@@ -0,0 +1,327 @@
+#include "MeshGenerator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace CS350 {
+    namespace {
+        float const  cPi        = 3.14159265358979f;
+        size_t const cChunkSize = 1 << 16; // Triangles generated per chunk when saving
+
+        uint64_t Mix(uint64_t x)
+        {
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+            return x ^ (x >> 31);
+        }
+
+        /**
+         * Splitmix64 stream keyed by (seed, index), one per triangle
+         */
+        struct Rng
+        {
+            Rng(uint32_t seed, uint64_t index) : state(Mix(uint64_t(seed) * 0x9e3779b97f4a7c15ull ^ Mix(index + 1))) {}
+
+            float uniform() // [0, 1)
+            {
+                state += 0x9e3779b97f4a7c15ull;
+                return float(Mix(state) >> 40) * (1.0f / 16777216.0f);
+            }
+            float uniform(float low, float high) { return low + (high - low) * uniform(); }
+            vec3  direction()
+            {
+                float z = uniform(-1.0f, 1.0f);
+                float a = uniform(0.0f, 2.0f * cPi);
+                float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+                return vec3(r * std::cos(a), r * std::sin(a), z);
+            }
+
+            uint64_t state;
+        };
+
+        // Any vector orthonormal to the unit vector d
+        vec3 Perpendicular(vec3 const& d)
+        {
+            vec3 axis = std::abs(d.x) < 0.9f ? vec3(1, 0, 0) : vec3(0, 1, 0);
+            return glm::normalize(glm::cross(d, axis));
+        }
+
+        size_t CeilSqrt(size_t n)
+        {
+            auto root = size_t(std::sqrt(double(n)));
+            while (root * root < n) {
+                ++root;
+            }
+            while (root > 0 && (root - 1) * (root - 1) >= n) {
+                --root;
+            }
+            return root;
+        }
+
+        size_t FloorSqrt(size_t n)
+        {
+            auto root = size_t(std::sqrt(double(n)));
+            while (root * root > n) {
+                --root;
+            }
+            while ((root + 1) * (root + 1) <= n) {
+                ++root;
+            }
+            return root;
+        }
+
+        float const cGolden = 1.61803398875f;
+        vec3 const  cIcosahedronVertices[12] = {
+            { -1, cGolden, 0 }, { 1, cGolden, 0 }, { -1, -cGolden, 0 }, { 1, -cGolden, 0 },
+            { 0, -1, cGolden }, { 0, 1, cGolden }, { 0, -1, -cGolden }, { 0, 1, -cGolden },
+            { cGolden, 0, -1 }, { cGolden, 0, 1 }, { -cGolden, 0, -1 }, { -cGolden, 0, 1 }
+        };
+        int const cIcosahedronFaces[20][3] = {
+            { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+            { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+            { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+            { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+        };
+        int const cTerrainOctaves = 6;
+    }
+
+    MeshGenerator::MeshGenerator(MeshGeneratorConfig const& cfg)
+        : m_cfg(cfg), m_count(cfg.triangle_count), m_resolution(0)
+    {
+        if (!(cfg.extent > 0.0f)) {
+            throw std::runtime_error("Mesh generator extent must be positive");
+        }
+        if (cfg.cluster_fraction < 0.0f || cfg.cluster_fraction > 1.0f || !(cfg.cluster_scale > 0.0f) || cfg.cluster_scale > 1.0f) {
+            throw std::runtime_error("Mesh generator cluster fraction and scale must be in [0, 1]");
+        }
+        switch (cfg.shape) {
+            case MeshShape::Sphere:
+                // 20 faces of s^2 triangles each
+                m_resolution = std::max<size_t>(1, CeilSqrt((cfg.triangle_count + 19) / 20));
+                m_count      = 20 * m_resolution * m_resolution;
+                break;
+            case MeshShape::Terrain:
+                // s^2 cells of 2 triangles each
+                m_resolution = std::max<size_t>(1, CeilSqrt((cfg.triangle_count + 1) / 2));
+                m_count      = 2 * m_resolution * m_resolution;
+                break;
+            default:
+                break;
+        }
+    }
+
+    Triangle MeshGenerator::operator[](size_t i) const
+    {
+        switch (m_cfg.shape) {
+            case MeshShape::Sphere: return sphere(i);
+            case MeshShape::Terrain: return terrain(i);
+            case MeshShape::Soup: return soup(i);
+            case MeshShape::Clustered: return clustered(i);
+            case MeshShape::Slivers: return sliver(i);
+        }
+        return {};
+    }
+
+    void MeshGenerator::generate(size_t begin, size_t end, Triangle* out) const
+    {
+        for (size_t i = begin; i < end; ++i) {
+            *out++ = (*this)[i];
+        }
+    }
+
+    Triangle MeshGenerator::sphere(size_t i) const
+    {
+        // Each face is split in rows, row r holding 2r + 1 triangles (r^2 before it)
+        size_t const s    = m_resolution;
+        auto const&  face = cIcosahedronFaces[i / (s * s)];
+        size_t const j    = i % (s * s);
+        size_t const r    = FloorSqrt(j);
+        size_t const k    = j - r * r;
+        size_t const c    = k / 2;
+
+        vec3 const a  = cIcosahedronVertices[face[0]];
+        vec3 const ab = (cIcosahedronVertices[face[1]] - a) / float(s);
+        vec3 const bc = (cIcosahedronVertices[face[2]] - cIcosahedronVertices[face[1]]) / float(s);
+        auto point    = [&](size_t row, size_t col) { return glm::normalize(a + ab * float(row) + bc * float(col)) * m_cfg.extent; };
+        if (k % 2 == 0) {
+            return { { point(r, c), point(r + 1, c), point(r + 1, c + 1) } };
+        }
+        return { { point(r, c), point(r + 1, c + 1), point(r, c + 1) } };
+    }
+
+    float MeshGenerator::height(size_t x, size_t z) const
+    {
+        // Fractal value noise over the grid, 4 lattice cells across at the first octave
+        float u         = float(x) / float(m_resolution);
+        float v         = float(z) / float(m_resolution);
+        float frequency = 4.0f;
+        float amplitude = 0.5f;
+        float sum       = 0.0f;
+        for (int octave = 0; octave < cTerrainOctaves; ++octave) {
+            float fu = u * frequency;
+            float fv = v * frequency;
+            auto  iu = int64_t(std::floor(fu));
+            auto  iv = int64_t(std::floor(fv));
+            float tu = fu - float(iu);
+            float tv = fv - float(iv);
+            tu       = tu * tu * (3.0f - 2.0f * tu);
+            tv       = tv * tv * (3.0f - 2.0f * tv);
+
+            auto lattice = [&](int64_t lu, int64_t lv) {
+                uint64_t key = Mix(uint64_t(lu) * 0x632be59bd9b4e019ull ^ uint64_t(lv) * 0x8cb92ba72f3d8dd7ull ^ uint64_t(octave));
+                return float(Mix(key ^ m_cfg.seed) >> 40) * (2.0f / 16777216.0f) - 1.0f;
+            };
+            float bottom = lattice(iu, iv) + (lattice(iu + 1, iv) - lattice(iu, iv)) * tu;
+            float top    = lattice(iu, iv + 1) + (lattice(iu + 1, iv + 1) - lattice(iu, iv + 1)) * tu;
+            sum += (bottom + (top - bottom) * tv) * amplitude;
+            frequency *= 2.0f;
+            amplitude *= 0.5f;
+        }
+        return sum * 0.5f * m_cfg.extent; // |sum| < 1
+    }
+
+    Triangle MeshGenerator::terrain(size_t i) const
+    {
+        size_t const s    = m_resolution;
+        size_t const cell = i / 2;
+        size_t const x    = cell % s;
+        size_t const z    = cell / s;
+        auto point        = [&](size_t px, size_t pz) {
+            float step = 2.0f * m_cfg.extent / float(s);
+            return vec3(-m_cfg.extent + step * float(px), height(px, pz), -m_cfg.extent + step * float(pz));
+        };
+        if (i % 2 == 0) {
+            return { { point(x, z), point(x, z + 1), point(x + 1, z) } };
+        }
+        return { { point(x + 1, z), point(x, z + 1), point(x + 1, z + 1) } };
+    }
+
+    Triangle MeshGenerator::soup(size_t i) const
+    {
+        // Edge length keeps the triangle density roughly constant with the count
+        Rng   rng(m_cfg.seed, i);
+        float size   = std::min(0.5f, 2.0f / std::cbrt(float(std::max<size_t>(m_count, 1)))) * m_cfg.extent;
+        float bound  = m_cfg.extent - size;
+        vec3  center = vec3(rng.uniform(-bound, bound), rng.uniform(-bound, bound), rng.uniform(-bound, bound));
+        return { { center + rng.direction() * size, center + rng.direction() * size, center + rng.direction() * size } };
+    }
+
+    Triangle MeshGenerator::clustered(size_t i) const
+    {
+        auto const cluster_count = size_t(double(m_count) * double(m_cfg.cluster_fraction));
+        if (i < cluster_count) {
+            // Small triangles tangent to the cluster sphere, about as large as needed to cover it
+            Rng   rng(m_cfg.seed, i);
+            float radius = m_cfg.extent * m_cfg.cluster_scale;
+            float size   = radius * 4.0f / std::sqrt(float(cluster_count));
+            vec3  normal = rng.direction();
+            vec3  u      = Perpendicular(normal);
+            vec3  v      = glm::cross(normal, u);
+            float angle  = rng.uniform(0.0f, 2.0f * cPi);
+            vec3  center = normal * radius;
+            auto  corner = [&](float offset) {
+                float a = angle + offset;
+                return center + (u * std::cos(a) + v * std::sin(a)) * size;
+            };
+            return { { corner(0.0f), corner(2.0f * cPi / 3.0f), corner(4.0f * cPi / 3.0f) } };
+        }
+
+        // The stadium: a closed strip between a low inner ring and a high outer one
+        size_t const strip      = m_count - cluster_count;
+        size_t const ring       = strip + strip % 2; // Even, so that inner and outer alternate across the seam
+        size_t const j          = i - cluster_count;
+        auto         ring_point = [&](size_t vertex) {
+            vertex %= ring;
+            float a     = 2.0f * cPi * float(vertex) / float(ring);
+            bool  outer = vertex % 2 == 1;
+            float r     = m_cfg.extent * (outer ? 1.0f : 0.6f);
+            return vec3(r * std::cos(a), m_cfg.extent * (outer ? 1.0f : -0.2f), r * std::sin(a));
+        };
+        return { { ring_point(j), ring_point(j + 1), ring_point(j + 2) } };
+    }
+
+    Triangle MeshGenerator::sliver(size_t i) const
+    {
+        Rng   rng(m_cfg.seed, i);
+        float length = rng.uniform(0.25f, 0.5f) * m_cfg.extent;
+        float width  = length * 1e-3f;
+        vec3  axis   = rng.direction();
+        vec3  side   = Perpendicular(axis);
+        float bound  = m_cfg.extent - length * 0.5f - width;
+        vec3  center = vec3(rng.uniform(-bound, bound), rng.uniform(-bound, bound), rng.uniform(-bound, bound));
+        return { { center - axis * (length * 0.5f), center + axis * (length * 0.5f), center + side * width } };
+    }
+
+    std::vector<Triangle> GenerateTriangles(MeshGeneratorConfig const& cfg, ThreadPool* pool)
+    {
+        MeshGenerator         generator(cfg);
+        std::vector<Triangle> triangles(generator.size());
+        auto                  run = [&](size_t begin, size_t end) { generator.generate(begin, end, triangles.data() + begin); };
+        if (pool != nullptr) {
+            pool->parallel_for(triangles.size(), run);
+        } else {
+            run(0, triangles.size());
+        }
+        return triangles;
+    }
+
+    void SaveGeneratedCS350Binary(std::string const& file, MeshGeneratorConfig const& cfg, ThreadPool* pool)
+    {
+        MeshGenerator generator(cfg);
+        if (generator.size() * 3 > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("Too many vertices for a CS350_binary file: " + file);
+        }
+
+        // Plain CS350_binary header, non-indexed positions only
+        char           header[16] = { 'C', 'S', '3', '5', '0' };
+        uint32_t const vertexCount = static_cast<uint32_t>(generator.size() * 3);
+        uint32_t const indexCount  = 0;
+        std::memcpy(header + 5, &vertexCount, sizeof(vertexCount));
+        std::memcpy(header + 9, &indexCount, sizeof(indexCount));
+        header[13] = 1;
+
+        static_assert(sizeof(Triangle) == 9 * sizeof(float), "Triangles are written as is");
+        std::ofstream outputFile(file, std::ios::binary | std::ios::trunc);
+        outputFile.write(header, sizeof(header));
+        std::vector<Triangle> chunk(std::min(cChunkSize, generator.size()));
+        for (size_t begin = 0; begin < generator.size() && outputFile; begin += cChunkSize) {
+            size_t count = std::min(cChunkSize, generator.size() - begin);
+            auto   run   = [&](size_t first, size_t last) { generator.generate(begin + first, begin + last, chunk.data() + first); };
+            if (pool != nullptr) {
+                pool->parallel_for(count, run);
+            } else {
+                run(0, count);
+            }
+            outputFile.write(reinterpret_cast<char const*>(chunk.data()), static_cast<std::streamsize>(count * sizeof(Triangle)));
+        }
+        if (!outputFile) {
+            throw std::runtime_error("Cannot write file: " + file);
+        }
+    }
+
+    char const* MeshShapeName(MeshShape shape)
+    {
+        switch (shape) {
+            case MeshShape::Sphere: return "sphere";
+            case MeshShape::Terrain: return "terrain";
+            case MeshShape::Soup: return "soup";
+            case MeshShape::Clustered: return "clustered";
+            case MeshShape::Slivers: return "slivers";
+        }
+        return "unknown";
+    }
+
+    MeshShape ParseMeshShape(std::string const& name)
+    {
+        for (auto shape : { MeshShape::Sphere, MeshShape::Terrain, MeshShape::Soup, MeshShape::Clustered, MeshShape::Slivers }) {
+            if (name == MeshShapeName(shape)) {
+                return shape;
+            }
+        }
+        throw std::runtime_error("Unknown mesh shape: " + name);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef MESH_GENERATOR_HPP
+#define MESH_GENERATOR_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Math.hpp"
+#include "Shapes.hpp"
+#include "ThreadPool.hpp"
+
+namespace CS350 {
+    /**
+     * Procedural distributions, each one stresses the tree differently
+     * 	- Sphere: subdivided icosahedron, uniform and closed
+     * 	- Terrain: noise heightfield, a 2.5D surface with two triangles per cell
+     * 	- Soup: independent small triangles uniformly spread in the volume
+     * 	- Clustered: "teapot in a stadium", most triangles in a tiny sphere at the center of a large, coarse bowl
+     * 	- Slivers: long thin triangles with random orientations
+     */
+    enum class MeshShape { Sphere, Terrain, Soup, Clustered, Slivers };
+
+    struct MeshGeneratorConfig {
+        MeshShape shape            = MeshShape::Soup;
+        size_t    triangle_count   = 1000;  // Rounded up to the next count the shape can tessellate (Sphere/Terrain)
+        uint32_t  seed             = 0;
+        float     extent           = 1.0f;  // Triangles lie in [-extent, extent]^3
+        float     cluster_fraction = 0.9f;  // Clustered: share of the triangles in the cluster
+        float     cluster_scale    = 0.01f; // Clustered: radius of the cluster, relative to the extent
+    };
+
+    /**
+     * Deterministic triangle generator
+     * 	- Triangle i only depends on the config and i, so any range can be generated on its own (in parallel, or streamed)
+     * 	- Same config, same triangles, with the same toolchain and libm (std::sin, std::cos and std::cbrt
+     * 	  may round differently across standard libraries, so other platforms can differ in the last bits)
+     */
+    class MeshGenerator {
+      public:
+        explicit MeshGenerator(MeshGeneratorConfig const& cfg);
+
+        [[nodiscard]] size_t                     size() const { return m_count; }
+        [[nodiscard]] MeshGeneratorConfig const& config() const { return m_cfg; }
+        [[nodiscard]] Triangle                   operator[](size_t i) const;
+
+        // Writes triangles [begin, end) into out
+        void generate(size_t begin, size_t end, Triangle* out) const;
+
+      private:
+        Triangle sphere(size_t i) const;
+        Triangle terrain(size_t i) const;
+        Triangle soup(size_t i) const;
+        Triangle clustered(size_t i) const;
+        Triangle sliver(size_t i) const;
+        float    height(size_t x, size_t z) const;
+
+        MeshGeneratorConfig m_cfg;
+        size_t              m_count;
+        size_t              m_resolution; // Sphere: subdivisions per icosahedron edge, Terrain: cells per side
+    };
+
+    /**
+     * All the triangles of a config, generated in parallel when a pool is given
+     */
+    std::vector<Triangle> GenerateTriangles(MeshGeneratorConfig const& cfg, ThreadPool* pool = nullptr);
+
+    /**
+     * Writes the triangles of a config as a non-indexed CS350_binary (positions only)
+     * 	- Streamed in chunks, memory use does not depend on the triangle count
+     * 	- Throws if the vertex count does not fit the format (more than 2^32 - 1 vertices)
+     */
+    void SaveGeneratedCS350Binary(std::string const& file, MeshGeneratorConfig const& cfg, ThreadPool* pool = nullptr);
+
+    /**
+     * Shape names ("sphere", "terrain", "soup", "clustered", "slivers"), ParseMeshShape throws on unknown names
+     */
+    char const* MeshShapeName(MeshShape shape);
+    MeshShape   ParseMeshShape(std::string const& name);
+}
+
+#endif // MESH_GENERATOR_HPP
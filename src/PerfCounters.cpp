@@ -0,0 +1,151 @@
+#include "PerfCounters.hpp"
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace CS350 {
+
+#ifdef __linux__
+    namespace {
+        struct EventDesc
+        {
+            uint32_t type;
+            uint64_t config;
+        };
+
+        uint64_t CacheConfig(uint64_t cache)
+        {
+            return cache | (uint64_t(PERF_COUNT_HW_CACHE_OP_READ) << 8) | (uint64_t(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16);
+        }
+
+        EventDesc Describe(PerfCounters::Event event)
+        {
+            switch (event) {
+                case PerfCounters::cCycles: return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES };
+                case PerfCounters::cInstructions: return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS };
+                case PerfCounters::cL1DMisses: return { PERF_TYPE_HW_CACHE, CacheConfig(PERF_COUNT_HW_CACHE_L1D) };
+                case PerfCounters::cLLCMisses: return { PERF_TYPE_HW_CACHE, CacheConfig(PERF_COUNT_HW_CACHE_LL) };
+                case PerfCounters::cBranchMisses: return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES };
+                default: return { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES };
+            }
+        }
+
+        int Open(EventDesc desc, int group)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size           = sizeof(attr);
+            attr.type           = desc.type;
+            attr.config         = desc.config;
+            attr.disabled       = group < 0 ? 1 : 0; // Members follow the leader
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+        }
+    }
+
+    PerfCounters::PerfCounters()
+    {
+        m_fds.fill(-1);
+        for (int e = 0; e < cEventCount; ++e) {
+            int fd = Open(Describe(Event(e)), m_leader);
+            if (fd < 0 && m_leader >= 0) {
+                // Some events can not share a group (too few hardware counters), count them on their own
+                fd = Open(Describe(Event(e)), -1);
+            }
+            m_fds[size_t(e)] = fd;
+            if (m_leader < 0) {
+                m_leader = fd;
+            }
+        }
+    }
+
+    PerfCounters::~PerfCounters()
+    {
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    void PerfCounters::start()
+    {
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    void PerfCounters::stop()
+    {
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+    }
+
+    void PerfCounters::reset()
+    {
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            }
+        }
+    }
+
+    PerfCounters::Sample PerfCounters::read() const
+    {
+        Sample sample;
+        for (size_t e = 0; e < m_fds.size(); ++e) {
+            uint64_t values[3] = {}; // Value, time enabled, time running
+            if (m_fds[e] < 0 || ::read(m_fds[e], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values))) {
+                continue;
+            }
+            if (values[1] > 0 && values[2] == 0) {
+                continue; // Enabled but never scheduled (multiplexed out): the count is unknown, not zero
+            }
+            sample.valid[e]  = true;
+            sample.values[e] = values[2] > 0 && values[2] < values[1] ? uint64_t(double(values[0]) * double(values[1]) / double(values[2])) : values[0];
+        }
+        return sample;
+    }
+#else
+    PerfCounters::PerfCounters() { m_fds.fill(-1); }
+    PerfCounters::~PerfCounters() = default;
+    void                 PerfCounters::start() {}
+    void                 PerfCounters::stop() {}
+    void                 PerfCounters::reset() {}
+    PerfCounters::Sample PerfCounters::read() const { return {}; }
+#endif
+
+    bool PerfCounters::any_available() const
+    {
+        for (int fd : m_fds) {
+            if (fd >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    char const* PerfCounters::Name(Event event)
+    {
+        switch (event) {
+            case cCycles: return "cycles";
+            case cInstructions: return "instructions";
+            case cL1DMisses: return "l1d_misses";
+            case cLLCMisses: return "llc_misses";
+            case cBranchMisses: return "branch_misses";
+            default: return "unknown";
+        }
+    }
+}
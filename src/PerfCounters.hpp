@@ -0,0 +1,63 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <array>
+#include <cstdint>
+
+namespace CS350 {
+    /**
+     * Hardware performance counters of the calling thread (Linux perf_event_open).
+     * 	- Counters start disabled and accumulate over every start()/stop() pair until reset()
+     * 	- Events the machine (or perf_event_paranoid) does not allow are just unavailable, never an error
+     * 	- Everywhere else (other platforms, containers without perf) nothing is available
+     * 	- User space only, threads spawned before the counters (e.g. a ThreadPool) are not counted
+     */
+    class PerfCounters {
+      public:
+        enum Event { cCycles, cInstructions, cL1DMisses, cLLCMisses, cBranchMisses, cEventCount };
+
+        struct Sample {
+            std::array<uint64_t, cEventCount> values{}; // Scaled up when the kernel multiplexed the counters
+            std::array<bool, cEventCount>     valid{};  // False when unavailable, or enabled but never scheduled on the hardware
+
+            uint64_t operator[](Event event) const { return values[event]; }
+        };
+
+        PerfCounters();
+        ~PerfCounters();
+        PerfCounters(PerfCounters const&)            = delete;
+        PerfCounters& operator=(PerfCounters const&) = delete;
+
+        [[nodiscard]] bool available(Event event) const { return m_fds[event] >= 0; }
+        [[nodiscard]] bool any_available() const;
+
+        void start();
+        void stop();
+        void reset();
+
+        [[nodiscard]] Sample read() const;
+
+        // "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+        static char const* Name(Event event);
+
+      private:
+        std::array<int, cEventCount> m_fds;
+        int                          m_leader = -1; // Events are opened as one group, scheduled together
+    };
+
+    /**
+     * Counts a scope: starts the counters on construction and stops them on destruction
+     */
+    class PerfScope {
+      public:
+        explicit PerfScope(PerfCounters& counters) : m_counters(counters) { m_counters.start(); }
+        ~PerfScope() { m_counters.stop(); }
+        PerfScope(PerfScope const&)            = delete;
+        PerfScope& operator=(PerfScope const&) = delete;
+
+      private:
+        PerfCounters& m_counters;
+    };
+}
+
+#endif // PERF_COUNTERS_HPP
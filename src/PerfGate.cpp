@@ -0,0 +1,410 @@
+#include "PerfGate.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include "CostCalibration.hpp"
+#include "LatencyHistogram.hpp"
+
+namespace CS350 {
+    namespace {
+        int const cBaselineVersion = 1;
+
+        /**
+         * Just enough JSON for baselines: objects, arrays, strings (no escapes but \" and \\), numbers and literals
+         */
+        struct JsonValue {
+            enum class Type { Null, Bool, Number, String, Array, Object } type = Type::Null;
+            double                                         number = 0.0;
+            std::string                                    text;
+            std::vector<JsonValue>                         array;
+            std::vector<std::pair<std::string, JsonValue>> object;
+
+            JsonValue const* find(std::string const& key) const
+            {
+                for (auto const& [name, value] : object) {
+                    if (name == key) {
+                        return &value;
+                    }
+                }
+                return nullptr;
+            }
+        };
+
+        class JsonReader {
+          public:
+            JsonReader(std::string const& text, std::string const& path) : m_text(text), m_path(path) {}
+
+            JsonValue parse()
+            {
+                JsonValue value = parse_value();
+                skip_spaces();
+                if (m_pos != m_text.size()) {
+                    fail("trailing characters");
+                }
+                return value;
+            }
+
+          private:
+            [[noreturn]] void fail(char const* what) const
+            {
+                throw std::runtime_error(fmt::format("Invalid JSON ({}) at offset {} in file: {}", what, m_pos, m_path));
+            }
+
+            void skip_spaces()
+            {
+                while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+                    ++m_pos;
+                }
+            }
+
+            bool consume(char c)
+            {
+                skip_spaces();
+                if (m_pos < m_text.size() && m_text[m_pos] == c) {
+                    ++m_pos;
+                    return true;
+                }
+                return false;
+            }
+
+            void expect(char c)
+            {
+                if (!consume(c)) {
+                    fail("unexpected character");
+                }
+            }
+
+            std::string parse_string()
+            {
+                expect('"');
+                std::string result;
+                while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+                    if (m_text[m_pos] == '\\' && m_pos + 1 < m_text.size()) {
+                        ++m_pos;
+                    }
+                    result += m_text[m_pos++];
+                }
+                expect('"');
+                return result;
+            }
+
+            JsonValue parse_value()
+            {
+                JsonValue value;
+                skip_spaces();
+                if (m_pos >= m_text.size()) {
+                    fail("unexpected end");
+                }
+                char const c = m_text[m_pos];
+                if (c == '{') {
+                    value.type = JsonValue::Type::Object;
+                    ++m_pos;
+                    if (!consume('}')) {
+                        do {
+                            std::string key = parse_string();
+                            expect(':');
+                            value.object.emplace_back(std::move(key), parse_value());
+                        } while (consume(','));
+                        expect('}');
+                    }
+                } else if (c == '[') {
+                    value.type = JsonValue::Type::Array;
+                    ++m_pos;
+                    if (!consume(']')) {
+                        do {
+                            value.array.push_back(parse_value());
+                        } while (consume(','));
+                        expect(']');
+                    }
+                } else if (c == '"') {
+                    value.type = JsonValue::Type::String;
+                    value.text = parse_string();
+                } else if (m_text.compare(m_pos, 4, "true") == 0 || m_text.compare(m_pos, 5, "false") == 0) {
+                    value.type   = JsonValue::Type::Bool;
+                    value.number = c == 't' ? 1.0 : 0.0;
+                    m_pos += c == 't' ? 4 : 5;
+                } else if (m_text.compare(m_pos, 4, "null") == 0) {
+                    m_pos += 4;
+                } else {
+                    char const* begin = m_text.c_str() + m_pos;
+                    char*       end   = nullptr;
+                    value.type        = JsonValue::Type::Number;
+                    value.number      = std::strtod(begin, &end);
+                    if (end == begin) {
+                        fail("unexpected character");
+                    }
+                    m_pos += size_t(end - begin);
+                }
+                return value;
+            }
+
+            std::string const& m_text;
+            std::string const& m_path;
+            size_t             m_pos = 0;
+        };
+
+        double Median(std::vector<double> values)
+        {
+            if (values.empty()) {
+                return 0.0;
+            }
+            auto middle = values.begin() + std::ptrdiff_t(values.size() / 2);
+            std::nth_element(values.begin(), middle, values.end());
+            if (values.size() % 2 == 1) {
+                return *middle;
+            }
+            return (*middle + *std::max_element(values.begin(), middle)) * 0.5;
+        }
+
+        double Regression(double baseline, double current, bool higher_is_better)
+        {
+            double const worse  = higher_is_better ? baseline : current;
+            double const better = higher_is_better ? current : baseline;
+            if (better == 0.0) {
+                return worse == 0.0 ? 0.0 : std::numeric_limits<double>::infinity();
+            }
+            return worse / better - 1.0;
+        }
+
+        std::vector<double> Resample(std::vector<double> const& samples, std::mt19937& rng)
+        {
+            std::uniform_int_distribution<size_t> pick(0, samples.size() - 1);
+            std::vector<double>                   result(samples.size());
+            for (auto& value : result) {
+                value = samples[pick(rng)];
+            }
+            return result;
+        }
+
+        std::string JsonString(std::string const& text)
+        {
+            std::string result = "\"";
+            for (char c : text) {
+                result += c == '"' || c == '\\' ? std::string("\\") + c : std::string(1, c);
+            }
+            return result + "\"";
+        }
+
+        std::string JsonNumber(double value)
+        {
+            return std::isfinite(value) ? fmt::format("{}", value) : (value > 0.0 ? "1e308" : "-1e308");
+        }
+    }
+
+    std::string PerfBaseline::to_json() const
+    {
+        std::ostringstream os;
+        os << "{\n"
+           << fmt::format("  \"version\": {},\n", cBaselineVersion)
+           << fmt::format("  \"host\": {},\n", JsonString(host))
+           << "  \"metrics\": {";
+        size_t i = 0;
+        for (auto const& [name, metric] : metrics) {
+            os << (i++ == 0 ? "\n" : ",\n")
+               << fmt::format("    {}: {{ \"better\": \"{}\", \"timed\": {}, \"samples\": [", JsonString(name), metric.higher_is_better ? "higher" : "lower", metric.timed);
+            for (size_t s = 0; s < metric.samples.size(); ++s) {
+                os << (s == 0 ? "" : ", ") << JsonNumber(metric.samples[s]);
+            }
+            os << "] }";
+        }
+        os << "\n  }\n}\n";
+        return os.str();
+    }
+
+    PerfBaseline LoadPerfBaseline(std::string const& path)
+    {
+        std::ifstream is(path);
+        if (!is) {
+            throw std::runtime_error("Could not open file " + path);
+        }
+        std::stringstream buffer;
+        buffer << is.rdbuf();
+        std::string const text = buffer.str();
+        JsonValue const   root = JsonReader(text, path).parse();
+
+        JsonValue const* version = root.find("version");
+        JsonValue const* host    = root.find("host");
+        JsonValue const* metrics = root.find("metrics");
+        if (version == nullptr || int(version->number) != cBaselineVersion || metrics == nullptr || metrics->type != JsonValue::Type::Object) {
+            throw std::runtime_error("Unsupported baseline in file: " + path);
+        }
+
+        PerfBaseline baseline;
+        baseline.host = host != nullptr ? host->text : "";
+        for (auto const& [name, entry] : metrics->object) {
+            JsonValue const* better  = entry.find("better");
+            JsonValue const* timed   = entry.find("timed");
+            JsonValue const* samples = entry.find("samples");
+            if (samples == nullptr || samples->type != JsonValue::Type::Array || samples->array.empty()) {
+                throw std::runtime_error(fmt::format("Metric {} has no samples in file: {}", name, path));
+            }
+            PerfMetric metric;
+            metric.higher_is_better = better != nullptr && better->text == "higher";
+            metric.timed            = timed != nullptr && timed->number != 0.0;
+            for (auto const& sample : samples->array) {
+                metric.samples.push_back(sample.number);
+            }
+            baseline.metrics[name] = std::move(metric);
+        }
+        return baseline;
+    }
+
+    void SavePerfBaseline(std::string const& path, PerfBaseline const& baseline)
+    {
+        std::ofstream os(path, std::ios::trunc);
+        os << baseline.to_json();
+        if (!os) {
+            throw std::runtime_error(fmt::format("Could not write file {}", path));
+        }
+    }
+
+    PerfBaseline MeasurePerf(std::vector<PerfWorkload> const& workloads, unsigned repetitions)
+    {
+        using Clock = std::chrono::steady_clock;
+        PerfBaseline result;
+        result.host = MachineBuildId();
+        repetitions = std::max(repetitions, 1u);
+
+        for (auto const& workload : workloads) {
+            if (workload.triangles == nullptr || workload.rays.empty()) {
+                throw std::runtime_error(fmt::format("Workload {} has no triangles or no rays", workload.name));
+            }
+            auto const& triangles = *workload.triangles;
+            PerfMetric build_ms{ false, true, {} };
+            PerfMetric rays_per_second{ true, true, {} };
+            KdTree     kdtree;
+            for (unsigned r = 0; r < repetitions; ++r) {
+                auto start = Clock::now();
+                kdtree.build(triangles, workload.config);
+                build_ms.samples.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+            }
+
+            size_t hits = 0;
+            for (unsigned r = 0; r <= repetitions; ++r) {
+                auto start = Clock::now();
+                for (auto const& ray : workload.rays) {
+                    hits += kdtree.get_closest<Instrumentation::None>(triangles, ray, nullptr) ? 1 : 0;
+                }
+                double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+                if (r != 0) { // Warm up pass
+                    rays_per_second.samples.push_back(seconds > 0.0 ? double(workload.rays.size()) / seconds : 0.0);
+                }
+            }
+            volatile size_t sink = hits;
+            (void)sink;
+
+            QueryProfiler profiler;
+            for (auto const& ray : workload.rays) {
+                (void)profiler.get_closest(kdtree, triangles, ray);
+            }
+            result.metrics[workload.name + "/build_ms"]          = std::move(build_ms);
+            result.metrics[workload.name + "/rays_per_second"]   = std::move(rays_per_second);
+            result.metrics[workload.name + "/nodes_per_ray"]     = PerfMetric{ false, false, { profiler.histograms().nodes_visited.mean() } };
+            result.metrics[workload.name + "/triangles_per_ray"] = PerfMetric{ false, false, { profiler.histograms().triangles_tested.mean() } };
+        }
+        return result;
+    }
+
+    PerfGateReport ComparePerf(PerfBaseline const& baseline, PerfBaseline const& current, PerfGateOptions const& options)
+    {
+        PerfGateReport report;
+        std::mt19937   rng(options.seed);
+        double const   alpha = std::clamp(1.0 - options.confidence, 0.0, 1.0);
+
+        for (auto const& [name, expected] : baseline.metrics) {
+            PerfGateResult result;
+            result.name     = name;
+            result.baseline = Median(expected.samples);
+
+            auto found = current.metrics.find(name);
+            if (found == current.metrics.end() || found->second.samples.empty()) {
+                result.failed = true;
+                report.passed = false;
+                report.results.push_back(result);
+                continue;
+            }
+            auto const& measured = found->second;
+            result.current       = Median(measured.samples);
+            result.regression    = Regression(result.baseline, result.current, expected.higher_is_better);
+            if (expected.timed && !options.compare_timed) {
+                result.regression_low  = result.regression;
+                result.regression_high = result.regression;
+                result.skipped         = true;
+                report.results.push_back(result);
+                continue;
+            }
+
+            std::vector<double> regressions;
+            regressions.reserve(options.resamples);
+            for (unsigned r = 0; r < options.resamples; ++r) {
+                regressions.push_back(Regression(Median(Resample(expected.samples, rng)), Median(Resample(measured.samples, rng)), expected.higher_is_better));
+            }
+            std::sort(regressions.begin(), regressions.end());
+            if (regressions.empty()) {
+                result.regression_low  = result.regression;
+                result.regression_high = result.regression;
+            } else {
+                auto rank              = [&](double fraction) { return regressions[std::min(regressions.size() - 1, size_t(fraction * double(regressions.size())))]; };
+                result.regression_low  = rank(alpha * 0.5);
+                result.regression_high = rank(1.0 - alpha * 0.5);
+            }
+            double const tolerance = expected.timed ? options.timed_tolerance : options.tolerance;
+            result.failed          = result.regression_low > tolerance;
+            result.improved        = result.regression_high < -tolerance;
+            report.passed          = report.passed && !result.failed;
+            report.results.push_back(result);
+        }
+        for (auto const& [name, metric] : current.metrics) {
+            if (baseline.metrics.count(name) == 0) {
+                report.new_metrics.push_back(name);
+            }
+        }
+        return report;
+    }
+
+    std::string PerfGateReport::to_text() const
+    {
+        std::ostringstream os;
+        for (auto const& result : results) {
+            char const* status = result.failed ? "FAIL" : result.skipped ? "skip" : result.improved ? "better" : "ok";
+            os << fmt::format("{:<6} {:<48} {:>14.4g} -> {:>14.4g}  {:>+8.2f}% [{:+.2f}%, {:+.2f}%]\n", status, result.name, result.baseline, result.current,
+                              result.regression * 100.0, result.regression_low * 100.0, result.regression_high * 100.0);
+        }
+        for (auto const& name : new_metrics) {
+            os << fmt::format("{:<6} {}\n", "new", name);
+        }
+        os << (passed ? "PASSED\n" : "FAILED\n");
+        return os.str();
+    }
+
+    std::string PerfGateReport::to_json() const
+    {
+        std::ostringstream os;
+        os << "{\n"
+           << fmt::format("  \"passed\": {},\n", passed)
+           << "  \"results\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            auto const& r = results[i];
+            os << (i == 0 ? "\n" : ",\n")
+               << fmt::format("    {{ \"name\": {}, \"baseline\": {}, \"current\": {}, \"regression\": {}, \"regression_low\": {}, \"regression_high\": {}, "
+                              "\"failed\": {}, \"improved\": {}, \"skipped\": {} }}",
+                              JsonString(r.name), JsonNumber(r.baseline), JsonNumber(r.current), JsonNumber(r.regression), JsonNumber(r.regression_low),
+                              JsonNumber(r.regression_high), r.failed, r.improved, r.skipped);
+        }
+        os << "\n  ],\n  \"new_metrics\": [";
+        for (size_t i = 0; i < new_metrics.size(); ++i) {
+            os << (i == 0 ? "" : ", ") << JsonString(new_metrics[i]);
+        }
+        os << "]\n}\n";
+        return os.str();
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef PERF_GATE_HPP
+#define PERF_GATE_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "KdTree.hpp"
+#include "Shapes.hpp"
+
+namespace CS350 {
+    /**
+     * Baseline format description (JSON, meant to be committed):
+     *
+     * 	{
+     * 	  "version": 1,
+     * 	  "host": "<MachineBuildId() or cs350-perf-gate --host_key>",
+     * 	  "metrics": {
+     * 	    "bunny/cost_intersection:80/min_triangles:50/build_ms": { "better": "lower", "timed": true, "samples": [12.1, 11.9, ...] },
+     * 	    ...
+     * 	  }
+     * 	}
+     *
+     * 	- Metric names are "<workload>/<metric>", metrics are build_ms, rays_per_second, nodes_per_ray and triangles_per_ray
+     * 	- Timed metrics keep every repetition, counted ones (deterministic) a single sample
+     */
+
+    struct PerfMetric {
+        bool                higher_is_better = false;
+        bool                timed            = false; // Depends on the host (only compared against baselines of the same host)
+        std::vector<double> samples;
+    };
+
+    struct PerfBaseline {
+        std::string                       host;
+        std::map<std::string, PerfMetric> metrics;
+
+        [[nodiscard]] std::string to_json() const;
+    };
+
+    PerfBaseline LoadPerfBaseline(std::string const& path); // Throws on missing or malformed files
+    void         SavePerfBaseline(std::string const& path, PerfBaseline const& baseline);
+
+    /**
+     * A mesh, a tree configuration and the rays it is queried with
+     */
+    struct PerfWorkload {
+        std::string                  name;                // e.g. "bunny/cost_intersection:80/min_triangles:50"
+        std::vector<Triangle> const* triangles = nullptr; // Not owned, shared by the workloads of a mesh
+        KdTree::Config               config;
+        std::vector<Ray>             rays;
+    };
+
+    /**
+     * Measures every workload: repetitions builds and repetitions passes over the rays (uninstrumented, after an untimed one)
+     * are timed, nodes and triangles per ray are counted once. The host is MachineBuildId()
+     */
+    PerfBaseline MeasurePerf(std::vector<PerfWorkload> const& workloads, unsigned repetitions = 7);
+
+    struct PerfGateOptions {
+        double   tolerance       = 0.01;  // Relative regression allowed for counted metrics (1%)
+        double   timed_tolerance = 0.10;  // Same for timed ones: runs differ more than repetitions of a run (memory placement, clocks)
+        double   confidence      = 0.95;  // Of the bootstrap interval
+        unsigned resamples       = 2000;
+        uint32_t seed            = 0x350; // Results are reproducible
+        bool     compare_timed   = true;  // When false (e.g. another host), only counted metrics are compared
+    };
+
+    /**
+     * Comparison of one metric. Regression is relative and positive when worse, whatever the direction:
+     * current / baseline - 1 for lower-is-better metrics, baseline / current - 1 for higher-is-better ones (of the medians)
+     */
+    struct PerfGateResult {
+        std::string name;
+        double      baseline        = 0.0; // Median
+        double      current         = 0.0; // Median
+        double      regression      = 0.0;
+        double      regression_low  = 0.0; // Bootstrap confidence interval of regression
+        double      regression_high = 0.0;
+        bool        failed          = false; // regression_low > tolerance (of the metric kind): worse beyond noise and tolerance
+        bool        improved        = false; // regression_high < -tolerance
+        bool        skipped         = false; // Timed metric, not compared (PerfGateOptions::compare_timed)
+    };
+
+    struct PerfGateReport {
+        std::vector<PerfGateResult> results;     // In metric name order
+        std::vector<std::string>    new_metrics; // In the current run only, not gated
+        bool                        passed = true;
+
+        [[nodiscard]] std::string to_text() const; // One line per metric, failures marked
+        [[nodiscard]] std::string to_json() const;
+    };
+
+    /**
+     * Compares every baseline metric to the current one: medians are bootstrapped (both sample sets are resampled)
+     * to get a confidence interval of the regression. A metric fails when the whole interval is above the tolerance,
+     * so noisy timings need a clear regression while counted metrics fail as soon as they exceed the tolerance.
+     * Metrics missing from the current run fail too (a renamed workload must come with a new baseline)
+     */
+    PerfGateReport ComparePerf(PerfBaseline const& baseline, PerfBaseline const& current, PerfGateOptions const& options = {});
+}
+
+#endif // PERF_GATE_HPP
@@ -26,6 +26,7 @@ namespace CS350 {
      * @brief Destructor for the Primitive class.
      */
     Primitive::~Primitive() {
+        glDeleteBuffers(1, &m_EBO);
         glDeleteBuffers(1, &m_VBO);
         glDeleteVertexArrays(1, &m_VAO);
     }
@@ -50,19 +51,29 @@ namespace CS350 {
      */
     void Primitive::Draw(GLenum mode) const {
         Bind();
-        glDrawArrays(mode, 0, m_VertexCount);
+        if (m_IndexCount > 0) {
+            glDrawElements(mode, m_IndexCount, GL_UNSIGNED_INT, (void*)0);
+        }
+        else {
+            glDrawArrays(mode, 0, m_VertexCount);
+        }
         Unbind();
     }
 
     /**
      * @brief Draws a part of the primitive.
      * @param mode The OpenGL primitive type to draw.
-     * @param first The starting index of the vertex array.
+     * @param first The starting index of the vertex array (of the index array, if indexed).
      * @param count The number of vertices to draw.
      */
     void Primitive::DrawPart(GLenum mode, GLint first, GLsizei count) const {
         Bind();
-        glDrawArrays(mode, first, count);
+        if (m_IndexCount > 0) {
+            glDrawElements(mode, count, GL_UNSIGNED_INT, (void*)(static_cast<size_t>(first) * sizeof(GLuint)));
+        }
+        else {
+            glDrawArrays(mode, first, count);
+        }
         Unbind();
     }
 
@@ -93,6 +104,28 @@ namespace CS350 {
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
         glEnableVertexAttribArray(0);
         m_VertexCount = static_cast<GLsizei>(vertices.size());
+        m_IndexCount = 0;
+    }
+
+    /**
+     * @brief Sets up a shared vertex buffer and the indices referencing it.
+     * @param vertices The vector of unique vertices.
+     * @param indices Three indices per triangle.
+     */
+    void Primitive::SetupIndexedBuffer(const std::vector<glm::vec3>& vertices, const std::vector<GLuint>& indices) {
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertices.size()) * static_cast<GLsizeiptr>(sizeof(glm::vec3)), vertices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        // The element buffer binding is part of the VAO state
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size()) * static_cast<GLsizeiptr>(sizeof(GLuint)), indices.data(), GL_STATIC_DRAW);
+        glBindVertexArray(0);
+
+        m_VertexCount = static_cast<GLsizei>(vertices.size());
+        m_IndexCount = static_cast<GLsizei>(indices.size());
     }
 
     /**
@@ -37,6 +37,7 @@ namespace CS350 {
 
 
         void SetupBuffer(const std::vector<glm::vec3>& vertices);
+        void SetupIndexedBuffer(const std::vector<glm::vec3>& vertices, const std::vector<GLuint>& indices);
         void SetupTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
         void SetupPlane(const glm::vec3& position, const glm::vec3& normal, float size);
         GLuint GetVertexCount() const { return m_VertexCount; } // Public function to access m_VertexCount
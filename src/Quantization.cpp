@@ -0,0 +1,165 @@
+#include "Quantization.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace CS350 {
+    namespace {
+        float const cUnorm16Max = 65535.0f;
+        float const cSnorm16Max = 32767.0f;
+
+        float SignNotZero(float v) { return v >= 0.0f ? 1.0f : -1.0f; }
+    }
+
+    PositionQuantizer::PositionQuantizer()
+    : bv_min(0.0f)
+    , scale(0.0f) {}
+
+    PositionQuantizer::PositionQuantizer(vec3 const& bv_min, vec3 const& bv_max)
+    : bv_min(bv_min)
+    , scale((bv_max - bv_min) / cUnorm16Max) {}
+
+    QuantizedPosition PositionQuantizer::encode(vec3 const& p) const {
+        QuantizedPosition q{};
+        for (int i = 0; i < 3; ++i) {
+            float steps = scale[i] > 0.0f ? (p[i] - bv_min[i]) / scale[i] : 0.0f;
+            q[size_t(i)] = static_cast<std::uint16_t>(std::clamp(std::round(steps), 0.0f, cUnorm16Max));
+        }
+        return q;
+    }
+
+    /**
+     * @brief
+     *  Projects the unit sphere on the octahedron |x|+|y|+|z|=1, unfolding the lower half over the corners
+     */
+    OctahedralNormal EncodeOctahedral(vec3 const& n) {
+        float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if (l1 == 0.0f) {
+            return { 0, 0 };
+        }
+        float x = n.x / l1;
+        float y = n.y / l1;
+        if (n.z < 0.0f) {
+            float folded_x = (1.0f - std::abs(y)) * SignNotZero(x);
+            float folded_y = (1.0f - std::abs(x)) * SignNotZero(y);
+            x              = folded_x;
+            y              = folded_y;
+        }
+        return { static_cast<std::int16_t>(std::round(std::clamp(x, -1.0f, 1.0f) * cSnorm16Max)),
+                 static_cast<std::int16_t>(std::round(std::clamp(y, -1.0f, 1.0f) * cSnorm16Max)) };
+    }
+
+    vec3 DecodeOctahedral(OctahedralNormal const& e) {
+        float x = std::max(float(e[0]) / cSnorm16Max, -1.0f);
+        float y = std::max(float(e[1]) / cSnorm16Max, -1.0f);
+        float z = 1.0f - std::abs(x) - std::abs(y);
+        float t = std::max(-z, 0.0f);
+        x += x >= 0.0f ? -t : t;
+        y += y >= 0.0f ? -t : t;
+        return glm::normalize(vec3(x, y, z));
+    }
+
+    /**
+     * @brief
+     *  IEEE 754 binary32 to binary16, round to nearest even. Overflows become infinity
+     */
+    std::uint16_t FloatToHalf(float f) {
+        std::uint32_t bits = 0;
+        std::memcpy(&bits, &f, sizeof(bits));
+        auto          sign     = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+        std::uint32_t exponent = (bits >> 23) & 0xffu;
+        std::uint32_t mantissa = bits & 0x7fffffu;
+
+        if (exponent == 0xffu) { // Inf/NaN
+            return static_cast<std::uint16_t>(sign | 0x7c00u | (mantissa != 0 ? 0x200u : 0u));
+        }
+        int half_exponent = int(exponent) - 127 + 15;
+        if (half_exponent >= 0x1f) {
+            return static_cast<std::uint16_t>(sign | 0x7c00u);
+        }
+        if (half_exponent <= 0) { // Subnormal or zero
+            if (half_exponent < -10) {
+                return sign;
+            }
+            mantissa |= 0x800000u;
+            std::uint32_t shift   = std::uint32_t(14 - half_exponent);
+            std::uint32_t half    = mantissa >> shift;
+            std::uint32_t rest    = mantissa & ((1u << shift) - 1u);
+            std::uint32_t halfway = 1u << (shift - 1u);
+            if (rest > halfway || (rest == halfway && (half & 1u) != 0)) {
+                ++half;
+            }
+            return static_cast<std::uint16_t>(sign | half);
+        }
+        std::uint32_t half = (std::uint32_t(half_exponent) << 10) | (mantissa >> 13);
+        std::uint32_t rest = mantissa & 0x1fffu;
+        if (rest > 0x1000u || (rest == 0x1000u && (half & 1u) != 0)) {
+            ++half; // May carry into the exponent, up to infinity, which is correct
+        }
+        return static_cast<std::uint16_t>(sign | half);
+    }
+
+    float HalfToFloat(std::uint16_t h) {
+        std::uint32_t sign     = std::uint32_t(h & 0x8000u) << 16;
+        std::uint32_t exponent = (h >> 10) & 0x1fu;
+        std::uint32_t mantissa = h & 0x3ffu;
+        std::uint32_t bits     = 0;
+        if (exponent == 0x1fu) {
+            bits = sign | 0x7f800000u | (mantissa << 13);
+        } else if (exponent != 0) {
+            bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        } else if (mantissa != 0) { // Subnormal, normalize
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400u) == 0) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+        } else {
+            bits = sign;
+        }
+        float f = 0.0f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    QuantizedTriangles::QuantizedTriangles(ArrayView<Triangle> triangles) {
+        if (triangles.empty()) {
+            return;
+        }
+        vec3 bv_min = triangles[0][0];
+        vec3 bv_max = triangles[0][0];
+        for (auto const& triangle : triangles) {
+            for (auto const& p : triangle.points) {
+                bv_min = glm::min(bv_min, p);
+                bv_max = glm::max(bv_max, p);
+            }
+        }
+        m_quantizer = PositionQuantizer(bv_min, bv_max);
+        m_vertices.reserve(triangles.size() * 3);
+        for (auto const& triangle : triangles) {
+            for (auto const& p : triangle.points) {
+                m_vertices.push_back(m_quantizer.encode(p));
+            }
+        }
+    }
+
+    QuantizedTriangles::QuantizedTriangles(PositionQuantizer const& quantizer, std::vector<QuantizedPosition> vertices)
+    : m_quantizer(quantizer)
+    , m_vertices(std::move(vertices)) {
+        if (m_vertices.size() % 3 != 0) {
+            throw std::runtime_error("Quantized triangle soup should contain three vertices per triangle");
+        }
+    }
+
+    std::vector<Triangle> QuantizedTriangles::dequantize() const {
+        std::vector<Triangle> triangles(size());
+        for (size_t i = 0; i < triangles.size(); ++i) {
+            triangles[i] = (*this)[i];
+        }
+        return triangles;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef QUANTIZATION_HPP
+#define QUANTIZATION_HPP
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "ArrayView.hpp"
+#include "Math.hpp"
+#include "Shapes.hpp"
+
+namespace CS350 {
+    using QuantizedPosition = std::array<std::uint16_t, 3>; // Unorm16 per component, relative to a bounding volume
+    using OctahedralNormal  = std::array<std::int16_t, 2>;  // Snorm16 octahedral projection
+    using HalfVec2          = std::array<std::uint16_t, 2>; // IEEE half floats
+
+    /**
+     * Maps positions inside [bv_min, bv_max] to 16 bits per component and back
+     */
+    struct PositionQuantizer {
+        vec3 bv_min;
+        vec3 scale; // Size of one quantization step per axis
+
+        PositionQuantizer();
+        PositionQuantizer(vec3 const& bv_min, vec3 const& bv_max);
+
+        [[nodiscard]] QuantizedPosition encode(vec3 const& p) const;
+        [[nodiscard]] vec3              decode(QuantizedPosition const& q) const {
+            return vec3(bv_min.x + float(q[0]) * scale.x, bv_min.y + float(q[1]) * scale.y, bv_min.z + float(q[2]) * scale.z);
+        }
+    };
+
+    OctahedralNormal EncodeOctahedral(vec3 const& n);
+    vec3             DecodeOctahedral(OctahedralNormal const& e);
+    std::uint16_t    FloatToHalf(float f);
+    float            HalfToFloat(std::uint16_t h);
+
+    /**
+     * Triangle soup with 16 bit positions (18 bytes per triangle instead of 36).
+     * Triangles are dequantized on access, trees must be built from dequantize() so that they bound the
+     * exact geometry that is intersected.
+     */
+    class QuantizedTriangles {
+      private:
+        PositionQuantizer              m_quantizer;
+        std::vector<QuantizedPosition> m_vertices; // Three per triangle
+
+      public:
+        QuantizedTriangles() = default;
+        explicit QuantizedTriangles(ArrayView<Triangle> triangles);
+        QuantizedTriangles(PositionQuantizer const& quantizer, std::vector<QuantizedPosition> vertices);
+
+        [[nodiscard]] size_t                   size() const noexcept { return m_vertices.size() / 3; }
+        [[nodiscard]] bool                     empty() const noexcept { return m_vertices.empty(); }
+        [[nodiscard]] size_t                   memory_bytes() const noexcept { return m_vertices.size() * sizeof(QuantizedPosition); }
+        [[nodiscard]] PositionQuantizer const& quantizer() const noexcept { return m_quantizer; }
+        [[nodiscard]] std::vector<Triangle>    dequantize() const;
+
+        Triangle operator[](size_t i) const {
+            return { { m_quantizer.decode(m_vertices[i * 3 + 0]), m_quantizer.decode(m_vertices[i * 3 + 1]), m_quantizer.decode(m_vertices[i * 3 + 2]) } };
+        }
+    };
+}
+
+#endif // QUANTIZATION_HPP
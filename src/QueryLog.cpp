@@ -0,0 +1,205 @@
+#include "QueryLog.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fmt/format.h>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+namespace CS350 {
+    namespace {
+        char const     cQuerySignature[8] = { 'C', 'S', '3', '5', '0', 'Q', 'R', 'Y' };
+        uint32_t const cQueryVersion      = 1;
+        size_t const   cQueryHeaderSize   = 16; // Signature (8), version (4), record size (4)
+
+        // Records are mapped as is
+        static_assert(sizeof(QueryRecord) == 9 * sizeof(float), "Query records must be packed");
+        static_assert(std::is_trivially_copyable_v<QueryRecord>, "Query records must be trivially copyable");
+
+        void WriteHeader(std::ofstream& os)
+        {
+            uint32_t const recordSize = sizeof(QueryRecord);
+            os.write(cQuerySignature, sizeof(cQuerySignature));
+            os.write(reinterpret_cast<char const*>(&cQueryVersion), sizeof(cQueryVersion));
+            os.write(reinterpret_cast<char const*>(&recordSize), sizeof(recordSize));
+        }
+    }
+
+    QueryRecorder::QueryRecorder(std::string const& path, unsigned sample_every, size_t flush_every)
+        : m_buffer_count(std::max(std::thread::hardware_concurrency(), 1u) * 2)
+        , m_buffers(std::make_unique<Buffer[]>(m_buffer_count))
+        , m_sample_every(std::max(sample_every, 1u))
+        , m_flush_every(std::max<size_t>(flush_every, 1))
+    {
+        // Existing logs are appended to: header checked, a trailing partial record dropped so new records stay aligned
+        std::error_code ec;
+        size_t          size = std::filesystem::exists(path, ec) ? size_t(std::filesystem::file_size(path, ec)) : 0;
+        if (ec) {
+            throw std::runtime_error("Cannot read file: " + path);
+        }
+        if (size != 0) {
+            size_t const records = LoadQueryLogView(path).records.size();
+            size_t const aligned = cQueryHeaderSize + records * sizeof(QueryRecord);
+            if (aligned != size) {
+                std::filesystem::resize_file(path, aligned);
+            }
+        }
+        m_file.open(path, std::ios::binary | std::ios::app);
+        if (size == 0) {
+            WriteHeader(m_file);
+        }
+        if (!m_file) {
+            throw std::runtime_error("Cannot write file: " + path);
+        }
+    }
+
+    QueryRecorder::~QueryRecorder()
+    {
+        flush();
+    }
+
+    void QueryRecorder::record(Ray const& ray, QueryType type, float t_min, float t_max)
+    {
+        if (m_seen.fetch_add(1, std::memory_order_relaxed) % m_sample_every != 0) {
+            return;
+        }
+        m_recorded.fetch_add(1, std::memory_order_relaxed);
+
+        // The full batch is written outside of the buffer lock, other threads of this buffer keep recording
+        auto&                    buffer = m_buffers[std::hash<std::thread::id>{}(std::this_thread::get_id()) % m_buffer_count];
+        std::vector<QueryRecord> full;
+        {
+            std::lock_guard<std::mutex> lock(buffer.mutex);
+            buffer.records.push_back({ ray.origin, ray.direction, t_min, t_max, type });
+            if (buffer.records.size() < m_flush_every) {
+                return;
+            }
+            full.swap(buffer.records);
+        }
+        write(full);
+    }
+
+    void QueryRecorder::flush()
+    {
+        for (size_t i = 0; i < m_buffer_count; ++i) {
+            std::vector<QueryRecord> records;
+            {
+                std::lock_guard<std::mutex> lock(m_buffers[i].mutex);
+                records.swap(m_buffers[i].records);
+            }
+            write(records);
+        }
+        std::lock_guard<std::mutex> lock(m_file_mutex);
+        m_file.flush();
+    }
+
+    size_t QueryRecorder::seen() const
+    {
+        return m_seen.load(std::memory_order_relaxed);
+    }
+
+    size_t QueryRecorder::recorded() const
+    {
+        return m_recorded.load(std::memory_order_relaxed);
+    }
+
+    void QueryRecorder::write(std::vector<QueryRecord> const& records)
+    {
+        if (records.empty()) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_file_mutex);
+        m_file.write(reinterpret_cast<char const*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(QueryRecord)));
+    }
+
+    QueryLogView LoadQueryLogView(std::string const& path)
+    {
+        QueryLogView view;
+        view.mapping          = std::make_shared<MappedFile const>(path);
+        std::byte const* data = view.mapping->data();
+        size_t           size = view.mapping->size();
+
+        if (size < cQueryHeaderSize || std::memcmp(data, cQuerySignature, sizeof(cQuerySignature)) != 0) {
+            throw std::runtime_error("Invalid file signature in file: " + path);
+        }
+        uint32_t version    = 0;
+        uint32_t recordSize = 0;
+        std::memcpy(&version, data + 8, sizeof(version));
+        std::memcpy(&recordSize, data + 12, sizeof(recordSize));
+        if (version != cQueryVersion || recordSize != sizeof(QueryRecord)) {
+            throw std::runtime_error("Unsupported query log version " + std::to_string(version) + " in file: " + path);
+        }
+        size_t count = (size - cQueryHeaderSize) / sizeof(QueryRecord);
+        view.records = ArrayView<QueryRecord>(reinterpret_cast<QueryRecord const*>(data + cQueryHeaderSize), count);
+        return view;
+    }
+
+    void SaveQueryLog(std::string const& path, ArrayView<QueryRecord> records)
+    {
+        std::ofstream os(path, std::ios::binary | std::ios::trunc);
+        WriteHeader(os);
+        os.write(reinterpret_cast<char const*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(QueryRecord)));
+        if (!os) {
+            throw std::runtime_error("Cannot write file: " + path);
+        }
+    }
+
+    ReplayReport ReplayQueries(KdTree const& tree, ArrayView<Triangle> triangles, ArrayView<QueryRecord> queries, unsigned repetitions)
+    {
+        using Clock = std::chrono::steady_clock;
+        ReplayReport  report;
+        QueryProfiler profiler(false);
+
+        for (auto const& query : queries) {
+            report.closest_queries   += query.type == QueryType::Occlusion ? 0 : 1;
+            report.occlusion_queries += query.type == QueryType::Occlusion ? 1 : 0;
+            report.ranged_queries    += query.t_min > 0.0f ? 1 : 0;
+        }
+
+        auto const start = Clock::now();
+        for (unsigned r = 0; r < repetitions; ++r) {
+            report.closest_hits   = 0;
+            report.occlusion_hits = 0;
+            for (auto const& query : queries) {
+                auto hit = profiler.get_closest(tree, triangles, Ray(query.origin, query.direction));
+                if (hit && query.t_min <= 0.0f && hit.t <= query.t_max) {
+                    (query.type == QueryType::Occlusion ? report.occlusion_hits : report.closest_hits) += 1;
+                }
+            }
+        }
+        report.hits               = report.closest_hits + report.occlusion_hits;
+        report.elapsed_ms         = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        report.latency_ns         = profiler.histograms().latency_ns;
+        report.queries            = size_t(report.latency_ns.count());
+        report.queries_per_second = report.elapsed_ms > 0.0 ? double(report.queries) * 1000.0 / report.elapsed_ms : 0.0;
+        report.p50_ns             = double(report.latency_ns.percentile(0.5));
+        report.p90_ns             = double(report.latency_ns.percentile(0.9));
+        report.p99_ns             = double(report.latency_ns.percentile(0.99));
+        report.p999_ns            = double(report.latency_ns.percentile(0.999));
+        report.max_ns             = double(report.latency_ns.max());
+        return report;
+    }
+
+    std::string ReplayReport::to_json() const
+    {
+        std::ostringstream os;
+        os << "{\n"
+           << fmt::format("  \"queries\": {},\n", queries)
+           << fmt::format("  \"closest\": {{ \"queries\": {}, \"hits\": {} }},\n", closest_queries, closest_hits)
+           << fmt::format("  \"occlusion\": {{ \"queries\": {}, \"hits\": {}, \"answered_as\": \"closest\" }},\n", occlusion_queries, occlusion_hits)
+           << fmt::format("  \"ranged_queries_not_in_hits\": {},\n", ranged_queries)
+           << fmt::format("  \"hits\": {},\n", hits)
+           << fmt::format("  \"elapsed_ms\": {:.3f},\n", elapsed_ms)
+           << fmt::format("  \"queries_per_second\": {:.1f},\n", queries_per_second)
+           << fmt::format("  \"latency_ns\": {{ \"p50\": {:.1f}, \"p90\": {:.1f}, \"p99\": {:.1f}, \"p999\": {:.1f}, \"max\": {:.1f} }},\n",
+                          p50_ns, p90_ns, p99_ns, p999_ns, max_ns)
+           << "  \"latency_histogram_ns\": " << latency_ns.to_json() << "\n"
+           << "}\n";
+        return os.str();
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef QUERY_LOG_HPP
+#define QUERY_LOG_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ArrayView.hpp"
+#include "KdTree.hpp"
+#include "LatencyHistogram.hpp"
+#include "MappedFile.hpp"
+#include "Shapes.hpp"
+
+namespace CS350 {
+    /**
+     * Query log format description.
+     *
+     * 	- Filename example: "traffic.cs350_queries".
+     * 	- File starts with the signature "CS350QRY" (8 bytes).
+     * 	- A format version follows (unsigned 4 bytes).
+     * 	- The record size follows (unsigned 4 bytes), 36 for version 1.
+     * 	- Packed records follow until the end of the file, laid out exactly as QueryRecord:
+     * 		- Origin and direction (3 floats each)
+     * 		- t_min and t_max (1 float each)
+     * 		- Query type (unsigned 4 bytes)
+     * 	- There is no record count, a log can be appended to and a trailing partial record (interrupted write) is ignored.
+     */
+
+    enum class QueryType : uint32_t {
+        Closest   = 0, // Closest hit in [t_min, t_max]
+        Occlusion = 1, // Any hit in [t_min, t_max]
+    };
+
+    struct QueryRecord {
+        vec3      origin;
+        vec3      direction;
+        float     t_min;
+        float     t_max;
+        QueryType type;
+    };
+
+    /**
+     * Appends queries to a log, safe to call from any thread.
+     * 	- An existing log is appended to (its header must match, a trailing partial record is dropped), a new one created
+     * 	- Only one query out of sample_every is kept (counted over all threads), skipped queries take no lock
+     * 	- Records are batched in per-thread buffers, written every flush_every records, on flush() and on destruction
+     */
+    class QueryRecorder {
+      public:
+        explicit QueryRecorder(std::string const& path, unsigned sample_every = 1, size_t flush_every = 4096);
+        ~QueryRecorder();
+        QueryRecorder(QueryRecorder const&)            = delete;
+        QueryRecorder& operator=(QueryRecorder const&) = delete;
+
+        void record(Ray const& ray, QueryType type = QueryType::Closest, float t_min = 0.0f, float t_max = std::numeric_limits<float>::max());
+        void flush();
+
+        [[nodiscard]] size_t seen() const;     // Queries passed to record
+        [[nodiscard]] size_t recorded() const; // Queries kept
+
+      private:
+        // Threads are spread over the buffers by id, so they rarely share one
+        struct alignas(64) Buffer {
+            std::mutex               mutex;
+            std::vector<QueryRecord> records;
+        };
+
+        void write(std::vector<QueryRecord> const& records);
+
+        std::mutex                m_file_mutex;
+        std::ofstream             m_file;
+        size_t                    m_buffer_count;
+        std::unique_ptr<Buffer[]> m_buffers;
+        unsigned                  m_sample_every;
+        size_t                    m_flush_every;
+        std::atomic<size_t>       m_seen{ 0 };
+        std::atomic<size_t>       m_recorded{ 0 };
+    };
+
+    /**
+     * Zero-copy view of a query log, records point directly into the file mapping
+     */
+    struct QueryLogView {
+        ArrayView<QueryRecord>            records;
+        std::shared_ptr<MappedFile const> mapping;
+    };
+
+    QueryLogView LoadQueryLogView(std::string const& path);
+
+    /**
+     * Writes a whole log at once (e.g. a synthetic or filtered workload)
+     */
+    void SaveQueryLog(std::string const& path, ArrayView<QueryRecord> records);
+
+    /**
+     * Result of replaying a log, latencies are per query (CycleClock, including the timer overhead).
+     * Percentiles come from latency_ns, so they are within its precision (under 2%) and never under reported
+     */
+    struct ReplayReport {
+        size_t    queries            = 0; // Queries answered (records * repetitions)
+        size_t    closest_queries    = 0; // Records of each type
+        size_t    occlusion_queries  = 0;
+        size_t    ranged_queries     = 0; // Records with t_min > 0, timed but left out of the hits (see ReplayQueries)
+        size_t    hits               = 0; // Of the last repetition, closest_hits + occlusion_hits
+        size_t    closest_hits       = 0;
+        size_t    occlusion_hits     = 0;
+        double    elapsed_ms         = 0.0;
+        double    queries_per_second = 0.0;
+        double    p50_ns             = 0.0;
+        double    p90_ns             = 0.0;
+        double    p99_ns             = 0.0;
+        double    p999_ns            = 0.0;
+        double    max_ns             = 0.0;
+        Histogram latency_ns;
+
+        [[nodiscard]] std::string to_json() const;
+    };
+
+    /**
+     * Runs every query of a log against a tree, on the calling thread, repetitions times.
+     * The tree has neither any hit nor range limited traversal:
+     * 	- Occlusion queries are answered by a closest hit search, their latencies are an upper bound
+     * 	- The closest hit is checked against t_max. With t_min > 0 a hit before t_min hides the ones after it,
+     * 	  so those records are replayed for latency only and counted in ranged_queries instead of the hits
+     */
+    ReplayReport ReplayQueries(KdTree const& tree, ArrayView<Triangle> triangles, ArrayView<QueryRecord> queries, unsigned repetitions = 1);
+}
+
+#endif // QUERY_LOG_HPP
@@ -0,0 +1,374 @@
+#include "RayCaster.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <fmt/format.h>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <lodepng.h>
+#include <sstream>
+#include <stdexcept>
+
+namespace CS350 {
+    namespace {
+        float const cPi             = 3.14159265358979f;
+        float const cAmbient        = 0.25f;
+        float const cOffsetFraction = 1e-4f; // Secondary ray origins leave the surface by this fraction of the scene diagonal
+        vec3 const  cAlbedo(0.9f, 0.85f, 0.75f);
+        vec3 const  cSkyTop(0.35f, 0.4f, 0.5f);
+        vec3 const  cSkyBottom(0.1f, 0.1f, 0.15f);
+
+        uint64_t Mix(uint64_t x)
+        {
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+            return x ^ (x >> 31);
+        }
+
+        /**
+         * Splitmix64 stream keyed by (seed, pixel)
+         */
+        struct PixelRng {
+            PixelRng(uint32_t seed, uint64_t pixel) : state(Mix(uint64_t(seed) * 0x9e3779b97f4a7c15ull ^ Mix(pixel + 1))) {}
+
+            float uniform() // [0, 1)
+            {
+                state += 0x9e3779b97f4a7c15ull;
+                return float(Mix(state) >> 40) * (1.0f / 16777216.0f);
+            }
+
+            uint64_t state;
+        };
+
+        /**
+         * Pinhole camera basis, right and up scaled to the image plane at distance 1
+         */
+        struct View {
+            vec3 eye;
+            vec3 forward;
+            vec3 right;
+            vec3 up;
+        };
+
+        View MakeView(Camera const& camera)
+        {
+            vec3 forward = camera.target() - camera.position();
+            forward      = glm::length(forward) > 0.0f ? glm::normalize(forward) : vec3(0, 0, -1);
+            vec3 right   = glm::cross(forward, vec3(0, 1, 0));
+            right        = glm::length(right) > 0.0f ? glm::normalize(right) : vec3(1, 0, 0);
+            vec3 up      = glm::cross(right, forward);
+            float scale  = std::tan(glm::radians(camera.fov_deg()) * 0.5f);
+            return { camera.position(), forward, right * scale, up * scale };
+        }
+
+        Ray ThroughPixel(View const& view, RenderSettings const& settings, unsigned x, unsigned y)
+        {
+            float aspect = float(settings.width) / float(settings.height);
+            float u      = ((float(x) + 0.5f) / float(settings.width) * 2.0f - 1.0f) * aspect;
+            float v      = 1.0f - (float(y) + 0.5f) / float(settings.height) * 2.0f;
+            return Ray(view.eye, view.forward + view.right * u + view.up * v);
+        }
+
+        /**
+         * Dark blue (cold) to red (hot), value in [0, 1]
+         */
+        vec3 HeatColor(float value)
+        {
+            static vec3 const cStops[] = { vec3(0.05f, 0.03f, 0.2f), vec3(0.1f, 0.3f, 0.9f), vec3(0.1f, 0.8f, 0.3f), vec3(0.95f, 0.85f, 0.1f), vec3(0.9f, 0.1f, 0.05f) };
+            float x     = std::clamp(value, 0.0f, 1.0f) * 4.0f;
+            auto  index = std::min(size_t(x), size_t(3));
+            return cStops[index] + (cStops[index + 1] - cStops[index]) * (x - float(index));
+        }
+
+        void CountEvent(void* user, TraceSink::Event event)
+        {
+            auto* counts = static_cast<uint32_t*>(user);
+            ++counts[event.kind == TraceSink::Kind::Node ? 0 : 1];
+        }
+
+        uint8_t ToByte(float value)
+        {
+            return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+
+        void WritePixel(Image& image, unsigned x, unsigned y, vec3 color)
+        {
+            uint8_t* out = image.pixel(x, y);
+            out[0]       = ToByte(color.x);
+            out[1]       = ToByte(color.y);
+            out[2]       = ToByte(color.z);
+            out[3]       = 255;
+        }
+
+        /**
+         * Everything the tiles share
+         */
+        struct Frame {
+            RenderSettings const&  settings;
+            KdTree const&          tree;
+            ArrayView<Triangle>    triangles;
+            Image&                 image;
+            std::vector<uint32_t>& counts; // Heatmap modes only
+            View                   view;
+            vec3                   light;
+            float                  offset;
+            float                  ao_distance;
+            unsigned               tiles_x;
+            unsigned               tile_count;
+            std::atomic<size_t>    shadow_rays{ 0 };
+            std::atomic<size_t>    ao_rays{ 0 };
+            std::atomic<size_t>    hits{ 0 };
+        };
+
+        vec3 Shade(Frame& frame, Ray const& primary, KdTree::Intersection hit, uint64_t pixel, size_t& shadow_rays, size_t& ao_rays)
+        {
+            auto const& tri    = frame.triangles[hit.triangle_index];
+            vec3        normal = glm::cross(tri[1] - tri[0], tri[2] - tri[0]);
+            float       length = glm::length(normal);
+            normal             = length > 0.0f ? normal / length : -primary.direction;
+            normal             = glm::dot(normal, primary.direction) > 0.0f ? -normal : normal;
+            vec3 point         = primary.origin + primary.direction * hit.t + normal * frame.offset;
+
+            float diffuse = std::max(0.0f, glm::dot(normal, frame.light));
+            if (diffuse > 0.0f && frame.settings.shadows) {
+                ++shadow_rays;
+                if (frame.tree.get_closest<Instrumentation::None>(frame.triangles, Ray(point, frame.light), nullptr)) {
+                    diffuse = 0.0f;
+                }
+            }
+
+            float ambient = cAmbient;
+            if (frame.settings.ao_samples > 0) {
+                // Cosine weighted directions around the normal
+                vec3     helper = std::abs(normal.x) < 0.9f ? vec3(1, 0, 0) : vec3(0, 1, 0);
+                vec3     t0     = glm::normalize(glm::cross(normal, helper));
+                vec3     t1     = glm::cross(normal, t0);
+                PixelRng rng(frame.settings.seed, pixel);
+                unsigned open   = 0;
+                for (unsigned s = 0; s < frame.settings.ao_samples; ++s) {
+                    float r        = std::sqrt(rng.uniform());
+                    float a        = 2.0f * cPi * rng.uniform();
+                    vec3  dir      = t0 * (r * std::cos(a)) + t1 * (r * std::sin(a)) + normal * std::sqrt(std::max(0.0f, 1.0f - r * r));
+                    auto  occluder = frame.tree.get_closest<Instrumentation::None>(frame.triangles, Ray(point, dir), nullptr);
+                    open += !occluder || occluder.t > frame.ao_distance ? 1 : 0;
+                }
+                ao_rays += frame.settings.ao_samples;
+                ambient *= float(open) / float(frame.settings.ao_samples);
+            }
+            float value = ambient + (1.0f - cAmbient) * diffuse;
+            return cAlbedo * value;
+        }
+
+        void RenderTile(Frame& frame, unsigned tile)
+        {
+            auto const& settings    = frame.settings;
+            unsigned    x0          = (tile % frame.tiles_x) * settings.tile_size;
+            unsigned    y0          = (tile / frame.tiles_x) * settings.tile_size;
+            unsigned    x1          = std::min(x0 + settings.tile_size, settings.width);
+            unsigned    y1          = std::min(y0 + settings.tile_size, settings.height);
+            size_t      shadow_rays = 0; // Local counts, added to the frame once per tile
+            size_t      ao_rays     = 0;
+            size_t      hits        = 0;
+
+            for (unsigned y = y0; y < y1; ++y) {
+                for (unsigned x = x0; x < x1; ++x) {
+                    Ray      primary = ThroughPixel(frame.view, settings, x, y);
+                    uint64_t pixel   = uint64_t(y) * settings.width + x;
+                    if (settings.mode != RenderMode::Shaded) {
+                        // Colored once the whole image is known
+                        uint32_t           counts[2] = {}; // Nodes, triangles
+                        TraceSink          sink(CountEvent, counts);
+                        KdTree::DebugStats stats;
+                        stats.sink = &sink;
+                        hits += frame.tree.get_closest<Instrumentation::Trace>(frame.triangles, primary, &stats) ? 1 : 0;
+                        frame.counts[pixel] = counts[settings.mode == RenderMode::NodesVisited ? 0 : 1];
+                        continue;
+                    }
+
+                    auto hit   = frame.tree.get_closest<Instrumentation::None>(frame.triangles, primary, nullptr);
+                    vec3 color = cSkyTop + (cSkyBottom - cSkyTop) * (float(y) / float(settings.height));
+                    if (hit) {
+                        ++hits;
+                        color = Shade(frame, primary, hit, pixel, shadow_rays, ao_rays);
+                    }
+                    WritePixel(frame.image, x, y, color);
+                }
+            }
+            frame.shadow_rays += shadow_rays;
+            frame.ao_rays += ao_rays;
+            frame.hits += hits;
+        }
+
+        /**
+         * Tiles claimed and finished, shared with the pool tasks. A task that starts once every tile is claimed
+         * (e.g. after the render returned) leaves without touching the frame
+         */
+        struct TileQueue {
+            Frame*                  frame;
+            unsigned                count;
+            std::atomic<unsigned>   next{ 0 };
+            unsigned                done = 0; // Guarded by mutex
+            std::mutex              mutex;
+            std::condition_variable all_done;
+        };
+
+        void RenderTiles(TileQueue& queue)
+        {
+            for (unsigned tile = queue.next++; tile < queue.count; tile = queue.next++) {
+                RenderTile(*queue.frame, tile);
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (++queue.done == queue.count) {
+                    queue.all_done.notify_all();
+                }
+            }
+        }
+    }
+
+    RenderResult RenderKdTree(Camera const& camera, KdTree const& tree, ArrayView<Triangle> triangles, RenderSettings const& settings)
+    {
+        if (settings.width == 0 || settings.height == 0 || settings.tile_size == 0) {
+            throw std::runtime_error(fmt::format("Invalid render size {}x{} (tiles of {})", settings.width, settings.height, settings.tile_size));
+        }
+        auto const start = std::chrono::steady_clock::now();
+
+        RenderResult result;
+        result.image = Image(settings.width, settings.height);
+
+        // Scene scale, for ray offsets and the ambient occlusion radius
+        float diagonal = 1.0f;
+        if (!tree.aabbs().empty()) {
+            Aabb const& bounds = tree.aabbs()[0];
+            diagonal           = std::max(glm::length(bounds.max - bounds.min), 1e-6f);
+        }
+        if (settings.mode != RenderMode::Shaded) {
+            result.counts.resize(size_t(settings.width) * settings.height);
+        }
+        unsigned tiles_x = (settings.width + settings.tile_size - 1) / settings.tile_size;
+        unsigned tiles_y = (settings.height + settings.tile_size - 1) / settings.tile_size;
+        Frame    frame{ settings, tree, triangles, result.image, result.counts, MakeView(camera), glm::normalize(settings.light_direction),
+                        diagonal * cOffsetFraction, diagonal * settings.ao_distance, tiles_x, tiles_x * tiles_y };
+
+        // The calling thread renders too, pool threads join as they become free. Only the tiles are waited for, not
+        // the tasks: called from a task of the same pool (or with the pool busy), the calling thread renders them all
+        unsigned threads = 1;
+        auto     queue   = std::make_shared<TileQueue>();
+        queue->frame     = &frame;
+        queue->count     = frame.tile_count;
+        if (settings.pool != nullptr && frame.tile_count > 1) {
+            for (unsigned t = 0; t < settings.pool->size(); ++t) {
+                settings.pool->post([queue] { RenderTiles(*queue); });
+            }
+            threads += settings.pool->size();
+        }
+        RenderTiles(*queue);
+        {
+            std::unique_lock<std::mutex> lock(queue->mutex);
+            queue->all_done.wait(lock, [&] { return queue->done == queue->count; });
+        }
+
+        auto& stats = result.stats;
+        if (!result.counts.empty()) {
+            stats.heatmap_max  = *std::max_element(result.counts.begin(), result.counts.end());
+            stats.heatmap_mean = double(std::accumulate(result.counts.begin(), result.counts.end(), uint64_t(0))) / double(result.counts.size());
+            float const scale  = 1.0f / float(std::max(1u, settings.heatmap_max != 0 ? settings.heatmap_max : stats.heatmap_max));
+            for (unsigned y = 0; y < settings.height; ++y) {
+                for (unsigned x = 0; x < settings.width; ++x) {
+                    WritePixel(result.image, x, y, HeatColor(float(result.counts[size_t(y) * settings.width + x]) * scale));
+                }
+            }
+        }
+
+        stats.primary_rays     = size_t(settings.width) * settings.height;
+        stats.shadow_rays      = frame.shadow_rays;
+        stats.ao_rays          = frame.ao_rays;
+        stats.hits             = frame.hits;
+        stats.tiles            = frame.tile_count;
+        stats.threads          = threads;
+        stats.elapsed_ms       = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stats.mrays_per_second = stats.elapsed_ms > 0.0 ? double(stats.total_rays()) / (stats.elapsed_ms * 1000.0) : 0.0;
+        return result;
+    }
+
+    std::string RenderStats::to_json() const
+    {
+        std::ostringstream os;
+        os << "{\n"
+           << fmt::format("  \"primary_rays\": {},\n", primary_rays)
+           << fmt::format("  \"shadow_rays\": {},\n", shadow_rays)
+           << fmt::format("  \"ao_rays\": {},\n", ao_rays)
+           << fmt::format("  \"hits\": {},\n", hits)
+           << fmt::format("  \"tiles\": {},\n", tiles)
+           << fmt::format("  \"threads\": {},\n", threads)
+           << fmt::format("  \"elapsed_ms\": {:.3f},\n", elapsed_ms)
+           << fmt::format("  \"mrays_per_second\": {:.3f},\n", mrays_per_second)
+           << fmt::format("  \"heatmap_max\": {},\n", heatmap_max)
+           << fmt::format("  \"heatmap_mean\": {:.3f}\n", heatmap_mean)
+           << "}\n";
+        return os.str();
+    }
+
+    char const* RenderModeName(RenderMode mode)
+    {
+        switch (mode) {
+            case RenderMode::Shaded: return "shaded";
+            case RenderMode::NodesVisited: return "nodes";
+            case RenderMode::TrianglesTested: return "triangles";
+        }
+        return "unknown";
+    }
+
+    RenderMode ParseRenderMode(std::string const& name)
+    {
+        for (auto mode : { RenderMode::Shaded, RenderMode::NodesVisited, RenderMode::TrianglesTested }) {
+            if (name == RenderModeName(mode)) {
+                return mode;
+            }
+        }
+        throw std::runtime_error("Unknown render mode: " + name);
+    }
+
+    Ray PrimaryRay(Camera const& camera, RenderSettings const& settings, unsigned x, unsigned y)
+    {
+        return ThroughPixel(MakeView(camera), settings, x, y);
+    }
+
+    void SavePng(std::string const& path, Image const& image)
+    {
+        auto error = lodepng::encode(path, image.rgba, image.width, image.height);
+        if (error) {
+            throw std::runtime_error(fmt::format("Could not save {}: {}", path, lodepng_error_text(error)));
+        }
+    }
+
+    Image LoadPng(std::string const& path)
+    {
+        Image result;
+        auto  error = lodepng::decode(result.rgba, result.width, result.height, path);
+        if (error) {
+            throw std::runtime_error(fmt::format("Could not load {}: {}", path, lodepng_error_text(error)));
+        }
+        return result;
+    }
+
+    double ImageDifference(Image const& a, Image const& b, int tolerance)
+    {
+        if (a.width != b.width || a.height != b.height) {
+            throw std::runtime_error(fmt::format("Cannot compare a {}x{} image with a {}x{} one", a.width, a.height, b.width, b.height));
+        }
+        size_t pixels    = size_t(a.width) * a.height;
+        size_t different = 0;
+        for (size_t p = 0; p < pixels; ++p) {
+            for (size_t c = 0; c < 4; ++c) {
+                if (std::abs(int(a.rgba[p * 4 + c]) - int(b.rgba[p * 4 + c])) > tolerance) {
+                    ++different;
+                    break;
+                }
+            }
+        }
+        return pixels > 0 ? double(different) / double(pixels) : 0.0;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef RAY_CASTER_HPP
+#define RAY_CASTER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ArrayView.hpp"
+#include "Camera.hpp"
+#include "KdTree.hpp"
+#include "Math.hpp"
+#include "Shapes.hpp"
+#include "ThreadPool.hpp"
+
+namespace CS350 {
+    /**
+     * 8 bit RGBA image, rows top to bottom
+     */
+    struct Image {
+        unsigned             width  = 0;
+        unsigned             height = 0;
+        std::vector<uint8_t> rgba;
+
+        Image() = default;
+        Image(unsigned w, unsigned h) : width(w), height(h), rgba(size_t(w) * h * 4, 0) {}
+
+        [[nodiscard]] uint8_t*       pixel(unsigned x, unsigned y) { return rgba.data() + (size_t(y) * width + x) * 4; }
+        [[nodiscard]] uint8_t const* pixel(unsigned x, unsigned y) const { return rgba.data() + (size_t(y) * width + x) * 4; }
+    };
+
+    void  SavePng(std::string const& path, Image const& image); // Throws on encoding or writing errors
+    Image LoadPng(std::string const& path);                     // Throws on reading or decoding errors
+
+    /**
+     * Fraction of pixels where a channel differs by more than tolerance (visual regression checks).
+     * Throws if the sizes differ
+     */
+    double ImageDifference(Image const& a, Image const& b, int tolerance = 2);
+
+    /**
+     * What pixels show
+     * 	- Shaded:          Lambert shading, with the shadow and ambient occlusion settings
+     * 	- NodesVisited:    Heatmap of the nodes the primary ray traversed (DebugStats trace)
+     * 	- TrianglesTested: Heatmap of the triangles the primary ray was tested against
+     * Heatmaps cast primary rays only, missed pixels included (they still traverse the tree)
+     */
+    enum class RenderMode { Shaded, NodesVisited, TrianglesTested };
+
+    char const* RenderModeName(RenderMode mode);           // "shaded", "nodes", "triangles"
+    RenderMode  ParseRenderMode(std::string const& name); // Throws on unknown names
+
+    struct RenderSettings {
+        RenderMode  mode            = RenderMode::Shaded;
+        unsigned    heatmap_max     = 0;                       // Count shown with the hottest color, 0 is the image maximum (fix it to compare configs)
+        unsigned    width           = 512;
+        unsigned    height          = 512;
+        unsigned    tile_size       = 16;                      // Square tiles, the unit of work of the threads
+        bool        shadows         = true;                    // One shadow ray per hit towards light_direction
+        vec3        light_direction = vec3(0.4f, 0.8f, 0.45f); // Towards the (directional) light
+        unsigned    ao_samples      = 0;                       // Ambient occlusion rays per hit, cosine weighted
+        float       ao_distance     = 0.1f;                    // Relative to the scene bounds diagonal
+        uint32_t    seed            = 0x350;                   // AO directions, per pixel: images do not depend on the thread count
+        ThreadPool* pool            = nullptr;                 // When null, renders on the calling thread
+    };
+
+    struct RenderStats {
+        size_t   primary_rays     = 0;
+        size_t   shadow_rays      = 0;
+        size_t   ao_rays          = 0;
+        size_t   hits             = 0;   // Primary rays that hit
+        unsigned tiles            = 0;
+        unsigned threads          = 0;
+        double   elapsed_ms       = 0.0;
+        double   mrays_per_second = 0.0; // All rays
+        uint32_t heatmap_max      = 0;   // Heatmap modes: highest count of the image
+        double   heatmap_mean     = 0.0; // Heatmap modes: average count per pixel
+
+        [[nodiscard]] size_t      total_rays() const noexcept { return primary_rays + shadow_rays + ao_rays; }
+        [[nodiscard]] std::string to_json() const;
+    };
+
+    struct RenderResult {
+        Image                 image;
+        RenderStats           stats;
+        std::vector<uint32_t> counts; // Heatmap modes: count of every pixel, rows top to bottom
+    };
+
+    /**
+     * Primary ray through the center of pixel (x, y), as cast by RenderKdTree
+     */
+    Ray PrimaryRay(Camera const& camera, RenderSettings const& settings, unsigned x, unsigned y);
+
+    /**
+     * Headless ray cast of a tree: one primary ray per pixel center, plus shadow and ambient occlusion rays at the hits.
+     * 	- Uses the camera position, target and vertical field of view (not its matrices), with the image aspect ratio
+     * 	- Lambert shading of flat triangles, missed pixels get a vertical gradient (see RenderMode for heatmaps)
+     * 	- Tiles are claimed by the threads in order from a shared counter, so busy threads take fewer tiles
+     * 	- Returns once every tile is rendered, without waiting for pool tasks that found none left: it can be called
+     * 	  from a task of settings.pool itself (the calling thread then renders whatever the busy pool does not)
+     * 	- Uninstrumented queries, the image is the same for any thread count
+     */
+    RenderResult RenderKdTree(Camera const& camera, KdTree const& tree, ArrayView<Triangle> triangles, RenderSettings const& settings = {});
+}
+
+#endif // RAY_CASTER_HPP
@@ -0,0 +1,115 @@
+#include "SceneLoader.hpp"
+
+#include <exception>
+#include <utility>
+
+namespace CS350 {
+
+    namespace {
+        using PrimitivePtr = std::shared_ptr<CS350LoadedPrimitive const>;
+
+        /**
+         * State shared by the tasks of one load
+         */
+        struct SceneLoadState
+        {
+            std::vector<std::string>                                                 files;
+            KdTree::Config                                                           cfg;
+            std::vector<std::promise<PrimitivePtr>>                                  promises;
+            std::function<void(size_t, CS350LoadedPrimitive const&)>                 on_ready;
+        };
+
+        void BuildPrimitive(std::shared_ptr<SceneLoadState> const& state, size_t index, std::shared_ptr<CS350LoadedPrimitive> primitive)
+        {
+            try {
+                primitive->kdtree.build(primitive->triangles, state->cfg);
+                if (state->on_ready) {
+                    state->on_ready(index, *primitive);
+                }
+                state->promises[index].set_value(std::move(primitive));
+            } catch (...) {
+                state->promises[index].set_exception(std::current_exception());
+            }
+        }
+
+        void LoadPrimitive(std::shared_ptr<SceneLoadState> const& state, size_t index, ThreadPool& pool)
+        {
+            try {
+                auto primitive       = std::make_shared<CS350LoadedPrimitive>();
+                primitive->data      = LoadCS350Binary(state->files[index]);
+                primitive->triangles = TrianglesFromPrimitive(primitive->data);
+                // Build as a separate task, the remaining loads are not delayed by it
+                pool.post([state, index, primitive]() mutable { BuildPrimitive(state, index, std::move(primitive)); });
+            } catch (...) {
+                state->promises[index].set_exception(std::current_exception());
+            }
+        }
+    }
+
+    std::vector<Triangle> TrianglesFromPrimitive(CS350PrimitiveData const& primitive)
+    {
+        std::vector<Triangle> triangles;
+        if (primitive.polygons.empty()) {
+            triangles.reserve(primitive.positions.size() / 3);
+            for (size_t i = 0; i + 2 < primitive.positions.size(); i += 3) {
+                triangles.push_back({ primitive.positions[i + 0], primitive.positions[i + 1], primitive.positions[i + 2] });
+            }
+        } else {
+            triangles.reserve(primitive.polygons.size());
+            for (auto const& face : primitive.polygons) {
+                triangles.push_back({ primitive.positions.at(size_t(face[0])), primitive.positions.at(size_t(face[1])), primitive.positions.at(size_t(face[2])) });
+            }
+        }
+        return triangles;
+    }
+
+    CS350SceneLoad LoadCS350SceneAsync(std::string const& scene_file,
+                                       std::vector<std::string> const& primitive_files,
+                                       KdTree::Config const& cfg,
+                                       ThreadPool& pool,
+                                       std::function<void(size_t primitive_index, CS350LoadedPrimitive const&)> on_primitive_ready)
+    {
+        auto state      = std::make_shared<SceneLoadState>();
+        state->files    = primitive_files;
+        state->cfg      = cfg;
+        state->promises = std::vector<std::promise<PrimitivePtr>>(primitive_files.size());
+        state->on_ready = std::move(on_primitive_ready);
+
+        CS350SceneLoad result;
+        for (auto& promise : state->promises) {
+            result.primitives.push_back(promise.get_future().share());
+        }
+
+        auto objects   = std::make_shared<std::promise<std::vector<CS350SceneObject>>>();
+        result.objects = objects->get_future().share();
+        pool.post([state, scene_file, objects, &pool] {
+            std::vector<bool> referenced(state->files.size(), false);
+            try {
+                auto scene = LoadCS350Scene(scene_file);
+                for (auto const& object : scene) {
+                    if (object.primitiveIndex < 0 || size_t(object.primitiveIndex) >= state->files.size()) {
+                        throw std::runtime_error("Scene " + scene_file + " references unknown primitive " + std::to_string(object.primitiveIndex));
+                    }
+                    referenced[size_t(object.primitiveIndex)] = true;
+                }
+                objects->set_value(std::move(scene));
+            } catch (...) {
+                auto error = std::current_exception();
+                objects->set_exception(error);
+                for (auto& promise : state->promises) {
+                    promise.set_exception(error);
+                }
+                return;
+            }
+
+            for (size_t i = 0; i < referenced.size(); ++i) {
+                if (referenced[i]) {
+                    pool.post([state, i, &pool] { LoadPrimitive(state, i, pool); });
+                } else {
+                    state->promises[i].set_value(nullptr);
+                }
+            }
+        });
+        return result;
+    }
+}
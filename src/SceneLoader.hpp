@@ -0,0 +1,61 @@
+/**
+ * @file SceneLoader.hpp
+ * @brief Asynchronous loading of CS350 scenes, their primitives and kd-trees
+ */
+#ifndef SCENE_LOADER_HPP
+#define SCENE_LOADER_HPP
+
+#include "CS350Loader.hpp"
+#include "KdTree.hpp"
+#include "ThreadPool.hpp"
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace CS350 {
+
+    /**
+     * A primitive ready to be queried
+     */
+    struct CS350LoadedPrimitive
+    {
+        CS350PrimitiveData    data;
+        std::vector<Triangle> triangles;
+        KdTree                kdtree;
+    };
+
+    /**
+     * Result of an asynchronous scene load.
+     * 	- objects: The parsed scene
+     * 	- primitives: One entry per primitive file given. Null for primitives not referenced by the scene
+     */
+    struct CS350SceneLoad
+    {
+        std::shared_future<std::vector<CS350SceneObject>>                          objects;
+        std::vector<std::shared_future<std::shared_ptr<CS350LoadedPrimitive const>>> primitives;
+    };
+
+    /**
+     * Triangles of a primitive, indexed or not
+     */
+    std::vector<Triangle> TrianglesFromPrimitive(CS350PrimitiveData const& primitive);
+
+    /**
+     * Loads a scene without blocking:
+     * 	- The scene file is parsed in the pool
+     * 	- Then every referenced primitive file is loaded concurrently
+     * 	- Each kd-tree build starts as soon as its primitive data is available
+     * The optional callback is invoked (from a pool thread) for each primitive once its kd-tree is built.
+     * Errors are delivered through the futures. The pool must outlive the load.
+     */
+    CS350SceneLoad LoadCS350SceneAsync(std::string const& scene_file,
+                                       std::vector<std::string> const& primitive_files,
+                                       KdTree::Config const& cfg,
+                                       ThreadPool& pool,
+                                       std::function<void(size_t primitive_index, CS350LoadedPrimitive const&)> on_primitive_ready = {});
+}
+
+#endif // SCENE_LOADER_HPP
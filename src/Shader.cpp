@@ -48,19 +48,25 @@ namespace CS350 {
     }
 
     void Shader::CompileAndLinkShaders() {
+        CompileAndLinkShaders(vertexShaderSource, fragmentShaderSource);
+    }
+
+    void Shader::CompileAndLinkShaders(const char* vertexSource, const char* fragmentSource) {
         // Compile vertex shader
         GLuint vertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShaderID, 1, &vertexShaderSource, nullptr);
+        glShaderSource(vertexShaderID, 1, &vertexSource, nullptr);
         glCompileShader(vertexShaderID);
         CheckCompileErrors(vertexShaderID, "VERTEX");
 
         // Compile fragment shader
         GLuint fragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShaderID, 1, &fragmentShaderSource, nullptr);
+        glShaderSource(fragmentShaderID, 1, &fragmentSource, nullptr);
         glCompileShader(fragmentShaderID);
         CheckCompileErrors(fragmentShaderID, "FRAGMENT");
 
-        // Link shaders into a shader program
+        // Link shaders into a shader program (uniform locations belong to the previous one)
+        glDeleteProgram(m_ProgramID);
+        m_UniformLocations.clear();
         m_ProgramID = glCreateProgram();
         glAttachShader(m_ProgramID, vertexShaderID);
         glAttachShader(m_ProgramID, fragmentShaderID);
@@ -14,6 +14,7 @@ namespace CS350 {
         ~Shader();
 
         void CompileAndLinkShaders();
+        void CompileAndLinkShaders(const char* vertexSource, const char* fragmentSource);
         void Use() const;
 
         void SetUniform(const std::string& name, int value) const;
@@ -275,4 +275,40 @@ namespace CS350
         return original_sphere;
     }
 
+    /**
+     * @brief Classifies a point with respect to an axis-aligned bounding box.
+     *
+     * @param p The point to classify.
+     * @param aabb The bounding box.
+     * @return SideResult Classification of the point.
+     */
+    SideResult ClassifyPointAabb(const glm::vec3& p, const Aabb& aabb)
+    {
+        return ClassifyPointAabb(p, aabb.min, aabb.max);
+    }
+
+    /**
+     * @brief Computes the intersection time between a ray and an AABB, updating Stats (see CS350_INSTRUMENTATION).
+     *
+     * @param ray The ray.
+     * @param aabb The bounding box.
+     * @return float Time of intersection (0 if the ray starts inside), -1 if no intersection.
+     */
+    float IntersectionTimeRayAabb(const Ray& ray, const Aabb& aabb)
+    {
+        return IntersectionTimeRayAabb<cDefaultInstrumentation>(ray, aabb);
+    }
+
+    /**
+     * @brief Computes the intersection time between a ray and a triangle, updating Stats (see CS350_INSTRUMENTATION).
+     *
+     * @param ray The ray.
+     * @param triangle The triangle.
+     * @return float Time of intersection, -1 if no intersection.
+     */
+    float IntersectionTimeRayTriangle(const Ray& ray, const Triangle& triangle)
+    {
+        return IntersectionTimeRayTriangle<cDefaultInstrumentation>(ray, triangle);
+    }
+
 }
@@ -22,6 +22,34 @@ namespace CS350
     Sphere CreateSphereRitter(const glm::vec3* positions, size_t size, const glm::mat4x4& transform = glm::mat4x4{ 1.f });
     Sphere CreateSphereIterative(const glm::vec3* positions, size_t size, int iterations, float shrinkRatio, const glm::mat4x4& transform = glm::mat4x4{ 1.f });
 
+    // Shape level tests (these keep Stats updated when built with CS350_INSTRUMENTATION >= 1, e.g. tests and demo)
+    SideResult ClassifyPointAabb(const glm::vec3& p, const Aabb& aabb);
+    float IntersectionTimeRayAabb(const Ray& ray, const Aabb& aabb);
+    float IntersectionTimeRayTriangle(const Ray& ray, const Triangle& triangle);
+
+    // Same tests, with an explicit instrumentation level
+    template <Instrumentation Level>
+    float IntersectionTimeRayAabb(const Ray& ray, const Aabb& aabb)
+    {
+#if CS350_INSTRUMENTATION_HOOKS
+        if constexpr (Level != Instrumentation::None) {
+            Stats::Instance().rayVsAabb++;
+        }
+#endif
+        return IntersectionTimeRayAabb(ray.origin, ray.direction, aabb.min, aabb.max);
+    }
+
+    template <Instrumentation Level>
+    float IntersectionTimeRayTriangle(const Ray& ray, const Triangle& triangle)
+    {
+#if CS350_INSTRUMENTATION_HOOKS
+        if constexpr (Level != Instrumentation::None) {
+            Stats::Instance().rayVsTriangle++;
+        }
+#endif
+        return IntersectionTimeRayTriangle(ray.origin, ray.direction, triangle[0], triangle[1], triangle[2]);
+    }
+
 }
 
 #endif // __SHAPEUTILS_HPP__
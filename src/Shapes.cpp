@@ -74,6 +74,14 @@ namespace CS350 {
         return *this;
     }
 
+    /**
+     * @brief Computes the tight bounding box of the triangle vertices.
+     */
+    Aabb Triangle::GetBoundingBox() const {
+        return Aabb(glm::min(points[0], glm::min(points[1], points[2])),
+                    glm::max(points[0], glm::max(points[1], points[2])));
+    }
+
     /**
      * @brief Default constructor for Sphere class.
      */
@@ -14,6 +14,7 @@
 #include <array> 
 #include "Stats.hpp"
 #include"Geometry.hpp"
+#include "ArrayView.hpp"
 
 namespace CS350 {
 
@@ -57,6 +58,32 @@ namespace CS350 {
     };
 
 
+    struct Triangle
+    {
+        std::array<glm::vec3, 3> points;
+
+        glm::vec3&       operator[](size_t i) { return points[i]; }
+        glm::vec3 const& operator[](size_t i) const { return points[i]; }
+        Aabb GetBoundingBox() const;
+    };
+
+    /**
+     * Triangles of an indexed mesh, read from a shared vertex buffer
+     */
+    struct IndexedTriangles
+    {
+        ArrayView<glm::vec3>          positions;
+        ArrayView<std::array<int, 3>> faces;
+
+        size_t size() const { return faces.size(); }
+        bool   empty() const { return faces.empty(); }
+        Triangle operator[](size_t i) const
+        {
+            auto const& face = faces[i];
+            return { { positions[size_t(face[0])], positions[size_t(face[1])], positions[size_t(face[2])] } };
+        }
+    };
+
     struct Ray
     {
         Ray();
@@ -0,0 +1,139 @@
+#include "SharedKdTree.hpp"
+#include "Utils.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace CS350 {
+
+    SharedKdTree::SharedKdTree(std::string folder, std::string name)
+    : m_folder(std::move(folder))
+    , m_name(std::move(name)) {}
+
+    std::string SharedKdTree::version_path(std::uint64_t version) const {
+        return (std::filesystem::path(m_folder) / fmt::format("{}.{}.kdtree", m_name, version)).string();
+    }
+
+    std::string SharedKdTree::current_path() const {
+        return (std::filesystem::path(m_folder) / fmt::format("{}.current", m_name)).string();
+    }
+
+    bool SharedKdTree::FileStamp::operator==(FileStamp const& other) const {
+        return inode == other.inode && mtime == other.mtime && size == other.size && exists == other.exists;
+    }
+
+    SharedKdTree::FileStamp SharedKdTree::current_stamp() const {
+        FileStamp       stamp;
+        std::error_code ec;
+        auto            path  = current_path();
+        auto            mtime = std::filesystem::last_write_time(path, ec);
+        if (ec) {
+            return stamp; // Not published yet
+        }
+        stamp.mtime  = mtime.time_since_epoch().count();
+        stamp.size   = std::filesystem::file_size(path, ec);
+        stamp.exists = !ec;
+#ifndef _WIN32
+        // Modification times may be coarse, a renamed file always has another inode than the one it replaces
+        struct stat info {};
+        if (::stat(path.c_str(), &info) == 0) {
+            stamp.inode = static_cast<std::uint64_t>(info.st_ino);
+        }
+#endif
+        return stamp;
+    }
+
+    bool SharedKdTree::read_current(std::uint64_t& version, std::uint64_t& source_hash) const {
+        std::ifstream is(current_path());
+        return static_cast<bool>(is >> version >> source_hash);
+    }
+
+    std::uint64_t SharedKdTree::publish(KdTree const& tree, std::vector<Triangle> const& all_triangles) {
+        std::filesystem::create_directories(m_folder);
+
+        std::uint64_t previous_version = 0;
+        std::uint64_t previous_hash    = 0;
+        read_current(previous_version, previous_hash);
+        std::uint64_t version     = previous_version + 1;
+        std::uint64_t source_hash = KdTree::content_hash(all_triangles);
+
+        // The version file is complete (renamed in place) before anyone can see it
+        tree.save(version_path(version), source_hash, all_triangles);
+
+        // Atomic switch to the new version. The temporary name is unique, a stray publisher of the same name
+        // (or a leftover of a crashed one) never writes into the file being renamed
+        std::string tmp_path = UniqueTempPath(current_path());
+        {
+            std::ofstream os(tmp_path, std::ios::trunc);
+            os << version << " " << source_hash << "\n";
+            os.close();
+            if (!os) {
+                std::error_code ignored;
+                std::filesystem::remove(tmp_path, ignored);
+                throw std::runtime_error(fmt::format("Could not write file {}", tmp_path));
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp_path, current_path(), ec);
+        if (ec) {
+            std::error_code ignored;
+            std::filesystem::remove(tmp_path, ignored);
+            throw std::runtime_error(fmt::format("Could not replace file {}: {}", current_path(), ec.message()));
+        }
+
+        // Readers of the previous version may still be opening it, older ones are gone.
+        // Mapped files can be unlinked safely (on Windows this fails while mapped and is retried on next publish)
+        for (std::uint64_t old = version - 1; old-- > 0;) {
+            std::error_code ec;
+            if (!std::filesystem::remove(version_path(old), ec) && !ec) {
+                break; // Already removed by a previous publish
+            }
+        }
+        return version;
+    }
+
+    std::shared_ptr<KdTree const> SharedKdTree::acquire() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Stamped before parsing: if the file is replaced in between, the next call sees another stamp and parses again
+        FileStamp stamp = current_stamp();
+        while (!(stamp == m_current_stamp)) {
+            std::uint64_t version     = 0;
+            std::uint64_t source_hash = 0;
+            if (!read_current(version, source_hash)) {
+                return m_current;
+            }
+            if (version != m_current_version) {
+                try {
+                    m_current         = std::make_shared<KdTree const>(KdTree::load_mmap(version_path(version), source_hash));
+                    m_current_version = version;
+                } catch (std::exception const& /* ex */) {
+                    // Versions older than the previous one are removed by publish: the version read may be gone
+                    // already, but then the pointer file has moved on. Retry with the newer version
+                    FileStamp latest = current_stamp();
+                    if (latest == stamp) {
+                        if (!m_current) {
+                            throw; // Not a race, the current version itself cannot be opened
+                        }
+                        return m_current;
+                    }
+                    stamp = latest;
+                    continue;
+                }
+            }
+            m_current_stamp = stamp;
+        }
+        return m_current;
+    }
+
+    std::uint64_t SharedKdTree::version() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_current_version;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef SHARED_KDTREE_HPP
+#define SHARED_KDTREE_HPP
+
+#include "KdTree.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace CS350 {
+    /**
+     * KdTree shared between processes of the same host through a common folder.
+     *
+     * A publisher saves each version as "<name>.<version>.kdtree" (triangles included) and then
+     * atomically replaces "<name>.current", which holds the current version and mesh hash.
+     * Readers map the current file read-only: all processes mapping it share the same physical
+     * pages (page cache), so N workers cost a single copy of nodes, indices and triangles.
+     * The folder may live in a tmpfs (e.g. /dev/shm) to avoid touching disk.
+     *
+     * Publication is safe with readers running: a version file is complete before it becomes
+     * current, trees already acquired keep their mapping alive until released, and a reader
+     * that finds its version already removed reads the pointer file again.
+     * Only one publisher per name is supported.
+     */
+    class SharedKdTree {
+      private:
+        /**
+         * Identity of the pointer file. Each publish renames a new file over it,
+         * so an unchanged stamp means an unchanged version.
+         */
+        struct FileStamp {
+            std::uint64_t inode  = 0;
+            std::int64_t  mtime  = 0;
+            std::uint64_t size   = 0;
+            bool          exists = false;
+
+            bool operator==(FileStamp const& other) const;
+        };
+
+        std::string                   m_folder;
+        std::string                   m_name;
+        std::mutex                    m_mutex;
+        std::shared_ptr<KdTree const> m_current;
+        std::uint64_t                 m_current_version = 0;
+        FileStamp                     m_current_stamp;
+
+        [[nodiscard]] std::string version_path(std::uint64_t version) const;
+        [[nodiscard]] std::string current_path() const;
+        [[nodiscard]] FileStamp   current_stamp() const;
+        bool                      read_current(std::uint64_t& version, std::uint64_t& source_hash) const;
+
+      public:
+        SharedKdTree(std::string folder, std::string name);
+
+        /**
+         * Writer side. Saves a new version of the tree and makes it current.
+         * Versions older than the previous one are removed.
+         * @return The published version
+         */
+        std::uint64_t publish(KdTree const& tree, std::vector<Triangle> const& all_triangles);
+
+        /**
+         * Reader side. Maps the current version if it changed since the last call.
+         * The pointer file is only parsed when its stamp (inode, modification time, size) changed, a single stat otherwise.
+         * @return The latest published tree, null if nothing has been published yet
+         */
+        std::shared_ptr<KdTree const> acquire();
+
+        [[nodiscard]] std::uint64_t version();
+    };
+}
+
+#endif // SHARED_KDTREE_HPP
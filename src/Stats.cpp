@@ -3,3 +3,53 @@
 //
 
 #include "Stats.hpp"
+
+namespace CS350 {
+    Stats::Shard* Stats::AcquireShard() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_free_shards.empty()) {
+            Shard* shard = m_free_shards.back();
+            m_free_shards.pop_back();
+            return shard;
+        }
+        m_shards.push_back(std::make_unique<Shard>());
+        return m_shards.back().get();
+    }
+
+    void Stats::ReleaseShard(Shard* shard) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free_shards.push_back(shard);
+    }
+
+    size_t Stats::RawTotal(CounterId id) const {
+        size_t total = 0;
+        for (auto const& shard : m_shards) {
+            total += shard->counts[id].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    /**
+     * @brief
+     *  Counts restart from zero. Increments racing with the reset are either counted or not, never lost
+     */
+    void Stats::Reset() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (unsigned id = 0; id < cCounterCount; ++id) {
+            m_baseline[id] = RawTotal(CounterId(id));
+        }
+    }
+
+    size_t Stats::Total(CounterId id) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return RawTotal(id) - m_baseline[id];
+    }
+
+    Stats::Snapshot Stats::TakeSnapshot() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return { RawTotal(cFrustumVsAabb) - m_baseline[cFrustumVsAabb],
+                 RawTotal(cAabbVsAabb) - m_baseline[cAabbVsAabb],
+                 RawTotal(cRayVsAabb) - m_baseline[cRayVsAabb],
+                 RawTotal(cRayVsTriangle) - m_baseline[cRayVsTriangle] };
+    }
+}
@@ -2,35 +2,127 @@
 #ifndef STATS_HPP
 #define STATS_HPP
 
+#include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+// Instrumentation compiled into the default query entry points: 0 none, 1 counters, 2 full trace (see Instrumentation).
+// Set by the build (CMake option CS350_INSTRUMENTATION, the test and demo targets use 2), none otherwise
+#ifndef CS350_INSTRUMENTATION
+#define CS350_INSTRUMENTATION 0
+#endif
+// 0 removes the instrumentation hooks of the query path with the preprocessor: the reference that
+// Instrumentation::None is checked against (benchmark/check_instrumentation.sh), not meant for other builds
+#ifndef CS350_INSTRUMENTATION_HOOKS
+#define CS350_INSTRUMENTATION_HOOKS 1
+#endif
+
 namespace CS350 {
     /**
-     * Debug structure, keeps track of how many times a certain operation was executed
+     * Instrumentation levels, resolved at compile time (no instrumentation code exists at all in None paths)
+     * 	- None:     Nothing is recorded
+     * 	- Counters: Stats counters are updated
+     * 	- Trace:    Counters, plus per query traces (e.g. KdTree::DebugStats) when requested
+     * None costs nothing: benchmark/check_instrumentation.sh compares its code with the query path built without the
+     * hooks (CS350_INSTRUMENTATION_HOOKS=0). The cost of counting is measured by the Query/bunny-dense/random (None)
+     * and QueryCounters/bunny-dense/random (Counters) pair of cs350-benchmark
+     */
+    enum class Instrumentation { None, Counters, Trace };
+
+    constexpr Instrumentation cDefaultInstrumentation = static_cast<Instrumentation>(CS350_INSTRUMENTATION);
+    static_assert(CS350_INSTRUMENTATION >= 0 && CS350_INSTRUMENTATION <= 2, "CS350_INSTRUMENTATION should be 0, 1 or 2");
+
+    /**
+     * Debug structure, keeps track of how many times a certain operation was executed.
+     * Thread safe: every thread increments its own cache line sized shard, reads add all the shards up.
      */
     class Stats {
+      public:
+        enum CounterId : unsigned { cFrustumVsAabb, cAabbVsAabb, cRayVsAabb, cRayVsTriangle, cCounterCount };
+
+        /**
+         * Aggregated values at some point in time
+         */
+        struct Snapshot {
+            size_t frustumVsAabb{};
+            size_t aabbVsAabb{};
+            size_t rayVsAabb{};
+            size_t rayVsTriangle{};
+        };
+
+        /**
+         * A counter, incremented like a size_t and readable as one (reads are not meant for hot paths)
+         */
+        class Counter {
+          private:
+            CounterId m_id;
+
+          public:
+            explicit Counter(CounterId id)
+            : m_id(id) {}
+            Counter(Counter const&)            = delete;
+            Counter& operator=(Counter const&) = delete;
+
+            Counter& operator++() {
+                Stats::Increment(m_id);
+                return *this;
+            }
+            void operator++(int) { Stats::Increment(m_id); }
+            operator size_t() const { return Stats::Instance().Total(m_id); } // NOLINT(google-explicit-constructor)
+        };
+
       private:
-        Stats() { Reset(); }
+        struct alignas(64) Shard {
+            std::array<std::atomic<size_t>, cCounterCount> counts{};
+        };
+
+        mutable std::mutex                        m_mutex;
+        std::vector<std::unique_ptr<Shard>>       m_shards;      // Never freed, counts of finished threads remain
+        std::vector<Shard*>                       m_free_shards; // Shards of finished threads, reused by new ones
+        std::array<size_t, cCounterCount>         m_baseline{};  // Totals at the last reset
+
+        Stats() = default;
         ~Stats()                       = default;
         Stats(Stats const&)            = delete;
         Stats& operator=(Stats const&) = delete;
 
+        Shard* AcquireShard();
+        void   ReleaseShard(Shard* shard);
+        size_t RawTotal(CounterId id) const;
+
+        static Shard& LocalShard() {
+            // The shard goes back to the pool when the thread finishes
+            struct Lease {
+                Shard* shard = Instance().AcquireShard();
+                ~Lease() { Instance().ReleaseShard(shard); }
+            };
+            thread_local Lease t_lease;
+            return *t_lease.shard;
+        }
+
+        static void Increment(CounterId id) {
+            // Only the owning thread writes a shard, no read-modify-write needed
+            auto& count = LocalShard().counts[id];
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
       public:
         static Stats& Instance() {
             static Stats st;
             return st;
         }
 
-        void Reset() {
-            frustumVsAabb = 0;
-            aabbVsAabb    = 0;
-            rayVsAabb     = 0;
-            rayVsTriangle = 0;
-        }
+        void                   Reset();
+        [[nodiscard]] Snapshot TakeSnapshot() const;
+        [[nodiscard]] size_t   Total(CounterId id) const;
 
-        size_t frustumVsAabb{};
-        size_t aabbVsAabb{};
-        size_t rayVsAabb{};
-        size_t rayVsTriangle{};
+        Counter frustumVsAabb{ cFrustumVsAabb };
+        Counter aabbVsAabb{ cAabbVsAabb };
+        Counter rayVsAabb{ cRayVsAabb };
+        Counter rayVsTriangle{ cRayVsTriangle };
     };
 }
 #endif // STATS_HPP
@@ -0,0 +1,85 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace CS350 {
+    /**
+     * Fixed size pool of worker threads consuming a FIFO task queue.
+     * Pending tasks are completed before destruction.
+     */
+    class ThreadPool {
+      private:
+        std::vector<std::thread>          m_workers;
+        std::deque<std::function<void()>> m_tasks;
+        std::mutex                        m_mutex;
+        std::condition_variable           m_wake;
+        bool                              m_stopping = false;
+
+        void worker_loop();
+
+      public:
+        explicit ThreadPool(unsigned thread_count = std::thread::hardware_concurrency());
+        ~ThreadPool();
+        ThreadPool(ThreadPool const&)            = delete;
+        ThreadPool& operator=(ThreadPool const&) = delete;
+        ThreadPool(ThreadPool&&)                 = delete;
+        ThreadPool& operator=(ThreadPool&&)      = delete;
+
+        [[nodiscard]] unsigned size() const noexcept { return static_cast<unsigned>(m_workers.size()); }
+
+        /**
+         * Queues a task, fire and forget. Tasks must not throw, nor block waiting for other queued tasks.
+         */
+        void post(std::function<void()> task);
+
+        /**
+         * Queues a task, its result (or exception) is delivered through the returned future
+         */
+        template <typename F>
+        auto submit(F&& f) -> std::future<std::invoke_result_t<F>> {
+            using Result = std::invoke_result_t<F>;
+            auto task    = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+            auto result  = task->get_future();
+            post([task] { (*task)(); });
+            return result;
+        }
+
+        /**
+         * Runs f(begin, end) over chunks of [0, count) and waits for all of them.
+         * The first exception thrown by a chunk is rethrown. Must not be called from a pool thread.
+         */
+        template <typename F>
+        void parallel_for(size_t count, F const& f) {
+            size_t chunks = std::min<size_t>(count, size_t(size()) * 4);
+            if (chunks <= 1) {
+                f(size_t(0), count);
+                return;
+            }
+            std::vector<std::future<void>> done;
+            done.reserve(chunks);
+            for (size_t c = 0; c < chunks; ++c) {
+                size_t begin = count * c / chunks;
+                size_t end   = count * (c + 1) / chunks;
+                done.push_back(submit([&f, begin, end] { f(begin, end); }));
+            }
+            for (auto& chunk : done) {
+                chunk.wait(); // Every chunk references f, all must finish before rethrowing
+            }
+            for (auto& chunk : done) {
+                chunk.get();
+            }
+        }
+    };
+}
+
+#endif // THREAD_POOL_HPP
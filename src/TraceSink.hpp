@@ -0,0 +1,71 @@
+#ifndef TRACE_SINK_HPP
+#define TRACE_SINK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace CS350 {
+    /**
+     * Allocation free destination of query traces (see KdTree::DebugStats::sink).
+     * 	- Ring:     Fixed capacity, keeps the newest events, older ones are overwritten
+     * 	- Fixed:    Fixed capacity, keeps the first events, newer ones are dropped
+     * 	- Callback: Every event is forwarded to a function, nothing is stored
+     * Storage is allocated once, on construction. Overwritten or dropped events are counted as overflow.
+     * Not thread safe, use one sink per thread.
+     */
+    class TraceSink {
+      public:
+        enum class Kind : std::uint32_t { Node, Triangle };
+        struct Event {
+            Kind          kind;
+            std::uint32_t index;
+        };
+        enum class Mode { Ring, Fixed };
+        using Callback = void (*)(void* user, Event event);
+
+      private:
+        std::unique_ptr<Event[]> m_events;
+        size_t                   m_capacity = 0;
+        size_t                   m_recorded = 0; // Total events received since the last clear
+        Mode                     m_mode     = Mode::Ring;
+        Callback                 m_callback = nullptr;
+        void*                    m_user     = nullptr;
+
+      public:
+        TraceSink(size_t capacity, Mode mode)
+        : m_events(new Event[capacity])
+        , m_capacity(capacity)
+        , m_mode(mode) {}
+        TraceSink(Callback callback, void* user)
+        : m_callback(callback)
+        , m_user(user) {}
+
+        void record(Kind kind, size_t index) noexcept {
+            Event event{ kind, static_cast<std::uint32_t>(index) };
+            if (m_callback != nullptr) {
+                m_callback(m_user, event);
+            } else if (m_capacity != 0 && (m_mode == Mode::Ring || m_recorded < m_capacity)) {
+                m_events[m_recorded % m_capacity] = event;
+            }
+            ++m_recorded;
+        }
+
+        void clear() noexcept { m_recorded = 0; }
+
+        [[nodiscard]] size_t capacity() const noexcept { return m_capacity; }
+        [[nodiscard]] size_t recorded() const noexcept { return m_recorded; }
+        [[nodiscard]] size_t size() const noexcept { return m_recorded < m_capacity ? m_recorded : m_capacity; }
+        [[nodiscard]] size_t overflow() const noexcept { return m_callback != nullptr ? 0 : m_recorded - size(); }
+
+        /**
+         * Stored events, oldest first
+         */
+        [[nodiscard]] Event const& operator[](size_t i) const noexcept {
+            size_t first = (m_mode == Mode::Ring && m_recorded > m_capacity) ? m_recorded % m_capacity : 0;
+            return m_events[(first + i) % m_capacity];
+        }
+    };
+}
+
+#endif // TRACE_SINK_HPP
@@ -1,6 +1,11 @@
 #include "Utils.hpp"
+#include <atomic>
+#include <cstring>
 #include <fstream>
 #include <iterator>
+#include <random>
+#include <sstream>
+#include <thread>
 
 namespace CS350 {
 
@@ -70,4 +75,44 @@ namespace CS350 {
         // Read
         return std::string(std::istreambuf_iterator<char>(fs), {});
     }
+
+    std::uint64_t HashBytes(void const* data, size_t size, std::uint64_t seed)
+    {
+        std::uint64_t const cPrime = 0x100000001b3ULL;
+        auto const*         bytes  = static_cast<unsigned char const*>(data);
+        std::uint64_t       h      = 0xcbf29ce484222325ULL ^ (seed * cPrime);
+
+        // Word at a time, the mesh buffers this is used on can be large
+        size_t i = 0;
+        for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+            std::uint64_t word = 0;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            h = (h ^ word) * cPrime;
+            h ^= h >> 29;
+        }
+        for (; i < size; ++i) {
+            h = (h ^ bytes[i]) * cPrime;
+        }
+
+        // Final avalanche (splitmix64)
+        h ^= size;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        return h ^ (h >> 31);
+    }
+
+    std::string UniqueTempPath(std::string const& path) {
+        // random_device differs between processes, the thread id and a counter between calls of a process
+        // (some random_device implementations are deterministic)
+        static std::atomic<std::uint64_t> counter{ 0 };
+        std::random_device                device;
+        std::ostringstream                os;
+        os << std::this_thread::get_id() << '/' << counter++;
+        std::string const id     = os.str();
+        std::uint64_t     suffix = HashBytes(id.data(), id.size(), (std::uint64_t(device()) << 32u) | device());
+
+        os.str("");
+        os << path << '.' << std::hex << suffix << ".tmp";
+        return os.str();
+    }
 }
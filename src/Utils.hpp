@@ -3,6 +3,7 @@
 
 #include "Logging.hpp"
 
+#include <cstdint>
 #include <filesystem>
 #include <string>
 #include <vector>
@@ -51,6 +52,20 @@ namespace CS350 {
      *  Given a file path, opens all it's content in text format. Throws an exception if not found or not able to open.
      */
     std::string LoadFile(std::string const& path);
+
+    /**
+     * @brief
+     *  Non-cryptographic 64 bit hash of a memory block. Stable across runs and platforms of the same endianness,
+     *  meant to be used as a content key for on-disk caches.
+     */
+    std::uint64_t HashBytes(void const* data, size_t size, std::uint64_t seed = 0);
+
+    /**
+     * @brief
+     *  Name for a temporary file next to path ("<path>.<random>.tmp"), unique across processes and threads.
+     *  Write it completely, then rename it over path: concurrent writers never share a temporary file.
+     */
+    std::string UniqueTempPath(std::string const& path);
 }
 
 #endif // UTILS_HPP
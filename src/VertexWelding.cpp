@@ -0,0 +1,185 @@
+#include "VertexWelding.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace CS350 {
+    namespace {
+        uint32_t const cNone = std::numeric_limits<uint32_t>::max();
+
+        struct Cell
+        {
+            int64_t x, y, z;
+            bool operator==(Cell const& rhs) const { return x == rhs.x && y == rhs.y && z == rhs.z; }
+        };
+
+        struct CellHash
+        {
+            size_t operator()(Cell const& c) const
+            {
+                uint64_t h = uint64_t(c.x) * 0x9e3779b97f4a7c15ull;
+                h ^= uint64_t(c.y) * 0xc2b2ae3d27d4eb4full + (h << 6) + (h >> 2);
+                h ^= uint64_t(c.z) * 0x165667b19e3779f9ull + (h << 6) + (h >> 2);
+                return size_t(h ^ (h >> 32));
+            }
+        };
+
+        /**
+         * Vertices of a shard, per cell, as ascending linked lists (first/last per cell, next per vertex)
+         */
+        struct Shard
+        {
+            std::unordered_map<Cell, std::pair<uint32_t, uint32_t>, CellHash> cells;
+        };
+
+        template <typename F>
+        void ForRange(ThreadPool* pool, size_t count, F const& f)
+        {
+            if (pool == nullptr) {
+                f(size_t(0), count);
+            } else {
+                pool->parallel_for(count, f);
+            }
+        }
+
+        bool Near(vec3 const& a, vec3 const& b, float epsilon)
+        {
+            return std::abs(a.x - b.x) <= epsilon && std::abs(a.y - b.y) <= epsilon && std::abs(a.z - b.z) <= epsilon;
+        }
+
+        bool Near(vec2 const& a, vec2 const& b, float epsilon)
+        {
+            return std::abs(a.x - b.x) <= epsilon && std::abs(a.y - b.y) <= epsilon;
+        }
+    }
+
+    CS350PrimitiveData WeldVertices(CS350PrimitiveData const& primitive, float epsilon, ThreadPool* pool)
+    {
+        if (!(epsilon > 0.0f)) {
+            throw std::runtime_error("Welding epsilon should be positive");
+        }
+        size_t vertexCount = primitive.positions.size();
+        if (vertexCount >= cNone) {
+            throw std::runtime_error("Too many vertices to weld");
+        }
+        bool hasNormals = primitive.normals.size() == vertexCount && vertexCount != 0;
+        bool hasUVs = primitive.uvs.size() == vertexCount && vertexCount != 0;
+
+        // Cells of epsilon size, vertices within epsilon are in the same or in a neighbor cell
+        std::vector<Cell> cells(vertexCount);
+        std::vector<size_t> hashes(vertexCount);
+        double inverseCellSize = 1.0 / double(epsilon);
+        ForRange(pool, vertexCount, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                vec3 const& p = primitive.positions[i];
+                cells[i] = { int64_t(std::floor(double(p.x) * inverseCellSize)),
+                             int64_t(std::floor(double(p.y) * inverseCellSize)),
+                             int64_t(std::floor(double(p.z) * inverseCellSize)) };
+                hashes[i] = CellHash{}(cells[i]);
+            }
+        });
+
+        // Each shard owns the cells whose hash maps to it. Vertices are bucketed by shard once (stable counting sort,
+        // O(N)), so each shard only walks its own vertices, in ascending order
+        size_t shardCount = pool != nullptr ? size_t(pool->size()) * 4 : 1;
+        std::vector<size_t> shardStart(shardCount + 1, 0);
+        for (size_t i = 0; i < vertexCount; ++i) {
+            ++shardStart[hashes[i] % shardCount + 1];
+        }
+        for (size_t s = 0; s < shardCount; ++s) {
+            shardStart[s + 1] += shardStart[s];
+        }
+        std::vector<uint32_t> byShard(vertexCount);
+        {
+            std::vector<size_t> fill(shardStart.begin(), shardStart.end() - 1);
+            for (size_t i = 0; i < vertexCount; ++i) {
+                byShard[fill[hashes[i] % shardCount]++] = uint32_t(i);
+            }
+        }
+
+        std::vector<Shard> shards(shardCount);
+        std::vector<uint32_t> next(vertexCount, cNone);
+        ForRange(pool, shardCount, [&](size_t begin, size_t end) {
+            for (size_t s = begin; s < end; ++s) {
+                auto& shardCells = shards[s].cells;
+                for (size_t k = shardStart[s]; k < shardStart[s + 1]; ++k) {
+                    uint32_t i = byShard[k];
+                    auto [it, inserted] = shardCells.try_emplace(cells[i], i, i);
+                    if (!inserted) {
+                        next[it->second.second] = i;
+                        it->second.second = i;
+                    }
+                }
+            }
+        });
+
+        // Each vertex points to the first vertex matching it (read only lookups)
+        std::vector<uint32_t> representative(vertexCount);
+        ForRange(pool, vertexCount, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                uint32_t best = uint32_t(i);
+                for (int64_t dx = -1; dx <= 1; ++dx) {
+                    for (int64_t dy = -1; dy <= 1; ++dy) {
+                        for (int64_t dz = -1; dz <= 1; ++dz) {
+                            Cell neighbor{ cells[i].x + dx, cells[i].y + dy, cells[i].z + dz };
+                            auto const& shardCells = shards[CellHash{}(neighbor) % shardCount].cells;
+                            auto it = shardCells.find(neighbor);
+                            if (it == shardCells.end()) {
+                                continue;
+                            }
+                            for (uint32_t j = it->second.first; j < best; j = next[j]) {
+                                if (Near(primitive.positions[j], primitive.positions[i], epsilon) &&
+                                    (!hasNormals || Near(primitive.normals[j], primitive.normals[i], epsilon)) &&
+                                    (!hasUVs || Near(primitive.uvs[j], primitive.uvs[i], epsilon))) {
+                                    best = j;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                }
+                representative[i] = best;
+            }
+        });
+
+        // Compaction, in first appearance order. Representatives always precede the vertex
+        CS350PrimitiveData welded;
+        std::vector<int> remap(vertexCount);
+        for (size_t i = 0; i < vertexCount; ++i) {
+            if (representative[i] != i) {
+                remap[i] = remap[representative[i]];
+                continue;
+            }
+            remap[i] = int(welded.positions.size());
+            welded.positions.push_back(primitive.positions[i]);
+            if (hasNormals) {
+                welded.normals.push_back(primitive.normals[i]);
+            }
+            if (hasUVs) {
+                welded.uvs.push_back(primitive.uvs[i]);
+            }
+        }
+
+        if (primitive.polygons.empty()) {
+            welded.polygons.resize(vertexCount / 3);
+            for (size_t f = 0; f < welded.polygons.size(); ++f) {
+                welded.polygons[f] = { remap[f * 3 + 0], remap[f * 3 + 1], remap[f * 3 + 2] };
+            }
+        } else {
+            welded.polygons.resize(primitive.polygons.size());
+            for (size_t f = 0; f < welded.polygons.size(); ++f) {
+                for (size_t k = 0; k < 3; ++k) {
+                    welded.polygons[f][k] = remap.at(size_t(primitive.polygons[f][k]));
+                }
+            }
+        }
+        welded.bvMin = primitive.bvMin;
+        welded.bvMax = primitive.bvMax;
+        return welded;
+    }
+}
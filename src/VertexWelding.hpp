@@ -0,0 +1,18 @@
+#ifndef VERTEX_WELDING_HPP
+#define VERTEX_WELDING_HPP
+
+#include "CS350Loader.hpp"
+#include "ThreadPool.hpp"
+
+namespace CS350 {
+    /**
+     * Merges vertices whose attributes (positions, and normals/uvs when present) are all within epsilon.
+     * 	- The result is always indexed, face i of the result is triangle i of the input
+     * 	- Vertices are merged into the first matching one, the output order is the first appearance order
+     * 	- Deterministic, the same result is produced with or without a pool
+     * Epsilon is absolute (model units) and must be positive.
+     */
+    CS350PrimitiveData WeldVertices(CS350PrimitiveData const& primitive, float epsilon = 1e-6f, ThreadPool* pool = nullptr);
+}
+
+#endif // VERTEX_WELDING_HPP
@@ -7,12 +7,36 @@
 #include "Stats.hpp"       // Stats
 #include "PRNG.h"          // Random
 #include "CS350Loader.hpp" // Loading assets
+#include "SharedKdTree.hpp" // Cross process trees
+#include "SceneLoader.hpp"  // Asynchronous scenes
+#include "Quantization.hpp" // Compressed meshes
+#include "VertexWelding.hpp" // Indexed meshes
+#include "MeshGenerator.hpp" // Synthetic meshes
+#include "PerfCounters.hpp"  // Hardware counters
+#include "ChromeTrace.hpp"   // Build/load traces
+#include "ConfigTuner.hpp"   // Config search
+#include "CostCalibration.hpp" // Host SAH costs
+#include "QueryLog.hpp"      // Query record/replay
+#include "LatencyHistogram.hpp" // Per query distributions
+#include "PerfGate.hpp"        // Regression gate
+#include "RayCaster.hpp"       // Offline rendering
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
 #include <gtest/gtest.h>
+#include <iterator>
 #include <ostream>
+#include <random>
+#include <thread>
 #include <vector>
 
 namespace {
+    // The default entry points only count with CS350_INSTRUMENTATION >= 1
+    constexpr bool cStatsKept = CS350::cDefaultInstrumentation != CS350::Instrumentation::None;
 
     struct Timer {
       private:
@@ -67,6 +91,10 @@ namespace {
     void DumpStats(CS350::KdTree const& kdtree, std::ostream& os) {
         os << "\tHeight: " << kdtree.height() << std::endl;
         os << "\tNode count: " << kdtree.nodes().size() << std::endl;
+        auto quality = kdtree.quality_report();
+        os << "\tSAH cost: " << quality.sah_cost << std::endl;
+        os << "\tLeaves: " << quality.leaf_count << " (" << quality.empty_leaf_count << " empty)" << std::endl;
+        os << "\tDuplication factor: " << quality.duplication_factor << std::endl;
     }
 
     /**
@@ -141,7 +169,9 @@ namespace {
             CS350::KdTree::Intersection intersection_bf{};
             CS350::Stats::Instance().Reset();
             intersection_bf = ClosestIntersection(ray, all_triangles);
-            ASSERT_EQ(CS350::Stats::Instance().rayVsTriangle, all_triangles.size()) << "Stats not being kept updated";
+            if (cStatsKept) {
+                ASSERT_EQ(CS350::Stats::Instance().rayVsTriangle, all_triangles.size()) << "Stats not being kept updated";
+            }
             performance_results.average_bf_duration_ms += static_cast<float>(timer.ellapsed_ms());
 
             // KdTree
@@ -301,7 +331,1165 @@ void Efficiency(KdTreeMesh const& mesh, int max_depth) {
     // Special case test
     if (max_depth == 1) {
         ASSERT_EQ(kdTree.nodes().size(), 1);
-        ASSERT_EQ(CS350::Stats::Instance().rayVsTriangle, mesh.triangles.size()) << "With a single node, all triangles should be tested";
+        if (cStatsKept) {
+            ASSERT_EQ(CS350::Stats::Instance().rayVsTriangle, mesh.triangles.size()) << "With a single node, all triangles should be tested";
+        }
+    }
+}
+
+void SaveLoad(KdTreeMesh const& mesh, int max_depth) {
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.cost_intersection = 80;
+    config.cost_traversal    = 1;
+    config.max_depth         = max_depth;
+    config.min_triangles     = 100;
+    kdTree.build(mesh.triangles, config);
+
+    auto path = fmt::format(".{}.kdtree", TestName());
+    auto hash = CS350::KdTree::content_hash(mesh.triangles);
+    kdTree.save(path, hash);
+    ASSERT_THROW((void)CS350::KdTree::load_mmap(path, hash + 1), std::runtime_error) << "Mesh hash should be validated";
+    ASSERT_THROW((void)kdTree.get_closest(RandomRay(mesh.center, 5.0f, 100.0f), nullptr), std::runtime_error) << "Built trees do not store triangles";
+    ASSERT_THROW((void)CS350::KdTree::load_mmap(path, hash).get_closest(RandomRay(mesh.center, 5.0f, 100.0f), nullptr), std::runtime_error)
+        << "Saved without triangles";
+
+    // Same tree, same queries
+    auto loaded = CS350::KdTree::load_mmap(path, hash);
+    ASSERT_EQ(loaded.nodes().size(), kdTree.nodes().size());
+    ASSERT_EQ(loaded.indices().size(), kdTree.indices().size());
+    ASSERT_EQ(loaded.config().max_depth, config.max_depth);
+    ASSERT_EQ(loaded.height(), kdTree.height());
+    for (size_t i = 0; i < kdTree.nodes().size(); ++i) {
+        ASSERT_EQ(loaded.aabbs().at(i), kdTree.aabbs().at(i));
+        ASSERT_EQ(loaded.get_triangles(i), kdTree.get_triangles(i));
+    }
+    for (int i = 0; i < 100; ++i) {
+        auto ray      = RandomRay(mesh.center, 5.0f, 100.0f);
+        auto expected = kdTree.get_closest(mesh.triangles, ray, nullptr);
+        auto actual   = loaded.get_closest(mesh.triangles, ray, nullptr);
+        ASSERT_EQ(expected.t, actual.t);
+    }
+}
+
+void LoadOrBuild(KdTreeMesh const& mesh) {
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    auto folder      = fmt::format(".{}.cache", TestName());
+    std::filesystem::remove_all(folder);
+
+    auto built = CS350::KdTree::load_or_build(folder, mesh.triangles, config);
+    ASSERT_EQ(std::distance(std::filesystem::directory_iterator(folder), {}), 1) << "Tree should be stored in the cache";
+    auto cached = CS350::KdTree::load_or_build(folder, mesh.triangles, config);
+    ASSERT_EQ(cached.nodes().size(), built.nodes().size());
+    ASSERT_EQ(std::distance(std::filesystem::directory_iterator(folder), {}), 1) << "Cache hit should not write";
+
+    // A different configuration is a different entry
+    config.max_depth = 2;
+    auto shallow     = CS350::KdTree::load_or_build(folder, mesh.triangles, config);
+    ASSERT_LE(shallow.height(), 2);
+    ASSERT_EQ(std::distance(std::filesystem::directory_iterator(folder), {}), 2);
+
+    // An entry holding a tree built with another configuration is rebuilt
+    auto hash = CS350::KdTree::content_hash(mesh.triangles);
+    std::string unlimited_entry;
+    for (auto const& entry : std::filesystem::directory_iterator(folder)) {
+        if (CS350::KdTree::load_mmap(entry.path().string(), hash).config().max_depth == 0) {
+            unlimited_entry = entry.path().string();
+        }
+    }
+    shallow.save(unlimited_entry, hash);
+    config.max_depth = 0;
+    auto rebuilt     = CS350::KdTree::load_or_build(folder, mesh.triangles, config);
+    ASSERT_EQ(rebuilt.config().max_depth, 0);
+    ASSERT_EQ(rebuilt.nodes().size(), built.nodes().size());
+
+    // Concurrent writers of the same entry use their own temporary files, the last rename wins
+    auto                     path = (std::filesystem::path(folder) / "shared.kdtree").string();
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 4; ++i) {
+        writers.emplace_back([&] {
+            for (int j = 0; j < 5; ++j) {
+                shallow.save(path, hash);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    ASSERT_EQ(CS350::KdTree::load_mmap(path, hash).nodes().size(), shallow.nodes().size());
+    ASSERT_EQ(std::distance(std::filesystem::directory_iterator(folder), {}), 3) << "No temporary file should be left";
+}
+
+namespace {
+    void Overwrite(std::string const& path, std::uint64_t offset, void const* data, size_t size) {
+        std::fstream fs(path, std::ios::binary | std::ios::in | std::ios::out);
+        fs.seekp(static_cast<std::streamoff>(offset));
+        fs.write(static_cast<char const*>(data), static_cast<std::streamsize>(size));
+    }
+}
+
+void CorruptFile(KdTreeMesh const& mesh) {
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(mesh.triangles, config);
+    auto hash = CS350::KdTree::content_hash(mesh.triangles);
+    auto path = fmt::format(".{}.kdtree", TestName());
+    ASSERT_TRUE(kdTree.nodes().at(0).is_internal());
+
+    // Layout of the file: 128 byte header, then nodes, aabbs and indices at multiples of 64 bytes
+    auto          align        = [](std::uint64_t offset) { return (offset + 63) / 64 * 64; };
+    std::uint64_t node_offset  = 128;
+    std::uint64_t aabb_offset  = align(node_offset + kdTree.nodes().size() * sizeof(CS350::KdTree::Node));
+    std::uint64_t index_offset = align(aabb_offset + kdTree.aabbs().size() * sizeof(CS350::Aabb));
+
+    // Root child out of the nodes
+    kdTree.save(path, hash);
+    std::uint32_t bad_child = (0x3FFFFFFFu << 2u) | kdTree.nodes()[0].axis();
+    Overwrite(path, node_offset + 4, &bad_child, sizeof(bad_child));
+    ASSERT_THROW((void)CS350::KdTree::load_mmap(path, hash), std::runtime_error);
+
+    // Cycle: the root's second child is itself
+    kdTree.save(path, hash);
+    std::uint32_t cycle = (0u << 2u) | kdTree.nodes()[0].axis();
+    Overwrite(path, node_offset + 4, &cycle, sizeof(cycle));
+    ASSERT_THROW((void)CS350::KdTree::load_mmap(path, hash), std::runtime_error);
+
+    // Triangle index out of the mesh
+    kdTree.save(path, hash);
+    size_t bad_index = mesh.triangles.size();
+    Overwrite(path, index_offset, &bad_index, sizeof(bad_index));
+    ASSERT_THROW((void)CS350::KdTree::load_mmap(path, hash), std::runtime_error);
+
+    // Truncated
+    kdTree.save(path, hash);
+    std::filesystem::resize_file(path, index_offset);
+    ASSERT_THROW((void)CS350::KdTree::load_mmap(path, hash), std::runtime_error);
+
+    // The cache rebuilds corrupted entries
+    auto folder = fmt::format(".{}.cache", TestName());
+    std::filesystem::remove_all(folder);
+    (void)CS350::KdTree::load_or_build(folder, mesh.triangles, config);
+    auto entry = std::filesystem::directory_iterator(folder)->path().string();
+    Overwrite(entry, node_offset + 4, &bad_child, sizeof(bad_child));
+    auto rebuilt = CS350::KdTree::load_or_build(folder, mesh.triangles, config);
+    ASSERT_EQ(rebuilt.nodes().size(), kdTree.nodes().size());
+    ASSERT_NO_THROW((void)CS350::KdTree::load_mmap(entry, hash));
+}
+
+void SharedTree(KdTreeMesh const& mesh) {
+    auto folder = fmt::format(".{}.shared", TestName());
+    std::filesystem::remove_all(folder);
+    CS350::SharedKdTree publisher(folder, "mesh");
+    CS350::SharedKdTree reader(folder, "mesh");
+    ASSERT_EQ(reader.acquire(), nullptr) << "Nothing published yet";
+
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(mesh.triangles, config);
+    ASSERT_EQ(publisher.publish(kdTree, mesh.triangles), 1u);
+
+    // Readers query using the shared triangles
+    auto first = reader.acquire();
+    ASSERT_NE(first, nullptr);
+    ASSERT_EQ(first->triangles().size(), mesh.triangles.size());
+    for (int i = 0; i < 100; ++i) {
+        auto ray = RandomRay(mesh.center, 5.0f, 100.0f);
+        ASSERT_EQ(first->get_closest(ray, nullptr).t, kdTree.get_closest(mesh.triangles, ray, nullptr).t);
+    }
+    ASSERT_EQ(reader.acquire(), first) << "Unchanged version should not be remapped";
+
+    // New versions replace the current one, trees in use remain valid
+    config.max_depth = 2;
+    kdTree.build(mesh.triangles, config);
+    ASSERT_EQ(publisher.publish(kdTree, mesh.triangles), 2u);
+    ASSERT_EQ(publisher.publish(kdTree, mesh.triangles), 3u);
+    auto latest = reader.acquire();
+    ASSERT_EQ(reader.version(), 3u);
+    ASSERT_LE(latest->height(), 2);
+    ASSERT_GT(first->height(), 2);
+    auto ray = RandomRay(mesh.center, 5.0f, 100.0f);
+    ASSERT_EQ(first->get_closest(ray, nullptr).t, latest->get_closest(ray, nullptr).t);
+}
+
+void LoadView(KdTreeMesh const& mesh, std::string const& path) {
+    auto view = CS350::LoadCS350BinaryView(path);
+    ASSERT_EQ(view.positions.size(), mesh.data.positions.size());
+    ASSERT_EQ(view.normals.size(), mesh.data.normals.size());
+    ASSERT_EQ(view.uvs.size(), mesh.data.uvs.size());
+    ASSERT_EQ(view.polygons.size(), mesh.data.polygons.size());
+    ASSERT_EQ(view.bvMin, mesh.data.bvMin);
+    ASSERT_EQ(view.bvMax, mesh.data.bvMax);
+    for (size_t i = 0; i < view.positions.size(); ++i) {
+        ASSERT_EQ(view.positions[i], mesh.data.positions[i]);
+    }
+
+    // Truncated files are detected
+    auto truncated_path = fmt::format(".{}.cs350_binary", TestName());
+    {
+        std::ifstream is(path, std::ios::binary);
+        std::string   content((std::istreambuf_iterator<char>(is)), {});
+        std::ofstream(truncated_path, std::ios::binary).write(content.data(), static_cast<std::streamsize>(content.size() / 2));
+    }
+    ASSERT_THROW((void)CS350::LoadCS350Binary(truncated_path), std::runtime_error);
+}
+
+void LoadSceneAsync(KdTreeMesh const& mesh, std::string const& path) {
+    // Primitive 1 is referenced twice, primitive 0 is not referenced
+    auto scene_path = fmt::format(".{}.scene", TestName());
+    {
+        std::ofstream os(scene_path);
+        for (int i = 0; i < 2; ++i) {
+            os << "1\n1,0,0,0,0,1,0,0,0,0,1,0," << i << ",0,0,1\n";
+        }
+    }
+
+    CS350::ThreadPool     pool(4);
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    std::atomic<int> ready{ 0 };
+    auto             load = CS350::LoadCS350SceneAsync(scene_path, { path, path }, config, pool, [&](size_t index, CS350::CS350LoadedPrimitive const&) {
+        ASSERT_EQ(index, 1u);
+        ++ready;
+    });
+
+    auto const& objects = load.objects.get();
+    ASSERT_EQ(objects.size(), 2u);
+    ASSERT_EQ(objects[1].primitiveIndex, 1);
+    ASSERT_EQ(objects[1].m2w[3][0], 1.0f);
+    ASSERT_EQ(load.primitives[0].get(), nullptr) << "Unreferenced primitives are not loaded";
+    auto primitive = load.primitives[1].get();
+    ASSERT_NE(primitive, nullptr);
+    ASSERT_EQ(ready.load(), 1);
+    ASSERT_EQ(primitive->triangles.size(), mesh.triangles.size());
+    CS350::KdTree reference;
+    reference.build(mesh.triangles, config);
+    ASSERT_EQ(primitive->kdtree.nodes().size(), reference.nodes().size());
+    for (int i = 0; i < 100; ++i) {
+        auto ray = RandomRay(mesh.center, 5.0f, 100.0f);
+        ASSERT_EQ(primitive->kdtree.get_closest(primitive->triangles, ray, nullptr).t, reference.get_closest(mesh.triangles, ray, nullptr).t);
+    }
+
+    // Errors are delivered through the futures
+    auto missing = CS350::LoadCS350SceneAsync(scene_path, { path, "missing.cs350_binary" }, config, pool);
+    ASSERT_THROW((void)missing.primitives[1].get(), std::runtime_error);
+    auto bad = CS350::LoadCS350SceneAsync(scene_path, { path }, config, pool);
+    ASSERT_THROW((void)bad.objects.get(), std::runtime_error);
+    ASSERT_THROW((void)bad.primitives[0].get(), std::runtime_error);
+}
+
+void SceneBinary(int object_count) {
+    // Text scene with mixed separators, blank lines and no trailing new line
+    std::vector<CS350::CS350SceneObject> expected;
+    auto                                 text_path = fmt::format(".{}.scene", TestName());
+    {
+        std::ofstream os(text_path, std::ios::binary);
+        for (int i = 0; i < object_count; ++i) {
+            CS350::CS350SceneObject object{ i % 7, mat4(1.0f) };
+            os << object.primitiveIndex << "\r\n";
+            for (int j = 0; j < 16; ++j) {
+                object.m2w[j / 4][j % 4] = CS170::Utils::Random(-1000.0f, 1000.0f);
+                os << fmt::format("{}{}", object.m2w[j / 4][j % 4], j == 15 ? "" : (j % 2 ? ", " : ","));
+            }
+            os << (i + 1 == object_count ? "" : "\n\n");
+            expected.push_back(object);
+        }
+    }
+    auto expect_equal = [&](std::vector<CS350::CS350SceneObject> const& objects) {
+        ASSERT_EQ(objects.size(), expected.size());
+        for (size_t i = 0; i < objects.size(); ++i) {
+            ASSERT_EQ(objects[i].primitiveIndex, expected[i].primitiveIndex);
+            ASSERT_EQ(objects[i].m2w, expected[i].m2w) << "Floats should round trip exactly";
+        }
+    };
+    expect_equal(CS350::LoadCS350Scene(text_path));
+
+    // Binary scenes are mapped as is, and loaded transparently
+    auto binary_path = fmt::format(".{}.cs350_scene", TestName());
+    CS350::ConvertCS350Scene(text_path, binary_path);
+    auto view = CS350::LoadCS350SceneBinaryView(binary_path);
+    expect_equal(std::vector<CS350::CS350SceneObject>(view.objects.begin(), view.objects.end()));
+    expect_equal(CS350::LoadCS350Scene(binary_path));
+
+    // Malformed files are reported
+    std::ofstream(text_path) << "1\n1,0,0,x\n";
+    ASSERT_THROW((void)CS350::LoadCS350Scene(text_path), std::runtime_error);
+    std::filesystem::resize_file(binary_path, std::filesystem::file_size(binary_path) - 1);
+    ASSERT_THROW((void)CS350::LoadCS350SceneBinaryView(binary_path), std::runtime_error);
+}
+
+void Quantized(KdTreeMesh const& mesh, std::string const& path) {
+    // Encodings
+    ASSERT_EQ(CS350::FloatToHalf(1.0f), 0x3c00);
+    ASSERT_EQ(CS350::FloatToHalf(-2.0f), 0xc000);
+    ASSERT_EQ(CS350::FloatToHalf(1e6f), 0x7c00) << "Overflow should be infinity";
+    ASSERT_EQ(CS350::HalfToFloat(0x7bff), 65504.0f);
+    ASSERT_EQ(CS350::HalfToFloat(0x0001), std::ldexp(1.0f, -24));
+    for (int i = 0; i < 1000; ++i) {
+        float f = CS170::Utils::Random(-10.0f, 10.0f);
+        ASSERT_NEAR(CS350::HalfToFloat(CS350::FloatToHalf(f)), f, std::abs(f) / 1024.0f);
+        vec3 n = glm::normalize(vec3(CS170::Utils::Random(-1.0f, 1.0f), CS170::Utils::Random(-1.0f, 1.0f), CS170::Utils::Random(-1.0f, 1.0f)));
+        ASSERT_GT(glm::dot(CS350::DecodeOctahedral(CS350::EncodeOctahedral(n)), n), 0.99999f);
+    }
+
+    // Round trip of the mesh, about half the size
+    auto quantized_path = fmt::format(".{}.cs350_binary", TestName());
+    CS350::SaveCS350BinaryQuantized(quantized_path, mesh.data);
+    ASSERT_LT(std::filesystem::file_size(quantized_path), std::filesystem::file_size(path) * 55 / 100);
+    auto decoded   = CS350::LoadCS350Binary(quantized_path);
+    auto tolerance = (mesh.data.bvMax - mesh.data.bvMin) / 65535.0f;
+    ASSERT_EQ(decoded.positions.size(), mesh.data.positions.size());
+    for (size_t i = 0; i < decoded.positions.size(); ++i) {
+        for (int axis = 0; axis < 3; ++axis) {
+            ASSERT_NEAR(decoded.positions[i][axis], mesh.data.positions[i][axis], tolerance[axis]);
+        }
+    }
+    ASSERT_THROW((void)CS350::LoadCS350BinaryView(quantized_path), std::runtime_error);
+
+    // Every attribute, indexed
+    CS350::CS350PrimitiveData primitive;
+    primitive.positions = { vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0) };
+    primitive.normals   = { vec3(0, 0, 1), vec3(0, 0, -1), glm::normalize(vec3(1, 1, 1)) };
+    primitive.uvs       = { vec2(0, 0), vec2(1, 0.5f), vec2(0.25f, 1) };
+    primitive.polygons  = { { 0, 1, 2 } };
+    CS350::SaveCS350BinaryQuantized(quantized_path, primitive);
+    auto attributes = CS350::LoadCS350Binary(quantized_path);
+    ASSERT_EQ(attributes.positions, primitive.positions);
+    ASSERT_EQ(attributes.uvs, primitive.uvs);
+    ASSERT_EQ(attributes.polygons, primitive.polygons);
+    for (size_t i = 0; i < primitive.normals.size(); ++i) {
+        ASSERT_GT(glm::dot(attributes.normals[i], primitive.normals[i]), 0.99999f);
+    }
+
+    // Positions kept quantized, dequantized in the leaves
+    CS350::SaveCS350BinaryQuantized(quantized_path, mesh.data);
+    auto triangles = CS350::LoadCS350BinaryQuantized(quantized_path);
+    ASSERT_EQ(triangles.size(), mesh.triangles.size());
+    ASSERT_EQ(triangles.memory_bytes() * 2, mesh.triangles.size() * sizeof(CS350::Triangle));
+    auto                  dequantized = triangles.dequantize();
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(dequantized, config);
+    for (int i = 0; i < 100; ++i) {
+        auto ray         = RandomRay(mesh.center, 5.0f, 100.0f);
+        auto from_codes  = kdTree.get_closest(triangles, ray, nullptr);
+        auto from_floats = kdTree.get_closest(dequantized, ray, nullptr);
+        ASSERT_EQ(from_codes.t, from_floats.t);
+        ASSERT_EQ(from_codes.triangle_index, from_floats.triangle_index);
+    }
+}
+
+void Weld(KdTreeMesh const& mesh) {
+    CS350::ThreadPool pool(4);
+    auto              welded = CS350::WeldVertices(mesh.data, 1e-6f, &pool);
+    ASSERT_EQ(welded.polygons.size(), mesh.triangles.size());
+    ASSERT_LT(welded.positions.size() * 4, mesh.data.positions.size()) << "Closed meshes share most vertices";
+    for (size_t i = 0; i < welded.polygons.size(); ++i) {
+        for (size_t k = 0; k < 3; ++k) {
+            for (int axis = 0; axis < 3; ++axis) {
+                ASSERT_NEAR(welded.positions.at(size_t(welded.polygons[i][k]))[axis], mesh.triangles[i][k][axis], 1e-6f);
+            }
+        }
+    }
+    auto sequential = CS350::WeldVertices(mesh.data, 1e-6f);
+    ASSERT_EQ(sequential.positions, welded.positions) << "Welding should be deterministic";
+    ASSERT_EQ(sequential.polygons, welded.polygons) << "Welding should be deterministic";
+
+    // Queries on the shared vertex buffer
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(mesh.triangles, config);
+    CS350::IndexedTriangles indexed{ welded.positions, welded.polygons };
+    for (int i = 0; i < 100; ++i) {
+        auto ray = RandomRay(mesh.center, 5.0f, 100.0f);
+        ASSERT_NEAR(kdTree.get_closest(indexed, ray, nullptr).t, kdTree.get_closest(mesh.triangles, ray, nullptr).t, 0.001f);
+    }
+
+    // Epsilon across cell boundaries, other attributes must match too
+    CS350::CS350PrimitiveData primitive;
+    primitive.positions = { vec3(0.0f), vec3(1, 0, 0), vec3(0, 1, 0), vec3(-0.5e-3f, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0) };
+    primitive.normals   = { vec3(0, 0, 1), vec3(0, 0, 1), vec3(0, 0, 1), vec3(0, 0, 1), vec3(0, 0, 1), vec3(0, 0, -1) };
+    auto small          = CS350::WeldVertices(primitive, 1e-3f);
+    ASSERT_EQ(small.positions.size(), 4u);
+    ASSERT_EQ(small.polygons[1], (std::array<int, 3>{ 0, 1, 3 }));
+}
+
+void StatsThreads(KdTreeMesh const& mesh) {
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(mesh.triangles, config);
+    std::vector<CS350::Ray> rays;
+    for (int i = 0; i < 4000; ++i) {
+        rays.push_back(RandomRay(mesh.center, 5.0f, 100.0f));
+    }
+
+    for (auto const& ray : rays) {
+        (void)kdTree.get_closest<CS350::Instrumentation::Counters>(mesh.triangles, ray, nullptr);
+    }
+    auto expected = CS350::Stats::Instance().TakeSnapshot();
+    ASSERT_GT(expected.rayVsTriangle, 0u);
+
+    // Same queries from several threads, nothing is lost
+    CS350::Stats::Instance().Reset();
+    ASSERT_EQ(CS350::Stats::Instance().TakeSnapshot().rayVsAabb, 0u);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            for (size_t i = t; i < rays.size(); i += 4) {
+                (void)kdTree.get_closest<CS350::Instrumentation::Counters>(mesh.triangles, rays[i], nullptr);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    auto snapshot = CS350::Stats::Instance().TakeSnapshot();
+    ASSERT_EQ(snapshot.rayVsTriangle, expected.rayVsTriangle);
+    ASSERT_EQ(snapshot.rayVsAabb, expected.rayVsAabb);
+    ASSERT_EQ(CS350::Stats::Instance().rayVsAabb, expected.rayVsAabb);
+}
+
+void InstrumentationLevels(KdTreeMesh const& mesh) {
+    using CS350::Instrumentation;
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(mesh.triangles, config);
+    for (int i = 0; i < 100; ++i) {
+        auto ray = RandomRay(mesh.center, 5.0f, 100.0f);
+
+        CS350::Stats::Instance().Reset();
+        CS350::KdTree::DebugStats none_stats;
+        auto                      none = kdTree.get_closest<Instrumentation::None>(mesh.triangles, ray, &none_stats);
+        ASSERT_EQ(CS350::Stats::Instance().rayVsAabb, 0u);
+        ASSERT_EQ(CS350::Stats::Instance().rayVsTriangle, 0u);
+        ASSERT_TRUE(none_stats.traversed_nodes.empty());
+
+        CS350::KdTree::DebugStats counters_stats;
+        auto                      counters = kdTree.get_closest<Instrumentation::Counters>(mesh.triangles, ray, &counters_stats);
+        auto                      counted  = CS350::Stats::Instance().TakeSnapshot();
+        ASSERT_GT(counted.rayVsAabb, 0u);
+        ASSERT_TRUE(counters_stats.traversed_nodes.empty());
+
+        CS350::Stats::Instance().Reset();
+        CS350::KdTree::DebugStats trace_stats;
+        auto                      trace = kdTree.get_closest<Instrumentation::Trace>(mesh.triangles, ray, &trace_stats);
+        ASSERT_EQ(CS350::Stats::Instance().rayVsAabb, counted.rayVsAabb);
+        ASSERT_EQ(CS350::Stats::Instance().rayVsTriangle, trace_stats.tested_triangles.size());
+        ASSERT_FALSE(trace_stats.traversed_nodes.empty());
+
+        ASSERT_EQ(none.t, trace.t);
+        ASSERT_EQ(counters.t, trace.t);
+    }
+}
+
+void TraceSinks(KdTreeMesh const& mesh) {
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(mesh.triangles, config);
+    auto ray = CS350::Ray(mesh.center + vec3(0, 0, 10), vec3(0, 0, -1));
+
+    CS350::KdTree::DebugStats reference;
+    (void)kdTree.get_closest<CS350::Instrumentation::Trace>(mesh.triangles, ray, &reference);
+    size_t event_count = reference.traversed_nodes.size() + reference.tested_triangles.size();
+    ASSERT_GT(reference.tested_triangles.size(), 8u);
+
+    // Ring keeps the newest events
+    CS350::TraceSink          ring(8, CS350::TraceSink::Mode::Ring);
+    CS350::KdTree::DebugStats ring_stats;
+    ring_stats.sink = &ring;
+    (void)kdTree.get_closest<CS350::Instrumentation::Trace>(mesh.triangles, ray, &ring_stats);
+    ASSERT_TRUE(ring_stats.traversed_nodes.empty() && ring_stats.tested_triangles.empty()) << "Sink should replace the vectors";
+    ASSERT_EQ(ring.recorded(), event_count);
+    ASSERT_EQ(ring.size(), 8u);
+    ASSERT_EQ(ring.overflow(), event_count - 8);
+    ASSERT_EQ(ring[7].kind, CS350::TraceSink::Kind::Triangle);
+    ASSERT_EQ(ring[7].index, reference.tested_triangles.back());
+
+    // Fixed keeps the first ones, the root is always the first node
+    CS350::TraceSink          fixed(8, CS350::TraceSink::Mode::Fixed);
+    CS350::KdTree::DebugStats fixed_stats;
+    fixed_stats.sink = &fixed;
+    (void)kdTree.get_closest<CS350::Instrumentation::Trace>(mesh.triangles, ray, &fixed_stats);
+    ASSERT_EQ(fixed.overflow(), event_count - 8);
+    ASSERT_EQ(fixed[0].kind, CS350::TraceSink::Kind::Node);
+    ASSERT_EQ(fixed[0].index, 0u);
+
+    // Callbacks see everything
+    size_t                    triangles = 0;
+    CS350::TraceSink          callback([](void* user, CS350::TraceSink::Event event) {
+        if (event.kind == CS350::TraceSink::Kind::Triangle) {
+            ++*static_cast<size_t*>(user);
+        }
+    }, &triangles);
+    CS350::KdTree::DebugStats callback_stats;
+    callback_stats.sink = &callback;
+    (void)kdTree.get_closest<CS350::Instrumentation::Trace>(mesh.triangles, ray, &callback_stats);
+    ASSERT_EQ(triangles, reference.tested_triangles.size());
+    ASSERT_EQ(callback.overflow(), 0u);
+}
+
+void Generated(CS350::MeshShape shape, size_t triangle_count) {
+    CS350::MeshGeneratorConfig cfg;
+    cfg.shape          = shape;
+    cfg.triangle_count = triangle_count;
+    cfg.seed           = 350;
+    CS350::ThreadPool pool(4);
+    auto              triangles = CS350::GenerateTriangles(cfg, &pool);
+    ASSERT_GE(triangles.size(), triangle_count);
+    ASSERT_LT(triangles.size(), triangle_count * 2);
+    for (auto const& triangle : triangles) {
+        for (auto const& point : triangle.points) {
+            for (int axis = 0; axis < 3; ++axis) {
+                ASSERT_LE(std::abs(point[axis]), cfg.extent * 1.0001f);
+            }
+        }
+    }
+
+    // Deterministic: pool or not, any range on its own
+    auto sequential = CS350::GenerateTriangles(cfg);
+    ASSERT_EQ(std::memcmp(sequential.data(), triangles.data(), triangles.size() * sizeof(CS350::Triangle)), 0);
+    CS350::MeshGenerator generator(cfg);
+    CS350::Triangle      last = generator[triangles.size() - 1];
+    ASSERT_EQ(std::memcmp(&triangles.back(), &last, sizeof(CS350::Triangle)), 0);
+    cfg.seed = 351;
+    if (shape != CS350::MeshShape::Sphere) {
+        ASSERT_NE(std::memcmp(CS350::GenerateTriangles(cfg).data(), triangles.data(), triangles.size() * sizeof(CS350::Triangle)), 0);
+    }
+    cfg.seed = 350;
+
+    // Streamed file, loadable as any other asset
+    auto file = fmt::format(".{}.cs350_binary", TestName());
+    CS350::SaveGeneratedCS350Binary(file, cfg, &pool);
+    auto loaded = CS350::LoadCS350Binary(file);
+    std::filesystem::remove(file);
+    ASSERT_TRUE(loaded.polygons.empty());
+    ASSERT_EQ(loaded.positions.size(), triangles.size() * 3);
+    ASSERT_EQ(std::memcmp(loaded.positions.data(), triangles.data(), triangles.size() * sizeof(CS350::Triangle)), 0);
+
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(triangles, config);
+    for (int i = 0; i < 100; ++i) {
+        auto ray = RandomRay(vec3(-2.0f), 4.0f, 20.0f);
+        ASSERT_NEAR(kdTree.get_closest(triangles, ray, nullptr).t, ClosestIntersection(ray, triangles).t, 0.001f);
+    }
+}
+
+void PerfCountersQueries(KdTreeMesh const& mesh) {
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(mesh.triangles, config);
+
+    // Counters start disabled, whatever is available must count the scope only
+    CS350::PerfCounters perf;
+    auto                idle = perf.read();
+    {
+        CS350::PerfScope scope(perf);
+        for (int i = 0; i < 1000; ++i) {
+            (void)kdTree.get_closest(mesh.triangles, RandomRay(mesh.center, 5.0f, 100.0f), nullptr);
+        }
+    }
+    auto sample = perf.read();
+    auto after  = perf.read();
+    for (int e = 0; e < CS350::PerfCounters::cEventCount; ++e) {
+        auto event = CS350::PerfCounters::Event(e);
+        ASSERT_EQ(sample.valid[size_t(e)], perf.available(event));
+        if (!perf.available(event)) {
+            ASSERT_EQ(sample[event], 0u);
+            continue;
+        }
+        ASSERT_EQ(idle[event], 0u) << CS350::PerfCounters::Name(event);
+        ASSERT_EQ(after[event], sample[event]) << "Stopped counters should not move";
+    }
+    if (perf.available(CS350::PerfCounters::cInstructions)) {
+        ASSERT_GT(sample[CS350::PerfCounters::cInstructions], 1000u * 100u);
+    }
+    perf.reset();
+    if (perf.available(CS350::PerfCounters::cInstructions)) {
+        ASSERT_EQ(perf.read()[CS350::PerfCounters::cInstructions], 0u);
+    }
+}
+
+void QualityReport(KdTreeMesh const& mesh) {
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 1;
+    kdTree.build(mesh.triangles, config);
+    auto single = kdTree.quality_report();
+    ASSERT_EQ(single.leaf_count, 1u);
+    ASSERT_FLOAT_EQ(single.sah_cost, config.cost_intersection * float(mesh.triangles.size())) << "A single leaf tests everything";
+    ASSERT_FLOAT_EQ(single.duplication_factor, 1.0f);
+
+    config.max_depth = 0;
+    kdTree.build(mesh.triangles, config);
+    auto report = kdTree.quality_report();
+    ASSERT_EQ(report.node_count, kdTree.nodes().size());
+    ASSERT_EQ(report.node_count, report.leaf_count * 2 - 1) << "Every internal node has two children";
+    ASSERT_EQ(report.max_depth + 1, kdTree.height());
+    ASSERT_EQ(report.triangle_count, mesh.triangles.size());
+    ASSERT_EQ(report.reference_count, kdTree.indices().size());
+    ASSERT_GE(report.duplication_factor, 1.0f);
+    ASSERT_LT(report.sah_cost, single.sah_cost);
+    ASSERT_EQ(std::accumulate(report.leaf_size_histogram.begin(), report.leaf_size_histogram.end(), size_t(0)), report.leaf_count);
+    ASSERT_EQ(std::accumulate(report.depth_histogram.begin(), report.depth_histogram.end(), size_t(0)), report.leaf_count);
+    ASSERT_EQ(report.leaf_size_histogram.empty() ? 0u : report.leaf_size_histogram[0], report.empty_leaf_count);
+    ASSERT_EQ(report.total_bytes(), report.node_bytes + report.aabb_bytes + report.index_bytes);
+
+    auto json = report.to_json();
+    for (auto const* key : { "\"sah_cost\"", "\"leaf_size_histogram\"", "\"depth_histogram\"", "\"duplication_factor\"", "\"memory_bytes\"" }) {
+        ASSERT_NE(json.find(key), std::string::npos) << key;
+    }
+    ASSERT_EQ(std::count(json.begin(), json.end(), '{'), std::count(json.begin(), json.end(), '}'));
+}
+
+void ChromeTraceBuild(KdTreeMesh const& mesh, std::string const& file) {
+    auto& trace = CS350::ChromeTrace::Instance();
+    ASSERT_FALSE(trace.enabled());
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(mesh.triangles, config);
+    ASSERT_TRUE(trace.events().empty()) << "Nothing is recorded while disabled";
+
+    trace.start();
+    (void)CS350::LoadCS350Binary(file);
+    kdTree.build(mesh.triangles, config);
+    std::thread([&] {
+        CS350::KdTree other;
+        other.build(mesh.triangles, config);
+    }).join();
+    trace.stop();
+    kdTree.build(mesh.triangles, config);
+
+    auto events = trace.events();
+    auto count  = [&](char const* name, uint32_t tid) {
+        return std::count_if(events.begin(), events.end(), [&](CS350::ChromeTrace::Event const& e) {
+            return std::string(e.name) == name && (tid == 0 || e.tid == tid);
+        });
+    };
+    uint32_t main_tid = CS350::ChromeTrace::ThreadId();
+    ASSERT_EQ(count("build", 0), 2);
+    ASSERT_EQ(count("build", main_tid), 1) << "Events carry their thread";
+    ASSERT_EQ(count("triangle_bounds", 0), 2);
+    ASSERT_EQ(count("LoadCS350Binary", main_tid), 1);
+    ASSERT_EQ(count("io", main_tid), 1);
+    ASSERT_EQ(count("decode", main_tid), 1);
+    ASSERT_GT(count("subtree", main_tid), 0);
+    ASSERT_GT(count("find_split", main_tid), 0);
+    ASSERT_GT(count("partition", main_tid), 0);
+    for (auto const& event : events) {
+        ASSERT_GE(event.begin_us, 0.0);
+        ASSERT_GE(event.duration_us, 0.0);
+        if (std::string(event.name) == "subtree") {
+            ASSERT_GE(event.arg_value, 1024u) << "Small subtrees are not traced";
+        }
+    }
+
+    auto path = fmt::format(".{}.json", TestName());
+    trace.save(path);
+    std::ifstream is(path);
+    std::string   json((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    std::filesystem::remove(path);
+    ASSERT_EQ(json, trace.to_json());
+    ASSERT_NE(json.find("\"traceEvents\""), std::string::npos);
+    ASSERT_EQ(size_t(std::count(json.begin(), json.end(), '\n')), events.size() + 3);
+}
+
+void ConfigTuning(KdTreeMesh const& mesh) {
+    std::vector<CS350::Ray> rays;
+    for (int i = 0; i < 2048; ++i) {
+        rays.push_back(RandomRay(mesh.center, 5.0f, 100.0f));
+    }
+    CS350::ThreadPool   pool(4);
+    CS350::TunerOptions options;
+    options.cost_intersection = { 1.0f, 10.0f, 80.0f };
+    options.max_depth         = { 1, 0 };
+    options.min_triangles     = { 1, 50 };
+    options.pool              = &pool;
+    auto report               = CS350::TuneConfig(mesh.triangles, rays, options);
+
+    // 12 candidates: 6, 3, 1 survive rounds of 256, 512 and 1024 rays
+    ASSERT_EQ(report.candidates.size(), 12u);
+    ASSERT_EQ(report.rounds, 3);
+    auto const& best = report.candidates.front();
+    ASSERT_EQ(best.rounds, report.rounds);
+    ASSERT_EQ(best.config.cost_intersection, report.best.cost_intersection);
+    ASSERT_EQ(best.config.max_depth, report.best.max_depth);
+    ASSERT_EQ(best.config.min_triangles, report.best.min_triangles);
+    ASSERT_NE(report.best.max_depth, 1) << "A single leaf can not be the fastest";
+    for (size_t i = 1; i < report.candidates.size(); ++i) {
+        ASSERT_LE(report.candidates[i].rounds, report.candidates[i - 1].rounds);
+        ASSERT_NEAR(report.candidates[i].hit_ratio, best.hit_ratio, 0.1) << "Every tree answers the same";
+    }
+    auto json = report.to_json();
+    ASSERT_NE(json.find("\"best\""), std::string::npos);
+    ASSERT_EQ(size_t(std::count(json.begin(), json.end(), '{')), report.candidates.size() + 2);
+
+    // The result is a regular config
+    CS350::KdTree kdTree;
+    kdTree.build(mesh.triangles, report.best);
+    for (size_t i = 0; i < 100; ++i) {
+        ASSERT_NEAR(kdTree.get_closest(mesh.triangles, rays[i], nullptr).t, ClosestIntersection(rays[i], mesh.triangles).t, 0.01f);
+    }
+    ASSERT_THROW(CS350::TuneConfig(mesh.triangles, {}, options), std::runtime_error);
+}
+
+void CostCalibration(KdTreeMesh const& mesh) {
+    auto calibration = CS350::CalibrateCosts();
+    ASSERT_GT(calibration.traversal_ns, 0.0f);
+    ASSERT_GT(calibration.intersection_ns, 0.0f);
+    ASSERT_EQ(calibration.host, CS350::CostCalibrationHostId());
+    ASSERT_EQ(calibration.host.find('\t'), std::string::npos);
+
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    auto calibrated  = calibration.apply(config);
+    ASSERT_EQ(calibrated.cost_traversal, 1.0f);
+    ASSERT_FLOAT_EQ(calibrated.cost_intersection, calibration.intersection_ns / calibration.traversal_ns);
+    ASSERT_EQ(calibrated.max_depth, 0);
+    ASSERT_EQ(calibrated.min_triangles, config.min_triangles);
+    CS350::KdTree kdTree;
+    kdTree.build(mesh.triangles, calibrated);
+    EnsureAllTrianglesContained(mesh, kdTree);
+
+    // Cache: other hosts are kept, this host is measured once
+    auto folder = fmt::format(".{}.cache", TestName());
+    auto file   = folder + "/sah_costs.txt";
+    std::filesystem::remove_all(folder);
+    std::filesystem::create_directories(folder);
+    {
+        std::ofstream os(file);
+        os << "some other host\t2\t3\n";
+        os << calibration.host << "\tnot-a-number\n";
+    }
+    auto first  = CS350::LoadOrCalibrateCosts(file);
+    auto second = CS350::LoadOrCalibrateCosts(file);
+    ASSERT_GT(first.traversal_ns, 0.0f) << "Corrupt entries are measured again";
+    ASSERT_EQ(second.traversal_ns, first.traversal_ns);
+    ASSERT_EQ(second.intersection_ns, first.intersection_ns);
+    ASSERT_EQ(second.host, calibration.host);
+    std::ifstream            is(file);
+    std::string              line;
+    std::vector<std::string> lines;
+    while (std::getline(is, line)) {
+        lines.push_back(line);
+    }
+    std::filesystem::remove_all(folder);
+    ASSERT_EQ(lines.size(), 2u);
+    ASSERT_EQ(lines[0], "some other host\t2\t3");
+    ASSERT_EQ(lines[1].rfind(calibration.host + "\t", 0), 0u);
+}
+
+void QueryLog(KdTreeMesh const& mesh) {
+    std::vector<CS350::Ray> rays;
+    for (int i = 0; i < 1000; ++i) {
+        rays.push_back(RandomRay(mesh.center, 5.0f, 100.0f));
+    }
+
+    // Two threads, every other query kept, buffers smaller than the log
+    auto path = fmt::format(".{}.cs350_queries", TestName());
+    std::filesystem::remove(path); // Left by an interrupted run, would be appended to
+    {
+        CS350::QueryRecorder recorder(path, 2, 64);
+        std::thread          other([&] {
+            for (size_t i = 500; i < rays.size(); ++i) {
+                recorder.record(rays[i], CS350::QueryType::Occlusion, 0.0f, 50.0f);
+            }
+        });
+        for (size_t i = 0; i < 500; ++i) {
+            recorder.record(rays[i]);
+        }
+        other.join();
+        ASSERT_EQ(recorder.seen(), rays.size());
+        ASSERT_EQ(recorder.recorded(), rays.size() / 2);
+    }
+    auto log = CS350::LoadQueryLogView(path);
+    ASSERT_EQ(log.records.size(), rays.size() / 2);
+    size_t occlusion = 0;
+    for (auto const& record : log.records) {
+        auto found = std::find_if(rays.begin(), rays.end(), [&](CS350::Ray const& ray) { return ray.origin == record.origin && ray.direction == record.direction; });
+        ASSERT_NE(found, rays.end()) << "Records are stored as is";
+        occlusion += record.type == CS350::QueryType::Occlusion ? 1 : 0;
+        ASSERT_EQ(record.type == CS350::QueryType::Occlusion, found - rays.begin() >= 500);
+    }
+    ASSERT_GT(occlusion, 0u);
+
+    // Any tree configuration answers the same
+    std::vector<CS350::QueryRecord> records(log.records.begin(), log.records.end());
+    log = {}; // Unmapped, the file is rewritten below
+    size_t expected_hits[2] = {};
+    for (auto const& record : records) {
+        auto hit = ClosestIntersection(CS350::Ray(record.origin, record.direction), mesh.triangles);
+        expected_hits[size_t(record.type)] += hit && hit.t >= record.t_min && hit.t <= record.t_max ? 1 : 0;
+    }
+    // Ranged records are timed, but not counted as hits
+    auto replayed = records;
+    replayed.push_back(records.front());
+    replayed.back().t_min = 1.0f;
+    for (int depth : { 1, 8, 0 }) {
+        CS350::KdTree         kdTree;
+        CS350::KdTree::Config config;
+        config.max_depth = depth;
+        kdTree.build(mesh.triangles, config);
+        auto report = CS350::ReplayQueries(kdTree, mesh.triangles, replayed, 2);
+        ASSERT_EQ(report.queries, replayed.size() * 2);
+        ASSERT_EQ(report.closest_queries + report.occlusion_queries, replayed.size());
+        ASSERT_EQ(report.occlusion_queries, occlusion + (replayed.back().type == CS350::QueryType::Occlusion ? 1 : 0));
+        ASSERT_EQ(report.ranged_queries, 1u);
+        ASSERT_EQ(report.closest_hits, expected_hits[size_t(CS350::QueryType::Closest)]);
+        ASSERT_EQ(report.occlusion_hits, expected_hits[size_t(CS350::QueryType::Occlusion)]);
+        ASSERT_EQ(report.hits, report.closest_hits + report.occlusion_hits);
+        ASSERT_GT(report.queries_per_second, 0.0);
+        ASSERT_LE(report.p50_ns, report.p90_ns);
+        ASSERT_LE(report.p90_ns, report.p99_ns);
+        ASSERT_LE(report.p999_ns, report.max_ns);
+        ASSERT_NE(report.to_json().find("\"latency_ns\""), std::string::npos);
+    }
+
+    // Interrupted writes leave a partial record, which is ignored
+    {
+        std::ofstream os(path, std::ios::binary | std::ios::app);
+        os.write("partial", 7);
+    }
+    ASSERT_EQ(CS350::LoadQueryLogView(path).records.size(), records.size());
+
+    // Recorders append to existing logs, after the last whole record
+    {
+        CS350::QueryRecorder recorder(path);
+        recorder.record(rays[0], CS350::QueryType::Occlusion, 0.0f, 1.0f);
+    }
+    {
+        auto appended = CS350::LoadQueryLogView(path);
+        ASSERT_EQ(appended.records.size(), records.size() + 1);
+        ASSERT_EQ(std::memcmp(appended.records.data(), records.data(), records.size() * sizeof(CS350::QueryRecord)), 0);
+        ASSERT_EQ(appended.records[records.size()].origin, rays[0].origin);
+        ASSERT_EQ(appended.records[records.size()].type, CS350::QueryType::Occlusion);
+    }
+    CS350::SaveQueryLog(path, records);
+    auto saved = CS350::LoadQueryLogView(path);
+    ASSERT_EQ(std::memcmp(saved.records.data(), records.data(), records.size() * sizeof(CS350::QueryRecord)), 0);
+    saved = {};
+    std::filesystem::remove(path);
+}
+
+void LatencyHistograms(KdTreeMesh const& mesh) {
+    // Exact below 2^precision, bounded relative error above, percentiles never under report
+    CS350::Histogram histogram(7);
+    for (uint64_t v = 1; v <= 100000; ++v) {
+        histogram.record(v);
+    }
+    ASSERT_EQ(histogram.count(), 100000u);
+    ASSERT_EQ(histogram.min(), 1u);
+    ASSERT_EQ(histogram.max(), 100000u);
+    ASSERT_NEAR(histogram.mean(), 50000.5, 1e-6);
+    for (double fraction : { 0.5, 0.9, 0.99, 0.999 }) {
+        auto exact = uint64_t(fraction * 100000.0);
+        ASSERT_GE(histogram.percentile(fraction), exact);
+        ASSERT_LE(double(histogram.percentile(fraction)), double(exact) * (1.0 + 1.0 / 64.0));
+    }
+    ASSERT_EQ(histogram.percentile(1.0), 100000u);
+    ASSERT_EQ(histogram.percentile(0.0), 1u);
+    uint64_t in_buckets = 0;
+    for (auto const& bucket : histogram.buckets()) {
+        ASSERT_LE(bucket.lowest, bucket.highest);
+        in_buckets += bucket.count;
+        if (bucket.lowest < 128) {
+            ASSERT_EQ(bucket.lowest, bucket.highest);
+        }
+    }
+    ASSERT_EQ(in_buckets, histogram.count());
+
+    CS350::Histogram low(7);
+    CS350::Histogram high(7);
+    for (uint64_t v = 1; v <= 100000; ++v) {
+        (v <= 50000 ? low : high).record(v);
+    }
+    low.merge(high);
+    ASSERT_EQ(low.to_json(), histogram.to_json());
+    ASSERT_THROW(low.merge(CS350::Histogram(8)), std::runtime_error);
+    low.record(UINT64_MAX);
+    ASSERT_EQ(low.percentile(1.0), UINT64_MAX);
+    low.reset();
+    ASSERT_EQ(low.count(), 0u);
+    ASSERT_EQ(low.percentile(0.99), 0u);
+
+    // Calibrated timestamps follow the wall clock
+    ASSERT_GT(CS350::CycleClock::NanosecondsPerTick(), 0.0);
+    auto start = CS350::CycleClock::Now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto slept = double(CS350::CycleClock::ToNanoseconds(CS350::CycleClock::Now() - start));
+    ASSERT_GT(slept, 15e6);
+    ASSERT_LT(slept, 500e6);
+
+    // Profiled queries answer as usual and count what a trace records
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(mesh.triangles, config);
+    CS350::QueryProfiler profiler;
+    CS350::QueryProfiler latency_only(false);
+    CS350::Histogram     nodes;
+    CS350::Histogram     triangles;
+    for (int i = 0; i < 1000; ++i) {
+        auto ray = RandomRay(mesh.center, 5.0f, 100.0f);
+        auto hit = kdTree.get_closest<CS350::Instrumentation::None>(mesh.triangles, ray, nullptr);
+        ASSERT_EQ(profiler.get_closest(kdTree, mesh.triangles, ray).t, hit.t);
+        ASSERT_EQ(latency_only.get_closest(kdTree, mesh.triangles, ray).t, hit.t);
+        CS350::KdTree::DebugStats stats;
+        (void)kdTree.get_closest<CS350::Instrumentation::Trace>(mesh.triangles, ray, &stats);
+        nodes.record(stats.traversed_nodes.size());
+        triangles.record(stats.tested_triangles.size());
+    }
+    auto const& histograms = profiler.histograms();
+    ASSERT_EQ(histograms.latency_ns.count(), 1000u);
+    ASSERT_EQ(histograms.nodes_visited.to_json(), nodes.to_json());
+    ASSERT_EQ(histograms.triangles_tested.to_json(), triangles.to_json());
+    ASSERT_EQ(latency_only.histograms().latency_ns.count(), 1000u);
+    ASSERT_EQ(latency_only.histograms().nodes_visited.count(), 0u);
+    ASSERT_GT(histograms.latency_ns.percentile(0.5), 0u);
+    ASSERT_LE(histograms.latency_ns.percentile(0.99), histograms.latency_ns.percentile(0.999));
+
+    CS350::QueryHistograms merged;
+    merged.merge(histograms);
+    merged.merge(latency_only.histograms());
+    ASSERT_EQ(merged.latency_ns.count(), 2000u);
+    auto json = merged.to_json();
+    for (char const* key : { "\"latency_ns\"", "\"nodes_visited\"", "\"triangles_tested\"", "\"p999\"", "\"buckets\"" }) {
+        ASSERT_NE(json.find(key), std::string::npos) << key;
+    }
+    std::cout << histograms;
+}
+
+void PerfGate(KdTreeMesh const& mesh) {
+    // Synthetic metrics: noisy timings around 100, a counted metric
+    std::mt19937                     rng(0x350);
+    std::normal_distribution<double> noise(0.0, 2.0);
+    auto                             timed = [&](double center, bool higher_is_better) {
+        CS350::PerfMetric metric{ higher_is_better, true, {} };
+        for (int i = 0; i < 9; ++i) {
+            metric.samples.push_back(center + noise(rng));
+        }
+        return metric;
+    };
+    CS350::PerfBaseline baseline;
+    baseline.host                            = "host";
+    baseline.metrics["mesh/build_ms"]        = timed(100.0, false);
+    baseline.metrics["mesh/rays_per_second"] = timed(100.0, true);
+    baseline.metrics["mesh/nodes_per_ray"]   = CS350::PerfMetric{ false, false, { 10.0 } };
+
+    auto path = fmt::format(".{}.json", TestName());
+    CS350::SavePerfBaseline(path, baseline);
+    auto loaded = CS350::LoadPerfBaseline(path);
+    std::filesystem::remove(path);
+    ASSERT_EQ(loaded.host, baseline.host);
+    ASSERT_EQ(loaded.to_json(), baseline.to_json());
+
+    // Same distributions pass, clear regressions fail in either direction
+    CS350::PerfBaseline same = baseline;
+    same.metrics["mesh/build_ms"]        = timed(101.0, false);
+    same.metrics["mesh/rays_per_second"] = timed(99.0, true);
+    auto report                          = CS350::ComparePerf(loaded, same);
+    ASSERT_TRUE(report.passed) << report.to_text();
+    ASSERT_EQ(report.results.size(), 3u);
+
+    CS350::PerfBaseline slower = same;
+    slower.metrics["mesh/rays_per_second"] = timed(70.0, true);
+    report                                 = CS350::ComparePerf(loaded, slower);
+    ASSERT_FALSE(report.passed);
+    for (auto const& result : report.results) {
+        ASSERT_EQ(result.failed, result.name == "mesh/rays_per_second") << result.name;
+        ASSERT_LE(result.regression_low, result.regression);
+        ASSERT_GE(result.regression_high, result.regression);
+    }
+
+    CS350::PerfBaseline faster = same;
+    faster.metrics["mesh/build_ms"] = timed(60.0, false);
+    report                          = CS350::ComparePerf(loaded, faster);
+    ASSERT_TRUE(report.passed);
+    ASSERT_TRUE(report.results[0].improved);
+
+    // Counted metrics have no noise, the tolerance alone decides
+    CS350::PerfBaseline more_nodes = same;
+    more_nodes.metrics["mesh/nodes_per_ray"].samples = { 10.5 };
+    ASSERT_FALSE(CS350::ComparePerf(loaded, more_nodes).passed);
+    more_nodes.metrics["mesh/nodes_per_ray"].samples = { 10.05 };
+    ASSERT_TRUE(CS350::ComparePerf(loaded, more_nodes).passed);
+
+    // Other hosts: timed metrics skipped. Missing metrics fail, new ones are listed
+    CS350::PerfGateOptions options;
+    options.compare_timed = false;
+    report                = CS350::ComparePerf(loaded, slower, options);
+    ASSERT_TRUE(report.passed);
+    ASSERT_TRUE(std::all_of(report.results.begin(), report.results.end(), [](auto const& r) { return r.skipped || r.name == "mesh/nodes_per_ray"; }));
+    CS350::PerfBaseline renamed = same;
+    renamed.metrics.erase("mesh/nodes_per_ray");
+    renamed.metrics["other/nodes_per_ray"] = CS350::PerfMetric{ false, false, { 10.0 } };
+    report                                 = CS350::ComparePerf(loaded, renamed);
+    ASSERT_FALSE(report.passed);
+    ASSERT_EQ(report.new_metrics, std::vector<std::string>{ "other/nodes_per_ray" });
+    ASSERT_NE(report.to_json().find("\"new_metrics\""), std::string::npos);
+
+    // Real measurements: counted metrics are reproducible
+    std::vector<CS350::Ray> rays;
+    for (int i = 0; i < 500; ++i) {
+        rays.push_back(RandomRay(mesh.center, 5.0f, 100.0f));
+    }
+    CS350::PerfWorkload workload;
+    workload.name             = "bunny/max_depth:0";
+    workload.triangles        = &mesh.triangles;
+    workload.config.max_depth = 0;
+    workload.rays             = rays;
+    auto first                = CS350::MeasurePerf({ workload }, 2);
+    auto second               = CS350::MeasurePerf({ workload }, 2);
+    ASSERT_EQ(first.metrics.size(), 4u);
+    ASSERT_EQ(first.metrics["bunny/max_depth:0/build_ms"].samples.size(), 2u);
+    ASSERT_GT(first.metrics["bunny/max_depth:0/nodes_per_ray"].samples[0], 0.0);
+    options.compare_timed = false;
+    report                = CS350::ComparePerf(first, second, options);
+    ASSERT_TRUE(report.passed) << report.to_text();
+    std::cout << report.to_text();
+}
+
+void RayCast(KdTreeMesh const& mesh) {
+    CS350::KdTree         kdTree;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    kdTree.build(mesh.triangles, config);
+    auto const& bounds = kdTree.aabbs()[0];
+    float       radius = glm::length(bounds.max - bounds.min) * 0.5f;
+
+    CS350::Camera camera;
+    camera.SetPosition(mesh.center + vec3(0.3f, 0.4f, 2.0f) * radius);
+    camera.SetTarget(mesh.center);
+
+    CS350::RenderSettings settings;
+    settings.width      = 96;
+    settings.height     = 64;
+    settings.tile_size  = 8;
+    settings.ao_samples = 4;
+    auto single         = CS350::RenderKdTree(camera, kdTree, mesh.triangles, settings);
+    ASSERT_EQ(single.image.width, settings.width);
+    ASSERT_EQ(single.image.rgba.size(), size_t(96 * 64 * 4));
+    ASSERT_EQ(single.stats.primary_rays, size_t(96 * 64));
+    ASSERT_EQ(single.stats.tiles, 12u * 8u);
+    ASSERT_GT(single.stats.hits, 0u) << "Camera aimed at the mesh";
+    ASSERT_LT(single.stats.hits, single.stats.primary_rays) << "Mesh fits in the view";
+    ASSERT_LE(single.stats.shadow_rays, single.stats.hits);
+    ASSERT_EQ(single.stats.ao_rays, single.stats.hits * settings.ao_samples);
+    ASSERT_GT(single.stats.mrays_per_second, 0.0);
+
+    // Same image for any thread count
+    CS350::ThreadPool pool(4);
+    settings.pool = &pool;
+    auto threaded = CS350::RenderKdTree(camera, kdTree, mesh.triangles, settings);
+    ASSERT_EQ(threaded.stats.threads, 5u);
+    ASSERT_EQ(threaded.stats.total_rays(), single.stats.total_rays());
+    ASSERT_EQ(CS350::ImageDifference(single.image, threaded.image, 0), 0.0);
+
+    // From a task of its own pool, every pool thread busy: the calling thread renders alone
+    CS350::ThreadPool tiny(1);
+    settings.pool = &tiny;
+    auto nested   = tiny.submit([&] { return CS350::RenderKdTree(camera, kdTree, mesh.triangles, settings); }).get();
+    ASSERT_EQ(CS350::ImageDifference(single.image, nested.image, 0), 0.0);
+    settings.pool = &pool;
+
+    // Any tree answers the same (up to ties between triangles at the same distance)
+    CS350::KdTree shallow;
+    config.max_depth = 8;
+    shallow.build(mesh.triangles, config);
+    auto other = CS350::RenderKdTree(camera, shallow, mesh.triangles, settings);
+    ASSERT_LE(CS350::ImageDifference(single.image, other.image), 0.002);
+
+    // PNG round trip, usable as a reference image
+    auto path = fmt::format(".{}.png", TestName());
+    CS350::SavePng(path, threaded.image);
+    auto loaded = CS350::LoadPng(path);
+    std::filesystem::remove(path);
+    ASSERT_EQ(CS350::ImageDifference(loaded, threaded.image, 0), 0.0);
+    ASSERT_THROW((void)CS350::ImageDifference(loaded, CS350::Image(4, 4)), std::runtime_error);
+    std::cout << threaded.stats.to_json();
+}
+
+void Heatmap(KdTreeMesh const& mesh) {
+    CS350::KdTree         deep;
+    CS350::KdTree         shallow;
+    CS350::KdTree::Config config;
+    config.max_depth = 0;
+    deep.build(mesh.triangles, config);
+    config.max_depth = 4;
+    shallow.build(mesh.triangles, config);
+    auto const& bounds = deep.aabbs()[0];
+    float       radius = glm::length(bounds.max - bounds.min) * 0.5f;
+
+    CS350::Camera camera;
+    camera.SetPosition(mesh.center + vec3(0.3f, 0.4f, 2.0f) * radius);
+    camera.SetTarget(mesh.center);
+    CS350::ThreadPool     pool(4);
+    CS350::RenderSettings settings;
+    settings.width  = 64;
+    settings.height = 48;
+    settings.pool   = &pool;
+    settings.mode   = CS350::ParseRenderMode("nodes");
+    ASSERT_EQ(CS350::RenderModeName(settings.mode), std::string("nodes"));
+    ASSERT_THROW((void)CS350::ParseRenderMode("cost"), std::runtime_error);
+
+    // Counts are those of a trace of the pixel ray
+    auto nodes = CS350::RenderKdTree(camera, deep, mesh.triangles, settings);
+    ASSERT_EQ(nodes.counts.size(), size_t(64 * 48));
+    ASSERT_EQ(nodes.stats.shadow_rays + nodes.stats.ao_rays, 0u) << "Heatmaps cast primary rays only";
+    ASSERT_EQ(nodes.stats.heatmap_max, *std::max_element(nodes.counts.begin(), nodes.counts.end()));
+    for (unsigned y = 0; y < settings.height; y += 7) {
+        for (unsigned x = 0; x < settings.width; x += 5) {
+            CS350::KdTree::DebugStats stats;
+            (void)deep.get_closest<CS350::Instrumentation::Trace>(mesh.triangles, CS350::PrimaryRay(camera, settings, x, y), &stats);
+            ASSERT_EQ(nodes.counts[y * settings.width + x], stats.traversed_nodes.size());
+        }
+    }
+
+    // Deeper trees test fewer triangles per ray where the mesh is
+    settings.mode          = CS350::RenderMode::TrianglesTested;
+    auto deep_triangles    = CS350::RenderKdTree(camera, deep, mesh.triangles, settings);
+    auto shallow_triangles = CS350::RenderKdTree(camera, shallow, mesh.triangles, settings);
+    ASSERT_LT(deep_triangles.stats.heatmap_mean, shallow_triangles.stats.heatmap_mean);
+    ASSERT_GT(CS350::ImageDifference(deep_triangles.image, shallow_triangles.image), 0.0);
+
+    // A fixed scale makes images of different trees comparable
+    settings.heatmap_max = shallow_triangles.stats.heatmap_max;
+    auto fixed           = CS350::RenderKdTree(camera, deep, mesh.triangles, settings);
+    ASSERT_EQ(fixed.counts, deep_triangles.counts);
+    if (deep_triangles.stats.heatmap_max != shallow_triangles.stats.heatmap_max) {
+        ASSERT_GT(CS350::ImageDifference(fixed.image, deep_triangles.image), 0.0);
+    }
+    std::cout << fmt::format("triangles per primary ray: {:.2f} (unlimited depth), {:.2f} (depth 4)\n", deep_triangles.stats.heatmap_mean, shallow_triangles.stats.heatmap_mean);
+}
+
+void IndexRanges(KdTreeMesh const& mesh) {
+    for (int max_depth : { 0, 6 }) {
+        CS350::KdTree         kdtree;
+        CS350::KdTree::Config config;
+        config.max_depth = max_depth;
+        kdtree.build(mesh.triangles, config);
+
+        // Every subtree is a contiguous run of indices(), the root covers all of them
+        auto ranges = kdtree.index_ranges();
+        ASSERT_EQ(ranges.size(), kdtree.nodes().size());
+        ASSERT_EQ(ranges[0].first, 0u);
+        ASSERT_EQ(ranges[0].count, kdtree.indices().size());
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            std::vector<size_t> in_range(kdtree.indices().begin() + ranges[i].first, kdtree.indices().begin() + ranges[i].first + ranges[i].count);
+            std::sort(in_range.begin(), in_range.end());
+            in_range.erase(std::unique(in_range.begin(), in_range.end()), in_range.end());
+            ASSERT_EQ(in_range, kdtree.get_triangles(i)) << "Node " << i;
+        }
     }
 }
 
@@ -344,3 +1532,35 @@ TEST_F(KdTree, Efficiency_Dragon_8) { Efficiency(g_dragon, 8); }
 TEST_F(KdTree, Efficiency_Dragon_16) { Efficiency(g_dragon, 16); }
 TEST_F(KdTree, Efficiency_Dragon_Unlimited) { Efficiency(g_dragon, 0); }
 TEST_F(KdTree, Efficiency_Dragon_32) { Efficiency(g_dragon, 32); }
+
+TEST_F(KdTree, SaveLoad_Bunny_4) { SaveLoad(g_bunny, 4); }
+TEST_F(KdTree, SaveLoad_Bunny_Unlimited) { SaveLoad(g_bunny, 0); }
+TEST_F(KdTree, SaveLoad_BunnyDense_Unlimited) { SaveLoad(g_bunny_dense, 0); }
+TEST_F(KdTree, LoadOrBuild_Bunny) { LoadOrBuild(g_bunny); }
+TEST_F(KdTree, CorruptFile_Bunny) { CorruptFile(g_bunny); }
+TEST_F(KdTree, SharedTree_Bunny) { SharedTree(g_bunny); }
+TEST_F(KdTree, LoadView_Bunny) { LoadView(g_bunny, "./assets/cs350/bunny.cs350_binary"); }
+TEST_F(KdTree, LoadSceneAsync_Bunny) { LoadSceneAsync(g_bunny, "./assets/cs350/bunny.cs350_binary"); }
+TEST_F(KdTree, SceneBinary_1000) { SceneBinary(1000); }
+TEST_F(KdTree, Quantized_Bunny) { Quantized(g_bunny, "./assets/cs350/bunny.cs350_binary"); }
+TEST_F(KdTree, Weld_Bunny) { Weld(g_bunny); }
+TEST_F(KdTree, Weld_BunnyDense) { Weld(g_bunny_dense); }
+TEST_F(KdTree, StatsThreads_Bunny) { StatsThreads(g_bunny); }
+TEST_F(KdTree, InstrumentationLevels_Bunny) { InstrumentationLevels(g_bunny); }
+TEST_F(KdTree, TraceSinks_Bunny) { TraceSinks(g_bunny); }
+TEST_F(KdTree, Generated_Sphere) { Generated(CS350::MeshShape::Sphere, 20000); }
+TEST_F(KdTree, Generated_Terrain) { Generated(CS350::MeshShape::Terrain, 20000); }
+TEST_F(KdTree, Generated_Soup) { Generated(CS350::MeshShape::Soup, 20000); }
+TEST_F(KdTree, Generated_Clustered) { Generated(CS350::MeshShape::Clustered, 20000); }
+TEST_F(KdTree, Generated_Slivers) { Generated(CS350::MeshShape::Slivers, 20000); }
+TEST_F(KdTree, PerfCounters_Bunny) { PerfCountersQueries(g_bunny); }
+TEST_F(KdTree, QualityReport_Bunny) { QualityReport(g_bunny); }
+TEST_F(KdTree, ChromeTrace_Bunny) { ChromeTraceBuild(g_bunny, "./assets/cs350/bunny.cs350_binary"); }
+TEST_F(KdTree, TuneConfig_Bunny) { ConfigTuning(g_bunny); }
+TEST_F(KdTree, CostCalibration_Bunny) { CostCalibration(g_bunny); }
+TEST_F(KdTree, QueryLog_Bunny) { QueryLog(g_bunny); }
+TEST_F(KdTree, LatencyHistograms_Bunny) { LatencyHistograms(g_bunny); }
+TEST_F(KdTree, PerfGate_Bunny) { PerfGate(g_bunny); }
+TEST_F(KdTree, RayCast_Bunny) { RayCast(g_bunny); }
+TEST_F(KdTree, Heatmap_Bunny) { Heatmap(g_bunny); }
+TEST_F(KdTree, IndexRanges_Bunny) { IndexRanges(g_bunny); }